@@ -0,0 +1,370 @@
+#include "Benchmarks.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include <boost/thread/thread.hpp>
+#include <boost/filesystem.hpp>
+#include <jsoncpp/json/json.h>
+
+#include "core/JobSystem.hpp"
+#include "core/LuaScript.hpp"
+#include "core/EntityBatch.hpp"
+#include "core/ScriptDomain.hpp"
+#include "map/MapCompiler.hpp"
+#include "map/MapReader.hpp"
+
+extern "C" {
+	#include "lua.h"
+	#include "lualib.h"
+	#include "lauxlib.h"
+}
+
+
+namespace {
+
+///Helper: milliseconds since "start".
+double MsSince(const std::chrono::steady_clock::time_point& start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-start).count();
+}
+
+///A stand-in for an agent that does a bit of math every tick.
+struct Agent {
+	float x, y;
+	float vx, vy;
+};
+
+void UpdateAgents(std::vector<Agent>& agents, size_t first, size_t last)
+{
+	for (size_t i=first; i<last; i++) {
+		Agent& a = agents[i];
+		for (int step=0; step<32; step++) {
+			float angle = std::atan2(a.vy, a.vx) + 0.01f;
+			a.vx = std::cos(angle);
+			a.vy = std::sin(angle);
+			a.x += a.vx;
+			a.y += a.vy;
+		}
+	}
+}
+
+///A line from /proc/self/status ("VmRSS" is resident memory now, "VmHWM" its peak), in bytes.
+/// 0 if we can't tell (e.g., we're not on Linux).
+size_t ProcStatus(const char* field)
+{
+	std::ifstream in("/proc/self/status");
+	std::string line;
+	size_t len = std::strlen(field);
+	while (std::getline(in, line)) {
+		if (line.compare(0, len, field)==0 && line.size()>len && line[len]==':') {
+			return std::strtoull(line.c_str()+len+1, nullptr, 10) * 1024;
+		}
+	}
+	return 0;
+}
+
+///Measure peak memory from now on (Linux only).
+void ResetPeakRss()
+{
+	std::ofstream out("/proc/self/clear_refs");
+	out <<"5";
+}
+
+///Write a map with "numTiles" tiles, of 16 types, on a grid.
+void WriteSyntheticMap(const std::string& file, unsigned int numTiles)
+{
+	std::ofstream out(file.c_str());
+	out <<"{\n  \"background\" : \"0x336699\",\n  \"tiles\" : {\n";
+	for (int i=0; i<16; i++) {
+		out <<"    \"t" <<i <<"\" : \"t" <<i <<".png\"" <<(i<15 ? ",\n" : "\n");
+	}
+	out <<"  },\n  \"tmap\" : [\n";
+	for (unsigned int i=0; i<numTiles; i++) {
+		out <<"    {\"tile\":\"t" <<(i*7)%16 <<"\", \"x\":" <<(i%1000)*32 <<", \"y\":" <<(i/1000)*32 <<"}" <<(i+1<numTiles ? ",\n" : "\n");
+	}
+	out <<"  ],\n  \"onupdate\" : \"this:modify(elapsed)\"\n}\n";
+}
+
+bool ReadWholeFile(const std::string& file, std::string& res)
+{
+	std::ifstream in(file.c_str(), std::ios::binary);
+	res.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	return !!in || in.eof();
+}
+
+} //End un-named namespace
+
+
+int bench::JobScaling(unsigned int maxThreads)
+{
+	const size_t NumAgents = 200000;
+	const size_t Grain = 1024;
+	const int Ticks = 20;
+
+	if (maxThreads==0) {
+		maxThreads = std::max(1U, boost::thread::hardware_concurrency());
+	}
+	printf("JobSystem scaling: %u agents, %d ticks, grain %u\n", static_cast<unsigned int>(NumAgents), Ticks, static_cast<unsigned int>(Grain));
+	printf("%8s %12s %10s\n", "threads", "ms/tick", "speedup");
+
+	double baseline = 0;
+	for (unsigned int threads=1; threads<=maxThreads; threads++) {
+		std::vector<Agent> agents(NumAgents);
+		for (size_t i=0; i<NumAgents; i++) {
+			agents[i].x = agents[i].y = 0;
+			agents[i].vx = 1;
+			agents[i].vy = static_cast<float>(i%7);
+		}
+
+		JobSystem jobs(threads-1);
+		auto start = std::chrono::steady_clock::now();
+		for (int tick=0; tick<Ticks; tick++) {
+			jobs.parallel_for(0, NumAgents, Grain, [&agents](size_t first, size_t last) {
+				UpdateAgents(agents, first, last);
+			});
+		}
+		double msPerTick = MsSince(start) / Ticks;
+
+		if (threads==1) { baseline = msPerTick; }
+		printf("%8u %12.2f %10.2f\n", threads, msPerTick, baseline/msPerTick);
+	}
+
+	return 0;
+}
+
+
+int bench::LuaOnUpdate(unsigned int numObjects)
+{
+	const int Frames = 200;
+	const char* Handler = "this.x = this.x + this.vx * elapsed / 1000; if this.x > 100 then this.vx = -this.vx end";
+
+	if (numObjects==0) { numObjects = 500; }
+	printf("Lua onupdate: %u objects, %d frames\n", numObjects, Frames);
+	printf("%12s %12s\n", "mode", "ms/frame");
+
+	lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+
+	//Our objects, as plain tables.
+	std::vector<int> objects;
+	for (unsigned int i=0; i<numObjects; i++) {
+		lua_newtable(L);
+		lua_pushnumber(L, 0);
+		lua_setfield(L, -2, "x");
+		lua_pushnumber(L, 1 + i%5);
+		lua_setfield(L, -2, "vx");
+		objects.push_back(lua::RefTop(L));
+	}
+
+	//Old way: set the globals, then re-compile and run the source.
+	auto start = std::chrono::steady_clock::now();
+	for (int frame=0; frame<Frames; frame++) {
+		lua_pushinteger(L, 16);
+		lua_setglobal(L, "elapsed");
+		for (int obj : objects) {
+			lua_rawgeti(L, LUA_REGISTRYINDEX, obj);
+			lua_setglobal(L, "this");
+			if (luaL_dostring(L, Handler)!=0) {
+				printf("Error: %s\n", lua_tostring(L, -1));
+				lua_close(L);
+				return 1;
+			}
+		}
+	}
+	double dostringMs = MsSince(start) / Frames;
+	printf("%12s %12.3f\n", "dostring", dostringMs);
+
+	//New way: compile once, pass "this" and "elapsed" as arguments.
+	int chunk = lua::CompileChunk(L, Handler, "bench", "this, elapsed");
+	start = std::chrono::steady_clock::now();
+	for (int frame=0; frame<Frames; frame++) {
+		for (int obj : objects) {
+			lua_rawgeti(L, LUA_REGISTRYINDEX, obj);
+			lua_pushinteger(L, 16);
+			if (!lua::CallChunk(L, chunk, 2, "bench")) {
+				lua_close(L);
+				return 1;
+			}
+		}
+	}
+	double cachedMs = MsSince(start) / Frames;
+	printf("%12s %12.3f\n", "cached", cachedMs);
+	printf("Speedup: %.2fx\n", dostringMs/cachedMs);
+
+	lua_close(L);
+	return 0;
+}
+
+
+int bench::LuaBatch(unsigned int numNpcs)
+{
+	const int Frames = 100;
+
+	if (numNpcs==0) { numNpcs = 10000; }
+	printf("Lua NPC update: %u NPCs, %d frames\n", numNpcs, Frames);
+	printf("%12s %12s\n", "mode", "ms/frame");
+
+	lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+	EntityBatch::RegisterLua(L);
+
+	//Per-NPC: each one is a table, and we call its handler once per NPC.
+	std::vector<int> objects;
+	for (unsigned int i=0; i<numNpcs; i++) {
+		lua_newtable(L);
+		lua_pushnumber(L, 0);
+		lua_setfield(L, -2, "x");
+		lua_pushnumber(L, 1 + i%5);
+		lua_setfield(L, -2, "vx");
+		objects.push_back(lua::RefTop(L));
+	}
+	int single = lua::CompileChunk(L, "this.x = this.x + this.vx*elapsed/1000", "single", "this, elapsed");
+	auto start = std::chrono::steady_clock::now();
+	for (int frame=0; frame<Frames; frame++) {
+		for (int obj : objects) {
+			lua_rawgeti(L, LUA_REGISTRYINDEX, obj);
+			lua_pushinteger(L, 16);
+			if (!lua::CallChunk(L, single, 2, "single")) {
+				lua_close(L);
+				return 1;
+			}
+		}
+	}
+	double singleMs = MsSince(start) / Frames;
+	printf("%12s %12.3f\n", "per-npc", singleMs);
+
+	//Batched: one call, over arrays.
+	EntityBatch batch("bench");
+	for (unsigned int i=0; i<numNpcs; i++) {
+		batch.add(0, 0, 1 + i%5, 0);
+	}
+	batch.setHandler(L, "local dt = elapsed/1000; for i=1,n do x[i] = x[i] + vx[i]*dt end");
+	start = std::chrono::steady_clock::now();
+	for (int frame=0; frame<Frames; frame++) {
+		if (!batch.update(16)) {
+			lua_close(L);
+			return 1;
+		}
+	}
+	double batchMs = MsSince(start) / Frames;
+	printf("%12s %12.3f\n", "batched", batchMs);
+	printf("Speedup: %.2fx\n", singleMs/batchMs);
+
+	batch.release();
+	lua_close(L);
+	return 0;
+}
+
+
+int bench::DomainScaling(unsigned int maxThreads)
+{
+	const int NumDomains = 16;
+	const int Frames = 20;
+	const char* Script = "function update(elapsed) local s = 0; for i=1,100000 do s = s + math.sin(i) end; post('main', tostring(s)) end";
+
+	if (maxThreads==0) {
+		maxThreads = std::max(1U, boost::thread::hardware_concurrency());
+	}
+	printf("Script domain scaling: %d domains, %d frames\n", NumDomains, Frames);
+	printf("%8s %12s %10s\n", "threads", "ms/frame", "speedup");
+
+	//The "main" state just counts messages.
+	lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+
+	double baseline = 0;
+	for (unsigned int threads=1; threads<=maxThreads; threads++) {
+		ScriptDomains domains(L);
+		for (int i=0; i<NumDomains; i++) {
+			char name[32];
+			snprintf(name, sizeof(name), "domain%d", i);
+			domains.create(name).run(Script, name);
+		}
+
+		JobSystem jobs(threads-1);
+		auto start = std::chrono::steady_clock::now();
+		for (int frame=0; frame<Frames; frame++) {
+			domains.update(jobs, sf::milliseconds(16));
+		}
+		double msPerFrame = MsSince(start) / Frames;
+
+		if (threads==1) { baseline = msPerFrame; }
+		printf("%8u %12.2f %10.2f\n", threads, msPerFrame, baseline/msPerFrame);
+	}
+
+	lua_close(L);
+	return 0;
+}
+
+
+int bench::MapLoad(unsigned int numTiles)
+{
+	if (numTiles==0) { numTiles = 1000000; }
+	namespace fs = boost::filesystem;
+	std::string jsonFile = (fs::temp_directory_path() / fs::unique_path("portentia-bench-%%%%%%.json")).string();
+	std::string streamOut = jsonFile + ".stream.pmap";
+	std::string treeOut = jsonFile + ".tree.pmap";
+
+	WriteSyntheticMap(jsonFile, numTiles);
+	printf("Map load: %u tiles (%.1f MB of JSON), parsed and compiled\n", numTiles, fs::file_size(jsonFile)/(1024.0*1024.0));
+	printf("%12s %12s %16s\n", "mode", "ms", "peak extra MB");
+
+	//Streaming first: memory freed by the tree (below) may stay resident, and would count against it.
+	double streamMs = 0, treeMs = 0;
+	try {
+		ResetPeakRss();
+		size_t before = ProcStatus("VmRSS");
+		auto start = std::chrono::steady_clock::now();
+		{
+		mapfile::MapData map;
+		mapfile::ReadMapFile(jsonFile, map);
+		mapfile::Compile(map, streamOut);
+		}
+		streamMs = MsSince(start);
+		size_t peak = ProcStatus("VmHWM");
+		printf("%12s %12.1f %16.1f\n", "streamed", streamMs, peak>before ? (peak-before)/(1024.0*1024.0) : 0.0);
+
+		//The old way: a JsonCpp tree of the whole map.
+		ResetPeakRss();
+		before = ProcStatus("VmRSS");
+		start = std::chrono::steady_clock::now();
+		{
+		Json::Value root;
+		Json::Reader read;
+		std::ifstream in(jsonFile.c_str());
+		if (!read.parse(in, root)) {
+			throw std::runtime_error(read.getFormattedErrorMessages());
+		}
+		mapfile::Compile(root, treeOut);
+		}
+		treeMs = MsSince(start);
+		peak = ProcStatus("VmHWM");
+		printf("%12s %12.1f %16.1f\n", "json tree", treeMs, peak>before ? (peak-before)/(1024.0*1024.0) : 0.0);
+	} catch (std::exception& ex) {
+		printf("Error: %s\n", ex.what());
+		fs::remove(jsonFile);
+		fs::remove(streamOut);
+		fs::remove(treeOut);
+		return 1;
+	}
+
+	//Both should compile to the same thing.
+	std::string a, b;
+	bool same = ReadWholeFile(streamOut, a) && ReadWholeFile(treeOut, b) && a==b;
+	printf("Speedup: %.2fx; compiled maps %s\n", treeMs/streamMs, same ? "match" : "DIFFER");
+
+	fs::remove(jsonFile);
+	fs::remove(streamOut);
+	fs::remove(treeOut);
+	return same ? 0 : 1;
+}
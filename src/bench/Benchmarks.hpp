@@ -0,0 +1,29 @@
+#pragma once
+
+/**
+ * Stand-alone benchmarks, run from the command line instead of the game (see main.cpp).
+ * Each prints its results to stdout and returns a process exit code.
+ */
+namespace bench {
+
+///Run the same per-agent workload on 1 to N threads with the JobSystem, and report the speedup.
+/// N defaults to the number of hardware threads.
+int JobScaling(unsigned int maxThreads=0);
+
+///Run an onupdate-style handler for N objects (Lua tables) every frame, once with luaL_dostring
+/// (re-compiling each time) and once as a pre-compiled chunk, and report ms/frame for both.
+int LuaOnUpdate(unsigned int numObjects=500);
+
+///Move N NPCs from Lua, once with one handler call per NPC and once with a single EntityBatch
+/// call over typed arrays, and report ms/frame for both.
+int LuaBatch(unsigned int numNpcs=10000);
+
+///Update a set of script-heavy ScriptDomains on 1 to N threads, and report the speedup.
+/// N defaults to the number of hardware threads.
+int DomainScaling(unsigned int maxThreads=0);
+
+///Compile a synthetic map with N tiles, once by parsing it into a JSON tree and once by streaming it
+/// (mapfile::ReadMapFile), and report the time and peak memory of each (memory is only measured on Linux).
+int MapLoad(unsigned int numTiles=1000000);
+
+}
@@ -0,0 +1,261 @@
+#include "AllocTracker.hpp"
+
+#include <new>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+
+
+namespace {
+std::atomic<size_t> numNews(0);
+
+#ifdef PORTENTIA_ALLOC_TRACKING
+
+const char* SubsystemNames[] = {"engine", "lua", "index", "render", "assets"};
+const size_t NumSubsystems = static_cast<size_t>(alloc::Subsystem::Count);
+
+///Counters for one subsystem. "frame*" counts the frame in progress; "last*" the previous one.
+struct Counters {
+	std::atomic<long long> liveBytes;
+	std::atomic<long long> liveCount;
+	std::atomic<size_t> frameBytes;
+	std::atomic<size_t> frameAllocs;
+	size_t lastBytes;
+	size_t lastAllocs;
+};
+Counters counters[NumSubsystems];
+
+//The subsystem we're tagging allocations with (per thread).
+thread_local alloc::Subsystem currSubsystem = alloc::Subsystem::Engine;
+
+//Steady-state budget.
+size_t budgetAllocs = 0;
+unsigned int budgetWarmup = 0;
+bool budgetOn = false;
+unsigned int framesSeen = 0;
+
+//Has reportLeaksAtExit() been registered?
+std::atomic<bool> leakReportRegistered(false);
+
+void ReportLeaks()
+{
+	alloc::reportLeaks(std::cout);
+	std::cout.flush();
+}
+
+///Stored in front of every allocation. 16 bytes, to keep the result suitably aligned.
+struct Header {
+	size_t size;
+	unsigned int subsystem;
+	unsigned int magic;
+};
+const unsigned int HeaderMagic = 0x50414C43; //"PALC"
+static_assert(sizeof(Header)==16, "Allocation header must preserve 16-byte alignment.");
+
+void* CountedAlloc(size_t size, bool nothrow)
+{
+	numNews.fetch_add(1, std::memory_order_relaxed);
+	Header* res = static_cast<Header*>(std::malloc(size+sizeof(Header)));
+	if (!res) {
+		if (nothrow) { return nullptr; }
+		throw std::bad_alloc();
+	}
+	res->size = size;
+	res->subsystem = static_cast<unsigned int>(currSubsystem);
+	res->magic = HeaderMagic;
+	alloc::noteAlloc(currSubsystem, size);
+	if (!leakReportRegistered.load(std::memory_order_relaxed)) {
+		alloc::reportLeaksAtExit();
+	}
+	return res+1;
+}
+
+void CountedFree(void* ptr)
+{
+	if (!ptr) { return; }
+	Header* head = static_cast<Header*>(ptr) - 1;
+	if (head->magic==HeaderMagic) {
+		head->magic = 0;
+		alloc::noteFree(static_cast<alloc::Subsystem>(head->subsystem), head->size);
+	}
+	std::free(head);
+}
+
+#else
+
+void* CountedAlloc(size_t size, bool nothrow)
+{
+	numNews.fetch_add(1, std::memory_order_relaxed);
+	void* res = std::malloc(size ? size : 1);
+	if (!res && !nothrow) { throw std::bad_alloc(); }
+	return res;
+}
+
+void CountedFree(void* ptr)
+{
+	std::free(ptr);
+}
+
+#endif //PORTENTIA_ALLOC_TRACKING
+} //End un-named namespace
+
+
+size_t alloc::newCount()
+{
+	return numNews.load(std::memory_order_relaxed);
+}
+
+
+#ifdef PORTENTIA_ALLOC_TRACKING
+
+alloc::Scope::Scope(Subsystem sub) : prev(currSubsystem)
+{
+	currSubsystem = sub;
+}
+
+alloc::Scope::~Scope()
+{
+	currSubsystem = prev;
+}
+
+
+void alloc::noteAlloc(Subsystem sub, size_t bytes)
+{
+	Counters& c = counters[static_cast<size_t>(sub)];
+	c.liveBytes.fetch_add(bytes, std::memory_order_relaxed);
+	c.liveCount.fetch_add(1, std::memory_order_relaxed);
+	c.frameBytes.fetch_add(bytes, std::memory_order_relaxed);
+	c.frameAllocs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void alloc::noteFree(Subsystem sub, size_t bytes)
+{
+	Counters& c = counters[static_cast<size_t>(sub)];
+	c.liveBytes.fetch_sub(bytes, std::memory_order_relaxed);
+	c.liveCount.fetch_sub(1, std::memory_order_relaxed);
+}
+
+
+void alloc::endFrame()
+{
+	size_t total = 0;
+	for (Counters& c : counters) {
+		c.lastBytes = c.frameBytes.exchange(0, std::memory_order_relaxed);
+		c.lastAllocs = c.frameAllocs.exchange(0, std::memory_order_relaxed);
+		total += c.lastAllocs;
+	}
+
+	//Check the budget, once we're warmed up.
+	framesSeen++;
+	if (budgetOn && framesSeen>budgetWarmup && total>budgetAllocs) {
+		std::cerr <<"Allocation budget exceeded on frame " <<framesSeen <<": " <<total <<" allocations (budget is " <<budgetAllocs <<")\n";
+		printReport(std::cerr);
+		std::abort();
+	}
+}
+
+
+alloc::Stats alloc::getStats(Subsystem sub)
+{
+	const Counters& c = counters[static_cast<size_t>(sub)];
+	Stats res;
+	res.liveBytes = c.liveBytes.load(std::memory_order_relaxed);
+	res.liveCount = c.liveCount.load(std::memory_order_relaxed);
+	res.frameBytes = c.lastBytes;
+	res.frameAllocs = c.lastAllocs;
+	return res;
+}
+
+
+void alloc::setSteadyStateBudget(size_t maxAllocsPerFrame, unsigned int warmupFrames)
+{
+	budgetAllocs = maxAllocsPerFrame;
+	budgetWarmup = framesSeen + warmupFrames;
+	budgetOn = true;
+}
+
+
+void alloc::printReport(std::ostream& out)
+{
+	out <<"subsystem   live bytes   live allocs   bytes/frame   allocs/frame\n";
+	for (size_t i=0; i<NumSubsystems; i++) {
+		Stats st = getStats(static_cast<Subsystem>(i));
+		out.width(9);
+		out <<SubsystemNames[i];
+		out.width(13);
+		out <<st.liveBytes;
+		out.width(14);
+		out <<st.liveCount;
+		out.width(14);
+		out <<st.frameBytes;
+		out.width(15);
+		out <<st.frameAllocs <<"\n";
+	}
+}
+
+
+long long alloc::reportLeaks(std::ostream& out)
+{
+	long long total = 0;
+	for (size_t i=0; i<NumSubsystems; i++) {
+		Stats st = getStats(static_cast<Subsystem>(i));
+		if (st.liveCount>0) {
+			out <<"Leak: " <<SubsystemNames[i] <<" still has " <<st.liveBytes <<" bytes in " <<st.liveCount <<" allocations\n";
+			total += st.liveBytes;
+		}
+	}
+	return total;
+}
+
+
+void alloc::reportLeaksAtExit()
+{
+	//Handlers run in reverse order of registration, so only the first (earliest) one counts.
+	if (!leakReportRegistered.exchange(true)) {
+		std::atexit(ReportLeaks);
+	}
+}
+
+#endif //PORTENTIA_ALLOC_TRACKING
+
+
+//Replacements for the global allocation functions.
+void* operator new(size_t size)
+{
+	return CountedAlloc(size, false);
+}
+
+void* operator new[](size_t size)
+{
+	return CountedAlloc(size, false);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return CountedAlloc(size, true);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return CountedAlloc(size, true);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	CountedFree(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	CountedFree(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+	CountedFree(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+	CountedFree(ptr);
+}
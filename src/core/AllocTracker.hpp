@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+
+/**
+ * Counts calls to the global operator new (which is replaced in AllocTracker.cpp). The engine
+ *   reports the number of allocations per frame in the FPS overlay; in steady state, it should be zero.
+ *
+ * If PORTENTIA_ALLOC_TRACKING is defined (see the ENABLE_ALLOC_TRACKING option in CMakeLists.txt),
+ *   every allocation is also tagged with the subsystem that made it. Code marks its subsystem with
+ *   ALLOC_SCOPE(alloc::Subsystem::Index) (untagged allocations count as "Engine"), and we track live
+ *   bytes plus bytes/allocations per frame for each subsystem, report whatever is still live at
+ *   shutdown, and can abort if a "steady-state" budget is exceeded (useful for benchmarks).
+ *   Each allocation carries a small header while tracking is on, so it is off by default.
+ */
+namespace alloc {
+
+///Total calls to (any form of) global operator new so far.
+size_t newCount();
+
+///Who allocated something.
+enum class Subsystem { Engine, Lua, Index, Render, Assets, Count };
+
+///Per-subsystem statistics.
+struct Stats {
+	long long liveBytes;
+	long long liveCount;
+	size_t frameBytes;  //Allocated during the last complete frame.
+	size_t frameAllocs;
+	Stats() : liveBytes(0), liveCount(0), frameBytes(0), frameAllocs(0) {}
+};
+
+#ifdef PORTENTIA_ALLOC_TRACKING
+
+///Tags allocations on this thread with "sub" for the lifetime of the scope. Use ALLOC_SCOPE.
+class Scope {
+public:
+	explicit Scope(Subsystem sub);
+	~Scope();
+private:
+	Subsystem prev;
+};
+
+#define ALLOC_SCOPE_CONCAT_INNER(a, b) a##b
+#define ALLOC_SCOPE_CONCAT(a, b) ALLOC_SCOPE_CONCAT_INNER(a, b)
+#define ALLOC_SCOPE(sub) alloc::Scope ALLOC_SCOPE_CONCAT(allocScope_, __LINE__)(sub)
+
+///Let allocators that don't use operator new (e.g., Lua's) report to the tracker.
+void noteAlloc(Subsystem sub, size_t bytes);
+void noteFree(Subsystem sub, size_t bytes);
+
+///Close off the current frame's statistics (called by the engine after each frame).
+/// In budget mode, aborts if the frame went over budget.
+void endFrame();
+
+///Statistics for one subsystem.
+Stats getStats(Subsystem sub);
+
+///Abort if any frame after the first "warmupFrames" makes more than "maxAllocsPerFrame" allocations.
+void setSteadyStateBudget(size_t maxAllocsPerFrame, unsigned int warmupFrames);
+
+///Print statistics for every subsystem.
+void printReport(std::ostream& out);
+
+///Print (and return the number of bytes of) anything still allocated. Call this at shutdown.
+long long reportLeaks(std::ostream& out);
+
+///Report leaks (to std::cout) once the program exits. This is registered with atexit() on the first
+/// tracked allocation, so it runs after every static object that allocated (e.g., the engine) has been
+/// destroyed; calling it before a static object is constructed guarantees the same for that object.
+void reportLeaksAtExit();
+
+#else
+
+#define ALLOC_SCOPE(sub) ((void)0)
+
+inline void noteAlloc(Subsystem, size_t) {}
+inline void noteFree(Subsystem, size_t) {}
+inline void endFrame() {}
+inline Stats getStats(Subsystem) { return Stats(); }
+inline void setSteadyStateBudget(size_t, unsigned int) {}
+inline void printReport(std::ostream&) {}
+inline long long reportLeaks(std::ostream&) { return 0; }
+inline void reportLeaksAtExit() {}
+
+#endif
+
+}
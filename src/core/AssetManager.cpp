@@ -0,0 +1,361 @@
+#include "AssetManager.hpp"
+
+#include <iostream>
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
+
+#include "core/Profiler.hpp"
+#include "core/AllocTracker.hpp"
+#include "pack/AssetPack.hpp"
+#include "util/Hash.hpp"
+
+
+namespace {
+///Cache keys use canonical paths, so "res/../res/a.png" and "res/a.png" are the same texture.
+std::string Canonical(const std::string& path)
+{
+	//Packed files are named without asking the file system.
+	if (pack::Contains(path)) {
+		return pack::Absolute(path);
+	}
+	boost::system::error_code err;
+	boost::filesystem::path res = boost::filesystem::canonical(path, err);
+	return err ? path : res.string();
+}
+
+size_t TextureBytes(const sf::Texture& texture)
+{
+	return texture.getSize().x * texture.getSize().y * 4;
+}
+} //End un-named namespace
+
+
+bool AssetManager::TextureHandle::ready() const
+{
+	return entry && entry->state==State::Ready;
+}
+
+
+bool AssetManager::TextureHandle::failed() const
+{
+	return entry && entry->state==State::Failed;
+}
+
+
+const sf::Texture& AssetManager::TextureHandle::get() const
+{
+	if (!ready()) {
+		return *entry->placeholder;
+	}
+	return entry->same ? entry->same->texture : entry->texture;
+}
+
+
+const std::string& AssetManager::TextureHandle::path() const
+{
+	return entry->path;
+}
+
+
+const sf::Font& AssetManager::FontHandle::get() const
+{
+	return entry->font;
+}
+
+
+AssetManager::AssetManager() : running(false), numPending(0), totalBytes(0), budgetBytes(128*1024*1024), frame(0)
+{
+}
+
+
+AssetManager::~AssetManager()
+{
+	stop();
+}
+
+
+void AssetManager::start(unsigned int numThreads)
+{
+	//A magenta/black checkerboard stands in for anything not yet loaded.
+	if (placeholderTex.getSize().x==0) {
+		const unsigned int Size = 16;
+		sf::Image img;
+		img.create(Size, Size, sf::Color::Black);
+		for (unsigned int y=0; y<Size; y++) {
+			for (unsigned int x=0; x<Size; x++) {
+				if ((x/4 + y/4)%2==0) {
+					img.setPixel(x, y, sf::Color::Magenta);
+				}
+			}
+		}
+		placeholderTex.loadFromImage(img);
+	}
+
+	if (running) { return; }
+	running = true;
+	for (unsigned int i=0; i<std::max(1U, numThreads); i++) {
+		workers.push_back(std::unique_ptr<boost::thread>(new boost::thread(&AssetManager::run, this)));
+	}
+}
+
+
+void AssetManager::stop()
+{
+	if (!running) { return; }
+	{
+	boost::mutex::scoped_lock lock(todoMutex);
+	running = false;
+	}
+	todoReady.notify_all();
+	for (auto& worker : workers) {
+		worker->join();
+	}
+	workers.clear();
+}
+
+
+void AssetManager::setBudget(size_t bytes)
+{
+	budgetBytes = bytes;
+}
+
+
+template <class T>
+std::shared_ptr<T> AssetManager::find(const std::string& key)
+{
+	auto it = cache.find(key);
+	if (it==cache.end()) { return std::shared_ptr<T>(); }
+	std::shared_ptr<T> res = std::dynamic_pointer_cast<T>(it->second);
+	if (res) {
+		res->lastUsed = frame;
+	}
+	return res;
+}
+
+
+AssetManager::TextureHandle AssetManager::loadTexture(const std::string& path)
+{
+	ALLOC_SCOPE(alloc::Subsystem::Assets);
+	std::string canonical = Canonical(path);
+	std::string key = "texture:" + canonical;
+	std::shared_ptr<TextureEntry> entry = find<TextureEntry>(key);
+	if (entry) {
+		return TextureHandle(entry);
+	}
+
+	//Not cached; start loading it.
+	entry.reset(new TextureEntry());
+	entry->path = canonical;
+	entry->lastUsed = frame;
+	entry->state = State::Decoding;
+	entry->hash = 0;
+	entry->placeholder = &placeholderTex;
+	cache[key] = entry;
+	numPending++;
+
+	{
+	boost::mutex::scoped_lock lock(todoMutex);
+	todo.push_back(entry);
+	}
+	todoReady.notify_one();
+	return TextureHandle(entry);
+}
+
+
+AssetManager::FontHandle AssetManager::loadFont(const std::string& path)
+{
+	ALLOC_SCOPE(alloc::Subsystem::Assets);
+	std::string canonical = Canonical(path);
+	std::string key = "font:" + canonical;
+	std::shared_ptr<FontEntry> entry = find<FontEntry>(key);
+	if (!entry) {
+		//SFML reads the font as it needs glyphs, so its file stays mapped.
+		entry.reset(new FontEntry());
+		if (!entry->file.open(path) || !entry->font.loadFromMemory(entry->file.data(), entry->file.size())) {
+			return FontHandle();
+		}
+		entry->path = canonical;
+		entry->lastUsed = frame;
+		entry->bytes = entry->file.size();
+		cache[key] = entry;
+		totalBytes += entry->bytes;
+	}
+	return FontHandle(entry);
+}
+
+
+void AssetManager::run()
+{
+	profiler::setThreadName("asset decode");
+	platform::MappedFile file;
+	for (;;) {
+		//Wait for something to decode.
+		std::shared_ptr<TextureEntry> entry;
+		{
+		boost::mutex::scoped_lock lock(todoMutex);
+		while (running && todo.empty()) {
+			todoReady.wait(lock);
+		}
+		if (!running) { return; }
+		entry = todo.front();
+		todo.pop_front();
+		}
+
+		//Read, hash and decode it (the slow part).
+		ALLOC_SCOPE(alloc::Subsystem::Assets);
+		bool ok = false;
+		{
+		PROFILE_SCOPE("decode image");
+		if (file.open(entry->path) && file.size()>0) {
+			entry->hash = hash::Fnv1a(file.data(), file.size());
+			ok = entry->image.loadFromMemory(file.data(), file.size());
+		}
+		file.close();
+		}
+		entry->state = ok ? State::Decoded : State::Failed;
+
+		boost::mutex::scoped_lock lock(doneMutex);
+		done.push_back(entry);
+	}
+}
+
+
+void AssetManager::update(const sf::Time& budget)
+{
+	PROFILE_SCOPE("AssetManager::update");
+	ALLOC_SCOPE(alloc::Subsystem::Assets);
+	frame++;
+
+	//Upload whatever's been decoded, within our budget.
+	sf::Clock clock;
+	while (numPending>0) {
+		std::shared_ptr<TextureEntry> entry;
+		{
+		boost::mutex::scoped_lock lock(doneMutex);
+		if (done.empty()) { break; }
+		entry = done.front();
+		done.pop_front();
+		}
+
+		upload(entry);
+		if (clock.getElapsedTime()>=budget) { break; }
+	}
+
+	//Anything with a handle (besides ours) is still in use; evict the rest if we have to.
+	for (auto& it : cache) {
+		if (it.second.use_count()>1) {
+			it.second->lastUsed = frame;
+		}
+	}
+	if (totalBytes>budgetBytes) {
+		evict();
+	}
+}
+
+
+void AssetManager::upload(const std::shared_ptr<TextureEntry>& entry)
+{
+	numPending--;
+	if (entry->state==State::Decoded) {
+		//If we've already uploaded the same image (under another name), share it.
+		auto it = texturesByHash.find(entry->hash);
+		std::shared_ptr<TextureEntry> same = it!=texturesByHash.end() ? it->second.lock() : std::shared_ptr<TextureEntry>();
+		if (same && same->state==State::Ready && !same->same) {
+			entry->same = same;
+			entry->state = State::Ready;
+		} else if (entry->texture.loadFromImage(entry->image)) {
+			entry->bytes = TextureBytes(entry->texture);
+			totalBytes += entry->bytes;
+			texturesByHash[entry->hash] = entry;
+			entry->state = State::Ready;
+		} else {
+			entry->state = State::Failed;
+		}
+		entry->image = sf::Image();
+	}
+
+	//Don't keep failures: the file may just have been missing (or half-written), so the next
+	// loadTexture() tries again. Handles we've given out stay failed.
+	if (entry->state==State::Failed) {
+		std::cout <<"Warn: couldn't load texture: " <<entry->path <<"\n";
+		auto it = cache.find("texture:" + entry->path);
+		if (it!=cache.end() && it->second==entry) {
+			totalBytes -= entry->bytes;
+			cache.erase(it);
+		}
+	}
+}
+
+
+void AssetManager::evict()
+{
+	//Unused resources (only the cache refers to them), least-recently used first.
+	scratchUnused.clear();
+	for (auto it=cache.begin(); it!=cache.end(); it++) {
+		if (it->second.use_count()==1) {
+			scratchUnused.push_back(it);
+		}
+	}
+	std::sort(scratchUnused.begin(), scratchUnused.end(), [](const CacheIter& a, const CacheIter& b) {
+		return a->second->lastUsed < b->second->lastUsed;
+	});
+
+	for (const CacheIter& it : scratchUnused) {
+		if (totalBytes<=budgetBytes) { break; }
+		totalBytes -= it->second->bytes;
+		cache.erase(it);
+	}
+
+	//Forget the hashes of evicted textures.
+	for (auto it=texturesByHash.begin(); it!=texturesByHash.end(); ) {
+		if (it->second.expired()) {
+			texturesByHash.erase(it++);
+		} else {
+			it++;
+		}
+	}
+}
+
+
+void AssetManager::replace(const TextureHandle& handle, const sf::Image& image)
+{
+	if (!handle.valid()) { return; }
+	ALLOC_SCOPE(alloc::Subsystem::Assets);
+	TextureEntry& entry = *handle.entry;
+
+	//It no longer matches anything else (or its old hash).
+	entry.same.reset();
+	auto it = texturesByHash.find(entry.hash);
+	if (it!=texturesByHash.end() && it->second.lock()==handle.entry) {
+		texturesByHash.erase(it);
+	}
+
+	//Anything sharing our texture still has its old contents (its file didn't change). The first
+	// takes a copy of it, and becomes what the rest (and new files with the same hash) share.
+	std::shared_ptr<TextureEntry> owner;
+	for (auto& res : cache) {
+		std::shared_ptr<TextureEntry> alias = std::dynamic_pointer_cast<TextureEntry>(res.second);
+		if (!alias || alias->same!=handle.entry) { continue; }
+		if (owner) {
+			alias->same = owner;
+			continue;
+		}
+		owner = alias;
+		owner->same.reset();
+		owner->texture = entry.texture;
+		owner->bytes = TextureBytes(owner->texture);
+		totalBytes += owner->bytes;
+		texturesByHash[owner->hash] = owner;
+	}
+
+	//If it's still loading, leave it to finish (it will upload over this, from the same file).
+	if (entry.texture.loadFromImage(image)) {
+		totalBytes -= entry.bytes;
+		entry.bytes = TextureBytes(entry.texture);
+		totalBytes += entry.bytes;
+		if (entry.state==State::Failed) {
+			entry.state = State::Ready;
+		}
+	}
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+#include <SFML/Graphics.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "platform/MappedFile.hpp"
+
+
+/**
+ * The engine's resource cache: textures and fonts, shared by every slice.
+ *
+ * Resources are keyed by their canonical path, and handed out as ref-counted handles. When the last
+ *   handle goes away, the resource stays cached (so, e.g., re-entering a map costs nothing) until
+ *   the cache goes over its memory budget; then, the least-recently-used unreferenced resources are
+ *   evicted. Textures are also keyed by a hash of their file's contents, so that the same image under
+ *   two names is only uploaded once.
+ *
+ * Textures load without blocking the frame. Image files are read and decoded (into an sf::Image) on
+ *   a few background threads; the engine then uploads the decoded images to textures on the main
+ *   (GL) thread in update(), a few at a time, so that no frame spends more than a small budget on
+ *   uploads. Until a texture is ready, its handle gives out a placeholder (a small checkerboard), so
+ *   slices can draw as if everything has loaded. Fonts are small, and load right away.
+ *   Everything is read through platform::MappedFile, so files in the asset pack are decoded straight
+ *   from it, without a copy.
+ *
+ * Apart from the background threads, this should only be used from the main thread.
+ *
+ * \note
+ * We use our own threads rather than the JobSystem: the main thread runs tasks while it waits on
+ *   the JobSystem, and we never want it to pick up a decode.
+ */
+class AssetManager {
+private:
+	struct Resource;
+	struct TextureEntry;
+	struct FontEntry;
+
+public:
+	///A texture that's loading (or has loaded). Handles are cheap to copy, and all copies share the texture.
+	class TextureHandle {
+	public:
+		TextureHandle() {}
+
+		///Has the texture been uploaded? (False if it failed.)
+		bool ready() const;
+
+		///Did the file fail to load?
+		bool failed() const;
+
+		///The texture, or a placeholder if it isn't ready yet.
+		const sf::Texture& get() const;
+
+		bool valid() const { return entry.get()!=nullptr; }
+		const std::string& path() const;
+
+	private:
+		friend class AssetManager;
+		explicit TextureHandle(const std::shared_ptr<TextureEntry>& entry) : entry(entry) {}
+
+		std::shared_ptr<TextureEntry> entry;
+	};
+
+	///A loaded font.
+	class FontHandle {
+	public:
+		FontHandle() {}
+		bool ok() const { return entry.get()!=nullptr; }
+		const sf::Font& get() const;
+
+	private:
+		friend class AssetManager;
+		explicit FontHandle(const std::shared_ptr<FontEntry>& entry) : entry(entry) {}
+
+		std::shared_ptr<FontEntry> entry;
+	};
+
+	AssetManager();
+	~AssetManager();
+
+	///Start decoding, on "numThreads" background threads.
+	void start(unsigned int numThreads=2);
+
+	///Stop the background threads (anything not yet decoded is dropped).
+	void stop();
+
+	///Get (or start loading) the texture at "path". Returns immediately. Textures that failed to load aren't cached, so this retries them.
+	TextureHandle loadTexture(const std::string& path);
+
+	///Get (or load) the font at "path". If it can't be loaded, the handle is not ok().
+	FontHandle loadFont(const std::string& path);
+
+	///Upload decoded images to their textures, until "budget" has passed (at least one is always uploaded),
+	/// then evict unused resources if we're over our memory budget. Call once per frame.
+	void update(const sf::Time& budget);
+
+	///Replace a texture's contents right away (e.g., with a reloaded image).
+	void replace(const TextureHandle& handle, const sf::Image& image);
+
+	///Unused resources are evicted once everything cached takes more than this. Default is 128MB.
+	void setBudget(size_t bytes);
+
+	///Number of textures not yet uploaded.
+	size_t pending() const { return numPending; }
+
+	///Approximate memory used by everything cached (in use or not).
+	size_t bytesCached() const { return totalBytes; }
+
+	///The placeholder, shown in place of textures that aren't ready.
+	const sf::Texture& placeholder() const { return placeholderTex; }
+
+private:
+	enum class State { Decoding, Decoded, Ready, Failed };
+
+	///Anything we cache.
+	struct Resource {
+		std::string path;      //Canonical.
+		size_t bytes;          //Approximate memory used.
+		unsigned int lastUsed; //The update() in which this was last referenced.
+		Resource() : bytes(0), lastUsed(0) {}
+		virtual ~Resource() {}
+	};
+
+	struct TextureEntry : public Resource {
+		std::atomic<State> state;
+		uint64_t hash;       //Of the file's contents. Set by the worker.
+		sf::Image image;     //Decoded on a worker; freed once uploaded.
+		sf::Texture texture; //Main thread only.
+		std::shared_ptr<TextureEntry> same; //Another texture with the same contents (which we use instead), if any.
+		const sf::Texture* placeholder;
+	};
+
+	struct FontEntry : public Resource {
+		platform::MappedFile file; //Must outlive "font".
+		sf::Font font;
+	};
+
+	typedef std::map<std::string, std::shared_ptr<Resource>>::iterator CacheIter;
+
+	void run();
+	void upload(const std::shared_ptr<TextureEntry>& entry);
+	void evict();
+
+	///Look up a cached resource of kind "T" (returns null if it's not there).
+	template <class T>
+	std::shared_ptr<T> find(const std::string& key);
+
+	std::vector<std::unique_ptr<boost::thread>> workers;
+	std::atomic<bool> running;
+
+	//Waiting to be decoded.
+	boost::mutex todoMutex;
+	boost::condition_variable todoReady;
+	std::deque<std::shared_ptr<TextureEntry>> todo; //Guarded by todoMutex.
+
+	//Decoded, waiting to be uploaded.
+	boost::mutex doneMutex;
+	std::deque<std::shared_ptr<TextureEntry>> done; //Guarded by doneMutex.
+
+	//Everything cached, by kind and canonical path; and uploaded textures, by content hash.
+	std::map<std::string, std::shared_ptr<Resource>> cache;
+	std::map<uint64_t, std::weak_ptr<TextureEntry>> texturesByHash;
+	std::vector<CacheIter> scratchUnused;
+
+	std::atomic<size_t> numPending;
+	size_t totalBytes;
+	size_t budgetBytes;
+	unsigned int frame;
+	sf::Texture placeholderTex;
+};
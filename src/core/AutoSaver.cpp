@@ -0,0 +1,259 @@
+#include "AutoSaver.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+#include "core/Profiler.hpp"
+
+
+namespace {
+///Journal entries are one line each, so records are flattened (JSON strings can't hold raw newlines, so this is safe).
+void AppendOneLine(std::string& out, const std::string& record)
+{
+	size_t start = out.size();
+	out += record;
+	std::replace(out.begin()+start, out.end(), '\n', ' ');
+}
+
+void WriteFile(const std::string& path, const std::string& data, std::ios::openmode mode)
+{
+	std::ofstream out(path.c_str(), std::ios::binary|mode);
+	out.write(data.data(), data.size());
+	if (!out) {
+		throw std::runtime_error("Can't write to: " + path);
+	}
+}
+} //End un-named namespace
+
+
+AutoSaver::AutoSaver(const std::string& listKey) : listKey(listKey), fullSaveEvery(20), running(false), queued(false),
+	busy(false), generation(0), journalSaves(0), fullBytes(0), journalBytes(0)
+{
+}
+
+
+AutoSaver::~AutoSaver()
+{
+	flush();
+	{
+	boost::mutex::scoped_lock lock(mutex);
+	running = false;
+	}
+	changed.notify_all();
+	if (thread.joinable()) {
+		thread.join();
+	}
+}
+
+
+std::string AutoSaver::JournalPath(const std::string& file)
+{
+	return file + ".journal";
+}
+
+
+void AutoSaver::setFullSaveEvery(unsigned int saves)
+{
+	fullSaveEvery = saves;
+}
+
+
+void AutoSaver::save(const std::string& file, const Snapshot& snapshot)
+{
+	{
+	boost::mutex::scoped_lock lock(mutex);
+	queuedFile = file;
+	queuedSnapshot = snapshot;
+	queued = true;
+	if (!running) {
+		running = true;
+		thread = boost::thread(&AutoSaver::run, this);
+	}
+	}
+	changed.notify_all();
+}
+
+
+void AutoSaver::flush()
+{
+	boost::mutex::scoped_lock lock(mutex);
+	while (queued || busy) {
+		changed.wait(lock);
+	}
+}
+
+
+void AutoSaver::run()
+{
+	profiler::setThreadName("autosave");
+	Snapshot snapshot;
+	std::string file;
+	for (;;) {
+		//Wait for a snapshot (only the latest one matters).
+		{
+		boost::mutex::scoped_lock lock(mutex);
+		while (running && !queued) {
+			changed.wait(lock);
+		}
+		if (!queued) { return; }
+		file = queuedFile;
+		snapshot.swap(queuedSnapshot);
+		queuedSnapshot.clear();
+		queued = false;
+		busy = true;
+		}
+
+		try {
+			write(file, snapshot);
+		} catch (std::exception& ex) {
+			std::cout <<"Warn: " <<ex.what() <<"\n";
+			savedFile.clear(); //Start over with a full save.
+		}
+
+		{
+		boost::mutex::scoped_lock lock(mutex);
+		busy = false;
+		}
+		changed.notify_all();
+	}
+}
+
+
+void AutoSaver::write(const std::string& file, const Snapshot& snapshot)
+{
+	PROFILE_SCOPE("AutoSaver::write");
+
+	//A full save if this is a new file, or if the journal has grown too long.
+	if (file!=savedFile || journalSaves>=fullSaveEvery || journalBytes>fullBytes) {
+		writeFull(file, snapshot);
+	} else {
+		writeJournal(file, snapshot);
+	}
+	saved = snapshot;
+	savedFile = file;
+}
+
+
+void AutoSaver::writeFull(const std::string& file, const Snapshot& snapshot)
+{
+	//Each full save gets a new generation (from the clock, so it also differs from any earlier run's).
+	uint64_t now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	generation = std::max(generation+1, now);
+
+	//Build it all in memory, then write it at once.
+	buffer.clear();
+	std::stringstream head;
+	head <<"{\n  \"filename\" : " <<Json::valueToQuotedString(file.c_str()) <<",\n  \"generation\" : " <<generation <<",\n";
+	head <<"  " <<Json::valueToQuotedString(listKey.c_str()) <<" :\n    [";
+	buffer += head.str();
+	std::string comma = "";
+	for (const auto& rec : snapshot) {
+		buffer += comma + "\n";
+		buffer += *rec.second;
+		comma = ",";
+	}
+	buffer += "\n    ]\n}\n";
+
+	//Write it to a temporary file and rename it (so a crash mid-write leaves the old save), then start a new journal.
+	std::string tempPath = file + ".tmp";
+	WriteFile(tempPath, buffer, std::ios::trunc);
+	if (std::rename(tempPath.c_str(), file.c_str())!=0) {
+		std::remove(tempPath.c_str());
+		throw std::runtime_error("Can't write to: " + file);
+	}
+	WriteFile(JournalPath(file), "", std::ios::trunc);
+
+	fullBytes = buffer.size();
+	journalBytes = 0;
+	journalSaves = 0;
+}
+
+
+void AutoSaver::writeJournal(const std::string& file, const Snapshot& snapshot)
+{
+	//Records are shared between snapshots, so anything that's a different object has changed.
+	buffer.clear();
+	std::stringstream head;
+	head <<"{\"generation\":" <<generation <<",\"set\":[";
+	buffer += head.str();
+	std::string comma = "";
+	for (const auto& rec : snapshot) {
+		auto prev = saved.find(rec.first);
+		if (prev==saved.end() || prev->second!=rec.second) {
+			buffer += comma;
+			AppendOneLine(buffer, *rec.second);
+			comma = ",";
+		}
+	}
+	bool anySet = !comma.empty();
+
+	buffer += "],\"removed\":[";
+	comma = "";
+	for (const auto& rec : saved) {
+		if (snapshot.find(rec.first)==snapshot.end()) {
+			std::stringstream id;
+			id <<comma <<rec.first;
+			buffer += id.str();
+			comma = ",";
+		}
+	}
+	buffer += "]}\n";
+
+	//Nothing changed.
+	if (!anySet && comma.empty()) { return; }
+
+	WriteFile(JournalPath(file), buffer, std::ios::app);
+	journalBytes += buffer.size();
+	journalSaves++;
+}
+
+
+bool AutoSaver::Load(const std::string& file, const std::string& listKey, std::map<uint64_t, Json::Value>& records)
+{
+	records.clear();
+
+	//The last full save.
+	Json::Value root;
+	Json::Reader read;
+	{
+	std::ifstream in(file.c_str());
+	if (!in.is_open() || !read.parse(in, root) || !root.isObject()) {
+		return false;
+	}
+	}
+	const Json::Value& list = root[listKey];
+	for (unsigned int i=0; i<list.size(); i++) {
+		records[list[i]["id"].asUInt64()] = list[i];
+	}
+
+	//Replay its journal.
+	std::ifstream journal(JournalPath(file).c_str());
+	std::string line;
+	Json::UInt64 generation = root["generation"].asUInt64();
+	while (std::getline(journal, line)) {
+		//A torn last line is expected if we crashed while appending it; anything else is damage, but the
+		// entries after it are still good.
+		Json::Value entry;
+		if (!read.parse(line, entry) || !entry.isObject()) {
+			if (journal.peek()!=std::char_traits<char>::eof()) {
+				std::cout <<"Warn: skipping damaged journal entry in: " <<JournalPath(file) <<"\n";
+			}
+			continue;
+		}
+		if (entry["generation"].asUInt64()!=generation) { continue; }
+		const Json::Value& set = entry["set"];
+		for (unsigned int i=0; i<set.size(); i++) {
+			records[set[i]["id"].asUInt64()] = set[i];
+		}
+		const Json::Value& removed = entry["removed"];
+		for (unsigned int i=0; i<removed.size(); i++) {
+			records.erase(removed[i].asUInt64());
+		}
+	}
+	return true;
+}
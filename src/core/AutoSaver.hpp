@@ -0,0 +1,85 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <memory>
+#include <cstdint>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <jsoncpp/json/json.h>
+
+
+/**
+ * Saves a document made of records (JSON objects, each with a unique numeric "id") without blocking
+ *   the main thread.
+ *
+ * Callers hand over a snapshot: each record's text, by id. Records are shared, immutable strings, so
+ *   a snapshot is cheap: only records that changed since the last one need to be re-serialized, and
+ *   the rest are shared with it (and with any save still in progress). Snapshots are written on a
+ *   background thread; if several are queued before it gets to them, only the latest is written.
+ *
+ * Most saves only append the records that changed (and the ids of any that were removed) to a journal
+ *   next to the file ("<file>.journal", one line per save). Every so often (and on the first save),
+ *   the whole document is written instead, and the journal is emptied. Load() reads the last full
+ *   save and replays the journal on top of it.
+ *
+ * The full file looks like: {"filename": <file>, "generation": <n>, <listKey>: [<record>, ...]}.
+ *   Journal lines are only replayed on the full save with the same "generation" (so a stale journal,
+ *   e.g. from a crash just after a full save, is ignored). A torn last line is skipped; any other
+ *   damaged line is skipped with a warning, and the lines after it are still replayed.
+ */
+class AutoSaver {
+public:
+	typedef std::shared_ptr<const std::string> Record;
+	typedef std::map<uint64_t, Record> Snapshot;
+
+	///"listKey" names the array of records in the full file.
+	explicit AutoSaver(const std::string& listKey);
+
+	///Finishes any save in progress (or queued).
+	~AutoSaver();
+
+	///Queue "snapshot" to be saved to "file". Returns immediately.
+	void save(const std::string& file, const Snapshot& snapshot);
+
+	///Wait until everything queued has been written.
+	void flush();
+
+	///Write the whole document after this many journaled saves (or once the journal is bigger than it). Default is 20.
+	void setFullSaveEvery(unsigned int saves);
+
+	///Read "file" (a full save, plus its journal) into "records", by id. Returns false if there's no full save to read.
+	static bool Load(const std::string& file, const std::string& listKey, std::map<uint64_t, Json::Value>& records);
+
+	///Where the journal for "file" lives.
+	static std::string JournalPath(const std::string& file);
+
+private:
+	void run();
+	void write(const std::string& file, const Snapshot& snapshot);
+	void writeFull(const std::string& file, const Snapshot& snapshot);
+	void writeJournal(const std::string& file, const Snapshot& snapshot);
+
+	std::string listKey;
+	unsigned int fullSaveEvery;
+
+	boost::thread thread;
+	boost::mutex mutex;
+	boost::condition_variable changed;
+	bool running;                //All guarded by "mutex".
+	bool queued;
+	bool busy;
+	std::string queuedFile;
+	Snapshot queuedSnapshot;
+
+	//Worker thread only: what's on disk, and a buffer to build each write in.
+	std::string savedFile;
+	Snapshot saved;
+	uint64_t generation;
+	unsigned int journalSaves;
+	size_t fullBytes;
+	size_t journalBytes;
+	std::string buffer;
+};
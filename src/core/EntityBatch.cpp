@@ -0,0 +1,207 @@
+#include "EntityBatch.hpp"
+
+extern "C" {
+	#include "lauxlib.h"
+}
+
+#include "core/LuaScript.hpp"
+
+
+namespace {
+const char* FloatArrayType = "portentia.FloatArray";
+const char* IntArrayType = "portentia.IntArray";
+
+///What each buffer userdata holds: a view into one of our vectors.
+template <class T>
+struct ArrayView {
+	T* data;
+	size_t size;
+};
+
+//Metamethods. These are only reachable through the buffer's metatable (which is hidden from
+// scripts by __metatable), so the first argument is always the right kind of userdata.
+template <class T>
+ArrayView<T>* CheckIndex(lua_State* L, size_t& index)
+{
+	ArrayView<T>* view = static_cast<ArrayView<T>*>(lua_touserdata(L, 1));
+	if (!view->data) {
+		luaL_error(L, "array used outside of its batch's update (it's only valid during the handler call)");
+	}
+	lua_Integer i = luaL_checkinteger(L, 2);
+	if (i<1 || static_cast<size_t>(i)>view->size) {
+		luaL_error(L, "array index %d out of range (size is %d)", static_cast<int>(i), static_cast<int>(view->size));
+	}
+	index = static_cast<size_t>(i-1);
+	return view;
+}
+
+template <class T>
+int ArrayIndex(lua_State* L)
+{
+	size_t i;
+	ArrayView<T>* view = CheckIndex<T>(L, i);
+	lua_pushnumber(L, static_cast<lua_Number>(view->data[i]));
+	return 1;
+}
+
+template <class T>
+int ArrayNewIndex(lua_State* L)
+{
+	size_t i;
+	ArrayView<T>* view = CheckIndex<T>(L, i);
+	view->data[i] = static_cast<T>(luaL_checknumber(L, 3));
+	return 0;
+}
+
+template <class T>
+int ArrayLen(lua_State* L)
+{
+	ArrayView<T>* view = static_cast<ArrayView<T>*>(lua_touserdata(L, 1));
+	lua_pushinteger(L, static_cast<lua_Integer>(view->size));
+	return 1;
+}
+
+template <class T>
+void RegisterArrayType(lua_State* L, const char* name)
+{
+	luaL_newmetatable(L, name);
+	lua_pushcfunction(L, ArrayIndex<T>);
+	lua_setfield(L, -2, "__index");
+	lua_pushcfunction(L, ArrayNewIndex<T>);
+	lua_setfield(L, -2, "__newindex");
+	lua_pushcfunction(L, ArrayLen<T>);
+	lua_setfield(L, -2, "__len");
+	lua_pushboolean(L, 0);
+	lua_setfield(L, -2, "__metatable");
+	lua_pop(L, 1);
+}
+
+///Make a new (empty) buffer and return its registry reference.
+template <class T>
+int NewArrayView(lua_State* L, const char* name)
+{
+	ArrayView<T>* view = static_cast<ArrayView<T>*>(lua_newuserdata(L, sizeof(ArrayView<T>)));
+	view->data = nullptr;
+	view->size = 0;
+	luaL_getmetatable(L, name);
+	lua_setmetatable(L, -2);
+	return lua::RefTop(L);
+}
+
+///Point a buffer at "vec", and push it.
+template <class T>
+void PushArrayView(lua_State* L, int ref, std::vector<T>& vec)
+{
+	lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+	ArrayView<T>* view = static_cast<ArrayView<T>*>(lua_touserdata(L, -1));
+	view->data = vec.empty() ? nullptr : &vec[0];
+	view->size = vec.size();
+}
+
+///Point a buffer at nothing (so a script that kept it can't reach our vectors once they may have moved).
+template <class T>
+void ResetArrayView(lua_State* L, int ref)
+{
+	lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+	ArrayView<T>* view = static_cast<ArrayView<T>*>(lua_touserdata(L, -1));
+	view->data = nullptr;
+	view->size = 0;
+	lua_pop(L, 1);
+}
+} //End un-named namespace
+
+
+EntityBatch::EntityBatch(const std::string& kind) : kind(kind), L(nullptr), handlerRef(LUA_NOREF)
+{
+	for (int i=0; i<NumViews; i++) {
+		viewRefs[i] = LUA_NOREF;
+	}
+}
+
+
+void EntityBatch::RegisterLua(lua_State* L)
+{
+	RegisterArrayType<float>(L, FloatArrayType);
+	RegisterArrayType<int>(L, IntArrayType);
+}
+
+
+size_t EntityBatch::add(float x, float y, float vx, float vy, int flags)
+{
+	this->x.push_back(x);
+	this->y.push_back(y);
+	this->vx.push_back(vx);
+	this->vy.push_back(vy);
+	this->flags.push_back(flags);
+	return size()-1;
+}
+
+
+void EntityBatch::clear()
+{
+	x.clear();
+	y.clear();
+	vx.clear();
+	vy.clear();
+	flags.clear();
+}
+
+
+bool EntityBatch::setHandler(lua_State* L, const std::string& source)
+{
+	//Moving to a new state? Drop everything in the old one.
+	if (this->L && this->L!=L) {
+		release();
+	}
+	this->L = L;
+
+	lua::Unref(L, handlerRef);
+	handlerRef = lua::CompileChunk(L, source, kind+":onupdate", "n, x, y, vx, vy, flags, elapsed");
+
+	//Our buffers only need to be made once.
+	if (viewRefs[0]==LUA_NOREF) {
+		for (int i=0; i<NumViews-1; i++) {
+			viewRefs[i] = NewArrayView<float>(L, FloatArrayType);
+		}
+		viewRefs[NumViews-1] = NewArrayView<int>(L, IntArrayType);
+	}
+
+	return handlerRef!=LUA_NOREF;
+}
+
+
+bool EntityBatch::update(int elapsedMs)
+{
+	if (!L || handlerRef==LUA_NOREF || x.empty()) {
+		return true;
+	}
+
+	lua_pushinteger(L, static_cast<lua_Integer>(size()));
+	PushArrayView(L, viewRefs[0], x);
+	PushArrayView(L, viewRefs[1], y);
+	PushArrayView(L, viewRefs[2], vx);
+	PushArrayView(L, viewRefs[3], vy);
+	PushArrayView(L, viewRefs[4], flags);
+	lua_pushinteger(L, elapsedMs);
+	bool res = lua::CallChunk(L, handlerRef, 7, kind+":onupdate");
+
+	//The handler may have stored a buffer somewhere; add() or clear() could move what it points at.
+	for (int i=0; i<NumViews-1; i++) {
+		ResetArrayView<float>(L, viewRefs[i]);
+	}
+	ResetArrayView<int>(L, viewRefs[NumViews-1]);
+	return res;
+}
+
+
+void EntityBatch::release()
+{
+	if (!L) { return; }
+	lua::Unref(L, handlerRef);
+	handlerRef = LUA_NOREF;
+	for (int i=0; i<NumViews; i++) {
+		lua::Unref(L, viewRefs[i]);
+		viewRefs[i] = LUA_NOREF;
+	}
+	L = nullptr;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+extern "C" {
+	#include "lua.h"
+}
+
+
+/**
+ * Every entity of one kind (e.g., "villager"), stored as parallel component arrays. The kind's Lua
+ *   handler is called once per update for the whole batch, rather than once per entity:
+ *
+ *     handler(n, x, y, vx, vy, flags, elapsed)
+ *
+ * Each array argument is a typed buffer (userdata) that reads and writes our vectors directly, with
+ *   1-based indices and bounds checking (e.g., "x[i] = x[i] + vx[i]*elapsed/1000"). Afterwards, C++ code
+ *   reads the results straight out of the vectors. The buffers are created once and re-pointed
+ *   before each call, so a batch update costs one pcall no matter how many entities it has. They're
+ *   emptied again after the call; a script that keeps one gets an error if it uses it later.
+ *
+ * Don't resize the arrays from inside the handler (Lua can't); call add() or clear() from C++.
+ */
+class EntityBatch {
+public:
+	explicit EntityBatch(const std::string& kind);
+
+	///Register the buffer types with a Lua state. Called once, by NewLuaState().
+	static void RegisterLua(lua_State* L);
+
+	///Add an entity; returns its index (0-based, in C++).
+	size_t add(float x, float y, float vx=0, float vy=0, int flags=0);
+
+	///Remove all entities.
+	void clear();
+
+	size_t size() const { return x.size(); }
+	const std::string& getKind() const { return kind; }
+
+	///Compile this kind's handler (see above) in "L", which the batch then runs in. Returns false if it doesn't compile.
+	bool setHandler(lua_State* L, const std::string& source);
+
+	///Run the handler once, over every entity. Returns false on a Lua error (which is printed).
+	bool update(int elapsedMs);
+
+	///Release our Lua references (before the state is closed, or before re-loading).
+	void release();
+
+	///The state our handler runs in (null if there's no handler).
+	lua_State* lua() const { return L; }
+
+	//Components, one entry per entity.
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> vx;
+	std::vector<float> vy;
+	std::vector<int> flags;
+
+private:
+	std::string kind;
+	lua_State* L;
+	int handlerRef;
+
+	//Our buffers (in the Lua registry), in the same order as the handler's arguments.
+	enum { NumViews = 5 };
+	int viewRefs[NumViews];
+};
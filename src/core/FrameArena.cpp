@@ -0,0 +1,46 @@
+#include "FrameArena.hpp"
+
+#include <algorithm>
+
+
+FrameArena::FrameArena(size_t capacity) : buffer(new char[capacity]), size(capacity), offset(0), maxUsed(0), numOverflows(0)
+{
+}
+
+
+void* FrameArena::allocate(size_t bytes, size_t align)
+{
+	//Align our current position.
+	size_t start = (offset + align-1) & ~(align-1);
+
+	//Out of space? Fall back to the heap.
+	if (start+bytes > size) {
+		numOverflows++;
+		return ::operator new(bytes);
+	}
+
+	offset = start + bytes;
+	maxUsed = std::max(maxUsed, offset);
+	return buffer.get() + start;
+}
+
+
+void FrameArena::deallocate(void* ptr)
+{
+	if (ptr && !owns(ptr)) {
+		::operator delete(ptr);
+	}
+}
+
+
+void FrameArena::reset()
+{
+	offset = 0;
+}
+
+
+bool FrameArena::owns(const void* ptr) const
+{
+	const char* p = static_cast<const char*>(ptr);
+	return p>=buffer.get() && p<buffer.get()+size;
+}
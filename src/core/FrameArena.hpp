@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+
+
+/**
+ * A per-frame "bump" allocator. Allocating just moves a pointer forward, freeing does nothing, and
+ *   the whole arena is reset at the end of each frame. This makes it ideal for the short-lived
+ *   containers we build every frame (e.g., search results).
+ *
+ * If the arena runs out of space, allocations fall back to the global heap (and are counted, so the
+ *   arena can be sized correctly). Anything allocated from the arena must not outlive the frame.
+ */
+class FrameArena {
+public:
+	explicit FrameArena(size_t capacity);
+
+	///Allocate "bytes" bytes, aligned to "align".
+	void* allocate(size_t bytes, size_t align);
+
+	///Free memory returned by allocate(). Does nothing unless the memory came from the heap.
+	void deallocate(void* ptr);
+
+	///Release everything (at the end of the frame).
+	void reset();
+
+	size_t capacity() const { return size; }
+	size_t used() const { return offset; }
+	size_t highWater() const { return maxUsed; }
+	size_t overflows() const { return numOverflows; }
+
+private:
+	bool owns(const void* ptr) const;
+
+	std::unique_ptr<char[]> buffer;
+	size_t size;
+	size_t offset;
+	size_t maxUsed;
+	size_t numOverflows;
+};
+
+
+/**
+ * An STL-compatible allocator which allocates from a FrameArena. A null arena uses the global heap,
+ *   so containers can use this type whether or not an arena is available.
+ */
+template <class T>
+class ArenaAllocator {
+public:
+	typedef T value_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+
+	template <class U>
+	struct rebind { typedef ArenaAllocator<U> other; };
+
+	explicit ArenaAllocator(FrameArena* arena=nullptr) : arena(arena) {}
+
+	template <class U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+	T* allocate(size_t n) {
+		if (!arena) {
+			return static_cast<T*>(::operator new(n*sizeof(T)));
+		}
+		return static_cast<T*>(arena->allocate(n*sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T* ptr, size_t) {
+		if (!arena) {
+			::operator delete(ptr);
+		} else {
+			arena->deallocate(ptr);
+		}
+	}
+
+	template <class U>
+	bool operator==(const ArenaAllocator<U>& other) const { return arena==other.arena; }
+
+	template <class U>
+	bool operator!=(const ArenaAllocator<U>& other) const { return arena!=other.arena; }
+
+	FrameArena* arena;
+};
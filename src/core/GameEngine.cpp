@@ -1,30 +1,108 @@
 #include "GameEngine.hpp"
 
 #include <vector>
+#include <cstdio>
+#include <algorithm>
 #include <iostream>
 #include <stdexcept>
 
 #include <luabind/luabind.hpp>
+#include <boost/filesystem.hpp>
 
 #include "core/LuaBindings.hpp"
+#include "core/LuaScript.hpp"
+#include "core/JobSystem.hpp"
+#include "core/ScriptScheduler.hpp"
+#include "core/ScriptMonitor.hpp"
+#include "core/ScriptDomain.hpp"
+#include "core/AllocTracker.hpp"
+#include "core/Profiler.hpp"
+#include "core/InitGraph.hpp"
+#include "map/CompiledMap.hpp"
+#include "map/MapCompiler.hpp"
+#include "map/MapReader.hpp"
+#include "pack/AssetPack.hpp"
+#include "pack/PackFormat.hpp"
 #include "platform/Fonts.hpp"
 #include "slices/Slice.hpp"
+#include "slices/LoadingSlice.hpp"
 #include "slices/WalkableMapSlice.hpp"
 
 
 //Temp: We don't perform memory management of slices.
+//They're made on first use (after the engine), so they're destroyed before it; the first slice
+// hands its NPCs back to the engine's script domains when it goes.
 namespace {
-WalkableMapSlice FirstSlice;
+WalkableMapSlice& FirstSlice()
+{
+	static WalkableMapSlice slice;
+	return slice;
+}
+
+LoadingSlice& Loading()
+{
+	static LoadingSlice slice;
+	return slice;
+}
+
+const char FirstMap[] = "res/map_tavern.json";
+
+//Time we'll spend uploading loaded textures each frame.
+const sf::Time AssetUploadBudget = sf::milliseconds(2);
+
+//Where we remember the system's monospace font (asking for it is slow).
+const char FontCacheFile[] = "cache/mono_font.txt";
+
+///Our own font, a packed one, or (slowest) the system's.
+std::string FindMonoFont()
+{
+	for (const char* font : {"scp.otf", packfile::MonoFont}) {
+		if (pack::Contains(font) || boost::filesystem::is_regular_file(font)) {
+			return font;
+		}
+	}
+
+	boost::system::error_code err;
+	boost::filesystem::create_directories(boost::filesystem::path(FontCacheFile).parent_path(), err);
+	return platform::CachedMonoFont(FontCacheFile);
+}
+
+///Compile "file" ahead of time, if its compiled form is out of date (see WalkableMapSlice::load()).
+void CompileMap(const std::string& file)
+{
+	std::string binFile = mapfile::CompiledPath(file);
+	if (CompiledMap::IsStale(file, binFile)) {
+		try {
+			mapfile::MapData map;
+			mapfile::ReadMapFile(file, map);
+			mapfile::Compile(map, binFile);
+		} catch (std::exception& ex) {
+			//The slice will try again (and fall back to the JSON) when it loads.
+			std::cout <<"Warn: " <<ex.what() <<"\n";
+		}
+	}
+}
 } //End un-named namespace.
 
 
-GameEngine::GameEngine() : fps(100), L(nullptr)
+GameEngine::GameEngine() : fps(240), L(nullptr), frameBudget(sf::microseconds(1000000/60)), hotReloadOn(true), startupBenchmark(false), maxCatchUp(5), frameCount(0), replayFrames(0), arena(1024*1024)
 {
+	//Typed keys can build up over a few frames (fixed timestep); don't allocate for them each frame.
+	typed.reserve(InputLog::MaxEvents*4);
 }
 
 GameEngine::~GameEngine()
 {
-	//Close the Lua state.
+	//Nothing more to reload (or load), or start up.
+	startup.reset();
+	reloader.stop();
+	assetManager.stop();
+
+	//Close the Lua state (the scheduler and monitor hold references into it).
+	domains.reset();
+	scheduler.reset();
+	monitor.reset();
+	luaGc.reset();
 	if (L) {
 		lua_close(L);
 	}
@@ -64,49 +142,144 @@ bool GameEngine::remSlice() {
 
 void GameEngine::createGameWindow(const sf::VideoMode& wndSize, const std::string& title, Position wndPos)
 {
-	//Load a default "mono" font, for helpful debugging.
-	bool foundFont = false;
-	std::vector<std::string> sampleFonts = {"scp.otf", platform::GuessMonoFont()};
-	for (std::string font : sampleFonts) {
-		if (monoFont.loadFromFile(font)) {
-			foundFont = true;
-			break;
+	//Start-up is a graph of tasks. The slow, independent parts (finding a font, setting up Lua and running our
+	// scripts, compiling the first map) run in the background, while the window opens and shows a loading
+	// slice; the rest runs on the main thread as soon as what it needs is ready (see runGameLoop()).
+	startupClock.restart();
+	startup.reset(new InitGraph());
+	InitGraph& init = *startup;
+	typedef InitGraph::Thread Thread;
+
+	//Find a default "mono" font, for helpful debugging.
+	init.add("font.find", Thread::Any, {}, [this]() {
+		monoFontPath = FindMonoFont();
+	});
+
+	//Initialize and bind the Lua state, then run our startup scripts (from the bytecode cache, if we can).
+	//Nothing else touches Lua until this has finished.
+	init.add("lua", Thread::Any, {}, [this]() {
+		L = NewLuaState(luaPool);
+		luaGc.reset(new LuaGc(L, gcPolicy));
+		scheduler.reset(new ScriptScheduler(L));
+		monitor.reset(new ScriptMonitor(L));
+		lua::RunDirectory(L, "script");
+	});
+
+	//Compile the first map (if it's changed), so that loading it is quick.
+	init.add("map.compile", Thread::Any, {}, []() {
+		CompileMap(FirstMap);
+	});
+
+	init.add("window", Thread::Main, {}, [this, wndSize, title, wndPos]() {
+		//Calculate the center position first, since getDesktopMode() seems to delay window movement otherwise.
+		sf::VideoMode deskMode = sf::VideoMode::getDesktopMode();
+		sf::Vector2i centerPos = {
+			static_cast<int>(deskMode.width-wndSize.width)/2,
+			static_cast<int>(deskMode.height-wndSize.height)/2
+		};
+
+		//Create and immediately center the window, if requested. (Seems to avoid flickering this way.)
+		window.create(wndSize, title);
+		if (wndPos==Position::Center) {
+			window.setPosition(centerPos);
+		}
+
+		//vsync. Replays run hidden, and as fast as possible.
+		if (inputLog.getMode()==InputLog::Mode::Replay) {
+			window.setVisible(false);
+			window.setVerticalSyncEnabled(false);
+		} else {
+			window.setVerticalSyncEnabled(true);
+		}
+
+		//Decode textures in the background (the GL context exists now, so we can make our placeholder).
+		assetManager.start();
+
+		//Show our progress until everything's ready.
+		Loading().watch(*startup, monoFont);
+		setSlice(&Loading());
+	});
+
+	//Start our worker threads.
+	init.add("jobs", Thread::Main, {}, [this]() {
+		jobSystem.reset(new JobSystem());
+	});
+
+	init.add("font.load", Thread::Main, {"font.find"}, [this]() {
+		monoFont = assetManager.loadFont(monoFontPath);
+		if (!monoFont.ok()) {
+			throw std::runtime_error("Can't find a suitable font; exiting.");
+		}
+
+		//Initialize our fps counter.
+		fps.setColor(sf::Color::Red);
+		fps.setPosition(10, 10);
+		fps.setCharacterSize(20);
+		fps.setFont(getMonoFont());
+	});
+
+	init.add("scripts", Thread::Main, {"lua", "jobs"}, [this]() {
+		domains.reset(new ScriptDomains(L));
+
+		//Reload content as it changes (but not while replaying; replays must be reproducible).
+		if (hotReloadOn && inputLog.getMode()!=InputLog::Mode::Replay) {
+			reloader.subscribe("script/", this, [this](const HotReloader::Asset& asset) {
+				if (asset.path.size()>4 && asset.path.compare(asset.path.size()-4, 4, ".lua")==0) {
+					lua::RunSource(L, asset.text, asset.path);
+				}
+			});
+			reloader.start({"res", "script"});
 		}
+	});
+
+	//TEMP
+	init.add("map.load", Thread::Main, {"scripts", "font.load", "map.compile", "window"}, [this]() {
+		FirstSlice().load(*this, FirstMap);
+	});
+
+	//Open the window now. Recorded (and replayed) input starts with the game's first slice, so don't show
+	// the loading slice in that case (replays must be reproducible).
+	init.start();
+	if (inputLog.getMode()!=InputLog::Mode::Off) {
+		init.wait();
+		finishStartup();
+	} else {
+		init.poll();
 	}
+}
 
-	//Nothing?
-	if (!foundFont) {
-		throw std::runtime_error("Can't find a suitable font; exiting.");
-    }
 
-	//Initialize and bind the Lua state.
-	L = NewLuaState();
-
-	//Initialize our fps counter.
-    fps.setColor(sf::Color::Red);
-    fps.setPosition(10, 10);
-    fps.setCharacterSize(20);
-    fps.setFont(getMonoFont());
-
-	//Calculate the center position first, since getDesktopMode() seems to delay window movement otherwise.
-	sf::VideoMode deskMode = sf::VideoMode::getDesktopMode();
-	sf::Vector2i centerPos = {
-		static_cast<int>(deskMode.width-wndSize.width)/2,
-		static_cast<int>(deskMode.height-wndSize.height)/2
-	};
-
-    //Create and immediately center the window, if requested. (Seems to avoid flickering this way.)
-    window.create(wndSize, title);
-    if (wndPos==Position::Center) {
-    	window.setPosition(centerPos);
-    }
+void GameEngine::finishStartup()
+{
+	readyTime = startupClock.getElapsedTime();
+	startupTimings = startup->timings();
+	setSlice(&FirstSlice());
+	Loading().unwatch();
+	startup.reset();
+}
 
-    //vsync
-    window.setVerticalSyncEnabled(true);
 
-    //TEMP
-    FirstSlice.load("res/map_tavern.json");
-    setSlice(&FirstSlice);
+void GameEngine::setStartupBenchmark(bool enabled)
+{
+	startupBenchmark = enabled;
+}
+
+
+void GameEngine::reportStartup() const
+{
+	printf("Start-up: first frame at %.1f ms; ready at %.1f ms; first game frame at %.1f ms\n",
+		firstFrameTime.asMicroseconds()/1000.0, readyTime.asMicroseconds()/1000.0, firstGameFrameTime.asMicroseconds()/1000.0);
+	printf("%-12s %-6s %10s %10s %10s\n", "task", "thread", "start(ms)", "end(ms)", "took(ms)");
+	for (const InitGraph::Timing& task : startupTimings) {
+		printf("%-12s %-6s %10.1f %10.1f %10.1f\n", task.name.c_str(), task.thread==InitGraph::Thread::Main?"main":"worker",
+			task.start.asMicroseconds()/1000.0, task.end.asMicroseconds()/1000.0, (task.end-task.start).asMicroseconds()/1000.0);
+	}
+}
+
+
+void GameEngine::setHotReload(bool enabled)
+{
+	hotReloadOn = enabled;
 }
 
 
@@ -123,39 +296,195 @@ YieldAction GameEngine::addRemMoveSlices(const YieldAction& next, Slice* currSli
 	}
 
 	//At this point, we've successfully modified the Slice stack. Notify the top-most Slice either way.
+	if (slices.empty()) { return YieldAction(); }
 	return slices.back()->activated(*this, currSlice, window);
 }
 
 
+void GameEngine::setFixedTimestep(unsigned int ticksPerSecond, unsigned int maxCatchUp)
+{
+	tickLength = ticksPerSecond>0 ? sf::microseconds(1000000/ticksPerSecond) : sf::Time::Zero;
+	this->maxCatchUp = std::max(1U, maxCatchUp);
+	accumulator = sf::Time::Zero;
+}
+
+
+void GameEngine::setLuaGcPolicy(const LuaGc::Policy& policy, const sf::Time& frameBudget)
+{
+	gcPolicy = policy;
+	this->frameBudget = frameBudget;
+	if (luaGc) {
+		luaGc->setPolicy(policy);
+	}
+}
+
+
 void GameEngine::runGameLoop()
 {
     sf::Clock clock;
+    size_t allocsAtFrameStart = alloc::newCount();
     while (window.isOpen()) {
+    	profiler::beginFrame(frameCount++);
+    	PROFILE_SCOPE("frame");
+
     	//Time elapsed
-    	elapsed = clock.restart();
-    	luabind::globals(L)["elapsed"] = elapsed.asMilliseconds();
+    	sf::Time frameTime = clock.restart();
 
-    	//Process all events.
-    	std::vector<sf::Event::KeyEvent> typed;
-    	processEvents(typed);
+    	//Process all events. This may replace the frame time, if we're replaying input.
+    	frameTime = processEvents(frameTime, typed);
+    	breakdown = FrameBreakdown();
 
-    	//Update the current slice.
-    	if (!slices.empty()) {
-    		slices.back()->update(elapsed, typed);
+    	//Closed (or out of recorded input)? Don't run a tick without input to match.
+    	if (!window.isOpen()) { break; }
+
+    	//Run any start-up tasks that are ready; once they've all finished, the game's first slice takes over.
+    	if (startup && startup->poll()) {
+    		finishStartup();
+    	}
+
+    	//Swap in anything that's been reloaded since the last frame.
+    	reloader.apply();
+
+    	//Upload a few textures that have finished loading.
+    	assetManager.update(AssetUploadBudget);
+
+    	//Update time includes script time; we separate it out afterwards.
+    	sf::Clock phaseClock;
+
+    	//Variable timestep: one update per frame, no interpolation.
+    	float alpha = 1.0;
+    	if (tickLength==sf::Time::Zero) {
+    		updateSlices(frameTime, typed);
+    		typed.clear();
+    	} else {
+    		//Fixed timestep: run as many ticks as have accumulated, up to our catch-up limit.
+    		accumulator += frameTime;
+    		unsigned int steps = 0;
+    		while (accumulator>=tickLength && steps<maxCatchUp) {
+    			updateSlices(tickLength, typed);
+    			typed.clear(); //Typed keys are only delivered to one tick.
+    			accumulator -= tickLength;
+    			steps++;
+    		}
+
+    		//Still behind? Drop the backlog rather than spiraling.
+    		if (accumulator>=tickLength) {
+    			accumulator = sf::microseconds(accumulator.asMicroseconds() % tickLength.asMicroseconds());
+    		}
+    		alpha = static_cast<float>(accumulator.asMicroseconds()) / tickLength.asMicroseconds();
     	}
 
+    	breakdown.update = phaseClock.restart() - breakdown.script;
+
     	//Paint everything
-    	repaintGame();
+    	repaintGame(alpha);
+    	breakdown.render = phaseClock.restart();
+
+    	//Collect Lua garbage in whatever's left of our frame budget (before we block on vsync).
+    	if (!startup) {
+    	PROFILE_SCOPE("lua gc");
+    	breakdown.gc = luaGc->step(frameBudget - clock.getElapsedTime());
+    	breakdown.luaHeap = luaGc->heapBytes();
+    	}
+
+    	//Show it (this typically blocks on vsync).
+    	{
+    	PROFILE_SCOPE("display");
+    	window.display();
+    	}
+
+    	//Time to the first frame (of anything), and to the game's first frame.
+    	if (firstFrameTime==sf::Time::Zero) {
+    		firstFrameTime = startupClock.getElapsedTime();
+    	}
+    	if (!startup && firstGameFrameTime==sf::Time::Zero) {
+    		firstGameFrameTime = startupClock.getElapsedTime();
+    		if (startupBenchmark) {
+    			reportStartup();
+    			window.close();
+    		}
+    	}
+
+    	//End of frame: count heap allocations, and release per-frame memory.
+    	size_t allocs = alloc::newCount();
+    	breakdown.allocs = allocs - allocsAtFrameStart;
+    	allocsAtFrameStart = allocs;
+    	alloc::endFrame();
+    	arena.reset();
     }
+
+    //Flush any partial capture (and input log).
+    profiler::finish();
+    inputLog.finish();
 }
 
 
-void GameEngine::processEvents(std::vector<sf::Event::KeyEvent>& typed)
+void GameEngine::updateSlices(const sf::Time& tick, const std::vector<sf::Event::KeyEvent>& typed)
 {
-	//Update the FPS counter.
-	fps.update(elapsed);
+	PROFILE_SCOPE("Slice::update");
+	elapsed = tick;
+
+	//Until start-up has finished, only the loading slice runs (Lua isn't ready).
+	if (startup) {
+		if (!slices.empty()) {
+			slices.back()->update(elapsed, typed);
+		}
+		return;
+	}
+
+	{
+	ALLOC_SCOPE(alloc::Subsystem::Lua);
+	lua_pushinteger(L, elapsed.asMilliseconds());
+	lua_setglobal(L, "elapsed");
+	}
 
-	//Update based on events.
+	//Update the current slice, and stack/replace/remove slices if it asks us to.
+	if (!slices.empty()) {
+		YieldAction next = slices.back()->update(elapsed, typed);
+		while (next.action!=YieldAction::Nothing && !slices.empty()) {
+			next = addRemMoveSlices(next, slices.back());
+		}
+	}
+
+	//Resume any behaviours that are due.
+	{
+	PROFILE_SCOPE("lua behaviours");
+	ALLOC_SCOPE(alloc::Subsystem::Lua);
+	sf::Clock scriptClock;
+	scheduler->update(elapsed);
+
+	//Then run every script domain, in parallel, and pass their messages around.
+	domains->update(*jobSystem, elapsed);
+	addScriptTime(scriptClock.getElapsedTime());
+	}
+}
+
+
+bool GameEngine::recordInput(const std::string& file)
+{
+	return inputLog.startRecording(file);
+}
+
+
+bool GameEngine::replayInput(const std::string& file)
+{
+	return inputLog.startReplay(file);
+}
+
+
+sf::Time GameEngine::processEvents(const sf::Time& frameTime, std::vector<sf::Event::KeyEvent>& typed)
+{
+	PROFILE_SCOPE("processEvents");
+
+	//Update the FPS counter (with the previous frame's timings).
+	fps.update(frameTime, breakdown);
+
+	//Start a new input frame; held keys carry over.
+	bool live = inputLog.getMode()!=InputLog::Mode::Replay;
+	input.elapsedUs = frameTime.asMicroseconds();
+	input.numEvents = 0;
+
+	//Update based on events. We track held keys from events (rather than polling every key).
 	sf::Event event;
 	while (window.pollEvent(event)) {
 		switch (event.type) {
@@ -165,30 +494,73 @@ void GameEngine::processEvents(std::vector<sf::Event::KeyEvent>& typed)
 
 			case sf::Event::KeyPressed:
 				//Accumulate key presses.
-				typed.push_back(event.key);
+				if (live) {
+					input.setKey(event.key.code, true);
+					input.addEvent(event.key);
+				}
+				break;
+
+			case sf::Event::KeyReleased:
+				if (live) {
+					input.setKey(event.key.code, false);
+				}
+				break;
+
+			case sf::Event::LostFocus:
+				//We won't see the releases.
+				if (live) {
+					input.keys[0] = input.keys[1] = 0;
+				}
 				break;
 
 			default: //Else, don't handle
 				break;
 		}
 	}
+
+	//Record or replay. A frame that closes the window is never run (see runGameLoop()), so it isn't recorded.
+	if (inputLog.getMode()==InputLog::Mode::Record && window.isOpen()) {
+		inputLog.record(input);
+	} else if (inputLog.getMode()==InputLog::Mode::Replay) {
+		if (replayFrames==0) {
+			replayClock.restart();
+		}
+		if (inputLog.replay(input)) {
+			replayFrames++;
+		} else {
+			//Done; report and exit.
+			float ms = replayClock.getElapsedTime().asMicroseconds()/1000.0f;
+			std::cout <<"Replay finished: " <<replayFrames <<" frames in " <<ms <<" ms (" <<(replayFrames>0?ms/replayFrames:0) <<" ms/frame)\n";
+			inputLog.finish();
+			window.close();
+		}
+	}
+
+	for (unsigned int i=0; i<input.numEvents; i++) {
+		typed.push_back(input.events[i]);
+	}
+	return sf::microseconds(input.elapsedUs);
 }
 
 
-void GameEngine::repaintGame() const
+void GameEngine::repaintGame(float alpha) const
 {
+	PROFILE_SCOPE("repaintGame");
+	ALLOC_SCOPE(alloc::Subsystem::Render);
+
 	//Now ask the slice to draw.
 	window.clear();
+	//Only the top slice is updated; the rest are drawn where they last were, not blended towards it.
 	for (Slice* sl : slices) {
+		sl->interpolate(sl==slices.back() ? alpha : 1.0f);
 		sl->render();
 		window.setView(window.getDefaultView());
 	}
 
-	//Paint the FPS counter over all slices.
-	window.draw(fps);
-
-	//Draw
-	window.display();
+	//Paint the FPS counter over all slices (once we have a font for it).
+	if (monoFont.ok()) {
+		window.draw(fps);
+	}
 }
 
 
@@ -198,6 +570,63 @@ lua_State* GameEngine::lua()
 }
 
 
+void GameEngine::addScriptTime(const sf::Time& time)
+{
+	breakdown.script += time;
+}
+
+
+bool GameEngine::isKeyPressed(sf::Keyboard::Key key) const
+{
+	return input.isKeyPressed(key);
+}
+
+
+FrameArena& GameEngine::frameArena()
+{
+	return arena;
+}
+
+
+JobSystem& GameEngine::jobs()
+{
+	if (!jobSystem) {
+		throw std::runtime_error("GameEngine::jobs() called before the \"jobs\" start-up task has run.");
+	}
+	return *jobSystem;
+}
+
+
+ScriptScheduler& GameEngine::scripts()
+{
+	return *scheduler;
+}
+
+
+ScriptMonitor& GameEngine::scriptMonitor()
+{
+	return *monitor;
+}
+
+
+ScriptDomains& GameEngine::scriptDomains()
+{
+	return *domains;
+}
+
+
+HotReloader& GameEngine::hotReload()
+{
+	return reloader;
+}
+
+
+AssetManager& GameEngine::assets()
+{
+	return assetManager;
+}
+
+
 float GameEngine::getElapsedMs() const
 {
 	return elapsed.asSeconds();
@@ -206,7 +635,7 @@ float GameEngine::getElapsedMs() const
 
 const sf::Font& GameEngine::getMonoFont() const
 {
-	return monoFont;
+	return monoFont.get();
 }
 
 
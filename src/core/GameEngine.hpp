@@ -3,15 +3,27 @@
 #include <SFML/Graphics.hpp>
 #include <string>
 #include <list>
+#include <memory>
 
 extern "C" {
 	#include "lua.h"
 }
 
 #include "widgets/FpsCounter.hpp"
+#include "core/InputLog.hpp"
+#include "core/FrameArena.hpp"
+#include "core/LuaPool.hpp"
+#include "core/LuaGc.hpp"
+#include "core/HotReloader.hpp"
+#include "core/AssetManager.hpp"
+#include "core/InitGraph.hpp"
 
 //Forward declarations
 class Slice;
+class JobSystem;
+class ScriptScheduler;
+class ScriptMonitor;
+class ScriptDomains;
 struct YieldAction;
 
 
@@ -31,6 +43,33 @@ public:
 
 	///Retrieve the Lua state.
 	virtual lua_State* lua() = 0;
+
+	///Report time spent running scripts this frame (it's shown separately from "update" time).
+	virtual void addScriptTime(const sf::Time& time) = 0;
+
+	///Retrieve the engine's task scheduler (for spreading work across cores). Throws if called during start-up, before it exists.
+	virtual JobSystem& jobs() = 0;
+
+	///Is this key held down? Use this instead of sf::Keyboard, so that input can be recorded and replayed.
+	virtual bool isKeyPressed(sf::Keyboard::Key key) const = 0;
+
+	///Scratch memory that lives until the end of the current frame (see FrameArena).
+	virtual FrameArena& frameArena() = 0;
+
+	///Retrieve the Lua behaviour scheduler (for scripts that wait; see ScriptScheduler).
+	virtual ScriptScheduler& scripts() = 0;
+
+	///Retrieve the Lua budget/profiling hooks (see ScriptMonitor).
+	virtual ScriptMonitor& scriptMonitor() = 0;
+
+	///Retrieve the isolated Lua states which run on worker threads (see ScriptDomain).
+	virtual ScriptDomains& scriptDomains() = 0;
+
+	///Subscribe to changed files here, to reload them without restarting (see HotReloader).
+	virtual HotReloader& hotReload() = 0;
+
+	///The shared texture/font/script cache. Textures load without blocking the frame (see AssetManager).
+	virtual AssetManager& assets() = 0;
 };
 
 
@@ -45,6 +84,13 @@ public:
 	///How to position the window.
 	enum class Position {Default, Center};
 
+	///Record all input to "file" (call before createGameWindow()).
+	bool recordInput(const std::string& file);
+
+	///Replay input from "file" instead of reading the keyboard (call before createGameWindow()).
+	/// The window is hidden, vsync is disabled, and the game exits once the log is exhausted.
+	bool replayInput(const std::string& file);
+
 	//Set the current Slice; replace all others in the stack (call once, at the game's start).
 	void setSlice(Slice* slice);
 
@@ -53,6 +99,16 @@ public:
 
 	//virtual void YieldToSlice(Slice* newSlice, Slice* parent, bool stack);
 
+	///Run the simulation at a fixed rate of "ticksPerSecond", independent of the display rate.
+	/// At most "maxCatchUp" ticks are run per frame; any further backlog is dropped (so a slow
+	/// frame can't spiral). Rendering is interpolated between the last two ticks.
+	///A tick rate of 0 restores the default variable timestep (one update per frame).
+	void setFixedTimestep(unsigned int ticksPerSecond, unsigned int maxCatchUp=5);
+
+	///How Lua's garbage collector is run (see LuaGc). By default, it's stepped in the time left over
+	/// at the end of each frame, assuming a "frameBudget" of 60Hz.
+	void setLuaGcPolicy(const LuaGc::Policy& policy, const sf::Time& frameBudget=sf::microseconds(1000000/60));
+
 	void runGameLoop();
 
 	float getElapsedMs() const;
@@ -63,12 +119,41 @@ public:
 	///Get the current Lua state.
 	virtual lua_State* lua();
 
+	virtual void addScriptTime(const sf::Time& time);
+
+	virtual JobSystem& jobs();
+
+	virtual bool isKeyPressed(sf::Keyboard::Key key) const;
+
+	virtual FrameArena& frameArena();
+
+	virtual ScriptScheduler& scripts();
+
+	virtual ScriptMonitor& scriptMonitor();
+
+	virtual ScriptDomains& scriptDomains();
+
+	virtual HotReloader& hotReload();
+
+	virtual AssetManager& assets();
+
+	///Reload changed files under "res" and "script" while the game runs (call before createGameWindow()). On by default.
+	void setHotReload(bool enabled);
+
+	///Report how long start-up took (to the first frame, and per start-up task) once the game's first
+	/// slice has been shown, then exit (call before createGameWindow()).
+	void setStartupBenchmark(bool enabled);
+
 private:
 	//Portions of the game update loop
-	void processEvents(std::vector<sf::Event::KeyEvent>& typed); //Stores typed keys in the vector.
-	void repaintGame() const;
+	sf::Time processEvents(const sf::Time& frameTime, std::vector<sf::Event::KeyEvent>& typed); //Stores typed keys in the vector; returns the simulated frame time.
+	void updateSlices(const sf::Time& tick, const std::vector<sf::Event::KeyEvent>& typed);
+	void repaintGame(float alpha) const;
 	YieldAction addRemMoveSlices(const YieldAction& next, Slice* currSlice);
 
+	void finishStartup(); //Replace the loading slice with the game's first slice.
+	void reportStartup() const;
+
 	bool addSlice(Slice* slice); //Add a Slice to the stack.
 	bool remSlice(); //Remove. Does *not* free the associated memory.
 
@@ -77,12 +162,66 @@ private:
 	//Elapsed time for this update tick.
 	sf::Time elapsed;
 
-	sf::Font monoFont;
+	//Fixed timestep. A zero tickLength means "variable timestep".
+	sf::Time tickLength;
+	unsigned int maxCatchUp;
+	sf::Time accumulator;
+
+	//Number of frames run (used to pick which frames the profiler captures).
+	unsigned int frameCount;
+
+	//This frame's input (live or replayed), and the log we record it to (or replay it from).
+	InputLog::Frame input;
+	InputLog inputLog;
+	sf::Clock replayClock;
+	unsigned int replayFrames;
+
+	//Transient, per-frame allocations.
+	FrameArena arena;
+
+	//Keys typed since the last update (kept across frames in which no fixed tick runs).
+	std::vector<sf::Event::KeyEvent> typed;
+
+	AssetManager::FontHandle monoFont;
 	FpsCounter fps;
+	FrameBreakdown breakdown; //For the frame in progress; reported to "fps" at the start of the next one.
 
-	//Every engine maintains the current Lua state.
+	//Every engine maintains the current Lua state, and the pool it allocates from (which must outlive it).
+	LuaPool luaPool;
 	lua_State* L;
 
+	//Runs Lua's collector in our spare time; created with the Lua state.
+	std::unique_ptr<LuaGc> luaGc;
+	LuaGc::Policy gcPolicy;
+	sf::Time frameBudget;
+
+	//Resumes waiting Lua coroutines; created (and destroyed) with the Lua state.
+	std::unique_ptr<ScriptScheduler> scheduler;
+	std::unique_ptr<ScriptMonitor> monitor;
+
+	//Our task scheduler; created with the window.
+	std::unique_ptr<JobSystem> jobSystem;
+
+	//Start-up tasks, while they run (see createGameWindow()); null once they've all finished.
+	std::unique_ptr<InitGraph> startup;
+	std::string monoFontPath; //Found by the "font.find" task.
+	bool startupBenchmark;
+	sf::Clock startupClock;
+	sf::Time firstFrameTime;
+	sf::Time readyTime;
+	sf::Time firstGameFrameTime;
+	std::vector<InitGraph::Timing> startupTimings;
+
+	//Watches for changed content; applied between frames.
+	HotReloader reloader;
+	bool hotReloadOn;
+
+	//Caches textures, fonts and scripts. Textures are decoded in the background, and a few are uploaded each frame.
+	AssetManager assetManager;
+
+	//Per-slice Lua states, updated in parallel on the task scheduler.
+	std::unique_ptr<ScriptDomains> domains;
+
 	std::list<Slice*> slices; //The back-most one handles events, but all of them render.
 };
 
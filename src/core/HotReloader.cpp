@@ -0,0 +1,157 @@
+#include "HotReloader.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+#include "core/Profiler.hpp"
+
+
+namespace {
+//How often the watcher thread checks whether it should stop.
+const int PollMs = 200;
+
+bool EndsWith(const std::string& str, const std::string& suffix)
+{
+	return str.size()>=suffix.size() && std::equal(suffix.rbegin(), suffix.rend(), str.rbegin());
+}
+} //End un-named namespace
+
+
+HotReloader::HotReloader() : running(false)
+{
+}
+
+
+HotReloader::~HotReloader()
+{
+	stop();
+}
+
+
+bool HotReloader::start(const std::vector<std::string>& dirs)
+{
+	bool any = false;
+	for (const std::string& dir : dirs) {
+		if (watcher.addDirectory(dir)) {
+			any = true;
+		} else {
+			std::cout <<"Warn: Can't watch directory for changes: " <<dir <<"\n";
+		}
+	}
+
+	if (any && !running) {
+		running = true;
+		thread = boost::thread(&HotReloader::run, this);
+	}
+	return any;
+}
+
+
+void HotReloader::stop()
+{
+	if (running) {
+		running = false;
+		thread.join();
+	}
+}
+
+
+void HotReloader::run()
+{
+	profiler::setThreadName("hot reload");
+	std::vector<std::string> changed;
+	while (running) {
+		changed.clear();
+		if (!watcher.wait(changed, PollMs)) { continue; }
+
+		//Do the slow part (reading, decoding, parsing) here.
+		for (const std::string& path : changed) {
+			//Skip our own output (compiled maps and their chunks, which can be large).
+			if (EndsWith(path, ".pmap") || EndsWith(path, ".tmp")) { continue; }
+			Asset asset = Load(path);
+			boost::mutex::scoped_lock lock(readyMutex);
+			ready.push_back(asset);
+		}
+	}
+}
+
+
+HotReloader::Asset HotReloader::Load(const std::string& path)
+{
+	//Watched directories are given as (e.g.) "res", so paths come out as "res/file".
+	Asset res;
+	res.path = path;
+	res.ok = false;
+
+	std::string lower = path;
+	std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+	if (EndsWith(lower, ".png") || EndsWith(lower, ".jpg") || EndsWith(lower, ".bmp") || EndsWith(lower, ".tga")) {
+		res.kind = Asset::Kind::Image;
+		res.ok = res.image.loadFromFile(path);
+	} else if (EndsWith(lower, ".json")) {
+		res.kind = Asset::Kind::Json;
+		std::ifstream in(path.c_str());
+		Json::Reader read;
+		res.ok = in && read.parse(in, res.json);
+	} else {
+		res.kind = Asset::Kind::Text;
+		std::ifstream in(path.c_str(), std::ios::binary);
+		if (in) {
+			res.text.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+			res.ok = true;
+		}
+	}
+
+	if (!res.ok) {
+		std::cout <<"Warn: Can't reload changed file: " <<path <<"\n";
+	}
+	return res;
+}
+
+
+void HotReloader::subscribe(const std::string& prefix, const void* owner, Listener listener)
+{
+	Subscription sub;
+	sub.prefix = prefix;
+	sub.owner = owner;
+	sub.listener = listener;
+	subs.push_back(sub);
+}
+
+
+void HotReloader::unsubscribe(const void* owner)
+{
+	subs.erase(std::remove_if(subs.begin(), subs.end(), [owner](const Subscription& sub) {
+		return sub.owner==owner;
+	}), subs.end());
+}
+
+
+void HotReloader::apply()
+{
+	//Grab everything that's ready (the watcher thread keeps going).
+	scratchReady.clear();
+	{
+	boost::mutex::scoped_lock lock(readyMutex);
+	if (ready.empty()) { return; }
+	scratchReady.swap(ready);
+	}
+
+	PROFILE_SCOPE("HotReloader::apply");
+	for (const Asset& asset : scratchReady) {
+		if (!asset.ok) { continue; }
+
+		//Listeners may (un-)subscribe, so work from a copy.
+		scratchSubs.clear();
+		for (const Subscription& sub : subs) {
+			if (asset.path.compare(0, sub.prefix.size(), sub.prefix)==0) {
+				scratchSubs.push_back(sub);
+			}
+		}
+		for (const Subscription& sub : scratchSubs) {
+			sub.listener(asset);
+		}
+	}
+	scratchReady.clear();
+}
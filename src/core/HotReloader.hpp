@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <functional>
+
+#include <SFML/Graphics.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <jsoncpp/json/json.h>
+
+#include "platform/FileWatcher.hpp"
+
+
+/**
+ * Reloads content while the game runs. A background thread watches directories (e.g., "res" and
+ *   "script") for changed files, and loads each one as soon as it changes:
+ *    * Images (png, jpg, bmp, tga) are decoded into an sf::Image.
+ *    * JSON files are parsed into a Json::Value.
+ *    * Anything else (e.g., Lua) is read as text.
+ * The results wait until apply() is called (by the engine, between frames), which hands each one to
+ *   whoever has subscribed to its path. Listeners only do the cheap part (e.g., uploading a texture
+ *   or swapping in one map layer), so a change costs milliseconds instead of a restart.
+ */
+class HotReloader {
+public:
+	///A changed file, loaded.
+	struct Asset {
+		enum class Kind { Image, Json, Text };
+
+		std::string path;
+		Kind kind;
+		bool ok; //False if it couldn't be loaded (or parsed).
+		sf::Image image;
+		Json::Value json;
+		std::string text;
+	};
+	typedef std::function<void(const Asset& asset)> Listener;
+
+	HotReloader();
+	~HotReloader();
+
+	///Start watching these directories (in the background). Returns false if nothing can be watched.
+	bool start(const std::vector<std::string>& dirs);
+
+	///Stop the background thread.
+	void stop();
+
+	///Call "listener" whenever a file whose path starts with "prefix" changes (e.g., "res/tavern.png"
+	/// for one file, or "script/" for a directory). Paths are relative to the watched directories.
+	void subscribe(const std::string& prefix, const void* owner, Listener listener);
+
+	///Remove every subscription made by "owner".
+	void unsubscribe(const void* owner);
+
+	///Hand everything that's been (re-)loaded to its listeners. Call between frames.
+	void apply();
+
+private:
+	struct Subscription {
+		std::string prefix;
+		const void* owner;
+		Listener listener;
+	};
+
+	void run();
+	static Asset Load(const std::string& path);
+
+	platform::FileWatcher watcher;
+	boost::thread thread;
+	std::atomic<bool> running;
+
+	boost::mutex readyMutex;
+	std::vector<Asset> ready; //Guarded by readyMutex.
+
+	std::vector<Subscription> subs;
+	std::vector<Subscription> scratchSubs;
+	std::vector<Asset> scratchReady;
+};
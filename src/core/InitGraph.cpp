@@ -0,0 +1,189 @@
+#include "InitGraph.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "core/Profiler.hpp"
+
+
+InitGraph::InitGraph() : numFinished(0), stopping(false)
+{
+}
+
+
+InitGraph::~InitGraph()
+{
+	//Nothing new starts once we're stopping, so the threads we have are all we need to wait for.
+	std::vector<std::unique_ptr<boost::thread>> running;
+	{
+	boost::mutex::scoped_lock lock(mutex);
+	stopping = true;
+	running.swap(threads);
+	}
+	for (auto& thread : running) {
+		thread->join();
+	}
+}
+
+
+void InitGraph::add(const std::string& name, Thread thread, const std::vector<std::string>& after, const std::function<void()>& fn)
+{
+	Task task;
+	task.name = name;
+	task.thread = thread;
+	task.fn = fn;
+	task.waitingOn = after.size();
+	task.state = State::Waiting;
+	for (const std::string& dep : after) {
+		auto it = std::find_if(tasks.begin(), tasks.end(), [&dep](const Task& t) { return t.name==dep; });
+		if (it==tasks.end()) {
+			throw std::runtime_error("Start-up task \"" + name + "\" depends on unknown task: " + dep);
+		}
+		it->next.push_back(tasks.size());
+	}
+	tasks.push_back(task);
+}
+
+
+void InitGraph::start()
+{
+	boost::mutex::scoped_lock lock(mutex);
+	clock.restart();
+	for (size_t i=0; i<tasks.size(); i++) {
+		if (tasks[i].thread==Thread::Any && tasks[i].waitingOn==0) {
+			launch(i);
+		}
+	}
+}
+
+
+void InitGraph::launch(size_t id)
+{
+	if (stopping) { return; }
+	tasks[id].state = State::Running;
+	threads.push_back(std::unique_ptr<boost::thread>(new boost::thread([this, id]() {
+		profiler::setThreadName("startup");
+		run(id);
+	})));
+}
+
+
+void InitGraph::run(size_t id)
+{
+	std::function<void()> fn;
+	{
+	boost::mutex::scoped_lock lock(mutex);
+	tasks[id].state = State::Running;
+	tasks[id].start = clock.getElapsedTime();
+	fn = tasks[id].fn;
+	}
+
+	std::string failure;
+	try {
+		fn();
+	} catch (std::exception& ex) {
+		failure = ex.what();
+	} catch (...) {
+		failure = "unknown error";
+	}
+
+	//Release anything waiting on this task (nothing, if it failed).
+	{
+	boost::mutex::scoped_lock lock(mutex);
+	Task& task = tasks[id];
+	task.end = clock.getElapsedTime();
+	task.state = failure.empty() ? State::Done : State::Failed;
+	if (!failure.empty()) {
+		if (error.empty()) {
+			error = "Start-up task \"" + task.name + "\" failed: " + failure;
+		}
+	} else {
+		numFinished++;
+		for (size_t next : task.next) {
+			if (--tasks[next].waitingOn==0 && tasks[next].thread==Thread::Any) {
+				launch(next);
+			}
+		}
+	}
+	}
+	changed.notify_all();
+}
+
+
+size_t InitGraph::nextMain() const
+{
+	for (size_t i=0; i<tasks.size(); i++) {
+		if (tasks[i].thread==Thread::Main && tasks[i].state==State::Waiting && tasks[i].waitingOn==0) { return i; }
+	}
+	return tasks.size();
+}
+
+
+bool InitGraph::poll()
+{
+	for (;;) {
+		//Run the next main-thread task that's ready (if there is one), or finish up.
+		size_t id = tasks.size();
+		{
+		boost::mutex::scoped_lock lock(mutex);
+		if (!error.empty()) {
+			throw std::runtime_error(error);
+		}
+		if (numFinished==tasks.size()) { return true; }
+		id = nextMain();
+		}
+		if (id==tasks.size()) { return false; }
+
+		run(id);
+	}
+}
+
+
+void InitGraph::wait()
+{
+	while (!poll()) {
+		boost::mutex::scoped_lock lock(mutex);
+		while (error.empty() && numFinished<tasks.size() && nextMain()==tasks.size()) {
+			changed.wait(lock);
+		}
+	}
+}
+
+
+size_t InitGraph::finished() const
+{
+	boost::mutex::scoped_lock lock(mutex);
+	return numFinished;
+}
+
+
+std::vector<std::string> InitGraph::running() const
+{
+	std::vector<std::string> res;
+	boost::mutex::scoped_lock lock(mutex);
+	for (const Task& task : tasks) {
+		if (task.state==State::Running) {
+			res.push_back(task.name);
+		}
+	}
+	return res;
+}
+
+
+std::vector<InitGraph::Timing> InitGraph::timings() const
+{
+	std::vector<Timing> res;
+	{
+	boost::mutex::scoped_lock lock(mutex);
+	for (const Task& task : tasks) {
+		if (task.state==State::Done) {
+			Timing timing = {task.name, task.thread, task.start, task.end};
+			res.push_back(timing);
+		}
+	}
+	}
+	std::stable_sort(res.begin(), res.end(), [](const Timing& a, const Timing& b) {
+		return a.start < b.start;
+	});
+	return res;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include <SFML/System.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+
+/**
+ * The engine's start-up work, as a graph of named tasks. Each task runs as soon as every task it
+ *   depends on has finished. Tasks that can run anywhere each get a thread of their own (start-up
+ *   tasks are few, and coarse); tasks that must run on the main thread (anything touching the window,
+ *   or the AssetManager) are run by poll(), which the engine calls once a frame while it shows a
+ *   loading slice.
+ *
+ * If a task throws, nothing that depends on it runs, and poll() re-throws its error on the main
+ *   thread. Each task's start and end times are kept, for the start-up report (see --bench-startup).
+ *
+ * \note
+ * Like the AssetManager, we use our own threads rather than the JobSystem, so that a start-up task
+ *   never ends up running inside a JobSystem::wait() on the main thread.
+ */
+class InitGraph {
+public:
+	enum class Thread { Main, Any };
+
+	struct Timing {
+		std::string name;
+		Thread thread;
+		sf::Time start; //Since start() was called.
+		sf::Time end;
+	};
+
+	InitGraph();
+
+	///Waits for any tasks that are running (tasks that haven't started yet never will).
+	~InitGraph();
+
+	///Add a task, which will run after each of "after" (which must already have been added).
+	void add(const std::string& name, Thread thread, const std::vector<std::string>& after, const std::function<void()>& fn);
+
+	///Start every task that can run anywhere, and is ready. Call once, after adding every task.
+	void start();
+
+	///Run any main-thread tasks that are ready. Returns true once every task has finished. Throws if a task failed.
+	bool poll();
+
+	///Run everything to completion, blocking the calling (main) thread. Throws if a task failed.
+	void wait();
+
+	///Number of tasks finished, out of size().
+	size_t finished() const;
+	size_t size() const { return tasks.size(); }
+
+	///Names of the tasks running right now.
+	std::vector<std::string> running() const;
+
+	///Time since start().
+	sf::Time elapsed() const { return clock.getElapsedTime(); }
+
+	///Every finished task's timing, in the order they started.
+	std::vector<Timing> timings() const;
+
+private:
+	enum class State { Waiting, Running, Done, Failed };
+
+	struct Task {
+		std::string name;
+		Thread thread;
+		std::function<void()> fn;
+		std::vector<size_t> next; //Tasks that depend on this one.
+		size_t waitingOn;         //Unfinished tasks this one depends on.
+		State state;
+		sf::Time start;
+		sf::Time end;
+	};
+
+	void launch(size_t id); //Call with "mutex" held.
+	void run(size_t id);
+	size_t nextMain() const; //A main-thread task that's ready, or size(). Call with "mutex" held.
+
+	mutable boost::mutex mutex;
+	boost::condition_variable changed;
+	std::vector<Task> tasks; //Guarded by "mutex" once started.
+	std::vector<std::unique_ptr<boost::thread>> threads;
+	size_t numFinished;
+	bool stopping;
+	std::string error;       //The first task to fail, and why.
+	sf::Clock clock;
+};
@@ -0,0 +1,186 @@
+#include "InputLog.hpp"
+
+#include <cstring>
+#include <iostream>
+
+
+namespace {
+const char Magic[4] = {'P', 'I', 'N', 'P'};
+const sf::Uint32 Version = 1;
+
+//Frames buffered before we write (or read) a batch.
+const size_t BatchFrames = 1024;
+
+//Largest possible record.
+const size_t MaxRecordSize = 8 + 16 + 1 + 2*InputLog::MaxEvents;
+
+enum ModBits { Alt=1, Control=2, Shift=4, System=8 };
+
+template <class T>
+void Put(std::string& out, const T& val)
+{
+	out.append(reinterpret_cast<const char*>(&val), sizeof(T));
+}
+
+template <class T>
+bool Get(std::istream& in, T& val)
+{
+	return static_cast<bool>(in.read(reinterpret_cast<char*>(&val), sizeof(T)));
+}
+} //End un-named namespace
+
+
+InputLog::Frame::Frame() : elapsedUs(0), numEvents(0)
+{
+	keys[0] = keys[1] = 0;
+}
+
+bool InputLog::Frame::isKeyPressed(sf::Keyboard::Key key) const
+{
+	if (key<0 || key>=128) { return false; }
+	return (keys[key/64]>>(key%64)) & 1;
+}
+
+void InputLog::Frame::setKey(sf::Keyboard::Key key, bool pressed)
+{
+	if (key<0 || key>=128) { return; }
+	sf::Uint64 bit = sf::Uint64(1)<<(key%64);
+	keys[key/64] = pressed ? (keys[key/64]|bit) : (keys[key/64]&~bit);
+}
+
+void InputLog::Frame::addEvent(const sf::Event::KeyEvent& key)
+{
+	if (numEvents<MaxEvents) {
+		events[numEvents++] = key;
+	}
+}
+
+
+InputLog::InputLog() : mode(Mode::Off), frames(BatchFrames)
+{
+	scratch.reserve(BatchFrames*MaxRecordSize);
+}
+
+InputLog::~InputLog()
+{
+	finish();
+}
+
+
+bool InputLog::startRecording(const std::string& file)
+{
+	finish();
+	this->file.open(file, std::ios::out|std::ios::binary|std::ios::trunc);
+	if (!this->file.is_open()) { return false; }
+
+	this->file.write(Magic, sizeof(Magic));
+	this->file.write(reinterpret_cast<const char*>(&Version), sizeof(Version));
+	mode = Mode::Record;
+	return true;
+}
+
+
+bool InputLog::startReplay(const std::string& file)
+{
+	finish();
+	this->file.open(file, std::ios::in|std::ios::binary);
+	if (!this->file.is_open()) { return false; }
+
+	char magic[4];
+	sf::Uint32 version = 0;
+	this->file.read(magic, sizeof(magic));
+	Get(this->file, version);
+	if (!this->file || std::memcmp(magic, Magic, sizeof(Magic))!=0 || version!=Version) {
+		std::cout <<"Warn: not a valid input log: " <<file <<"\n";
+		this->file.close();
+		return false;
+	}
+
+	mode = Mode::Replay;
+	return true;
+}
+
+
+void InputLog::record(const Frame& frame)
+{
+	if (mode!=Mode::Record) { return; }
+	if (frames.full()) {
+		flush();
+	}
+	frames.push_back(frame);
+}
+
+
+bool InputLog::replay(Frame& frame)
+{
+	if (mode!=Mode::Replay) { return false; }
+	if (frames.empty()) {
+		refill();
+		if (frames.empty()) { return false; }
+	}
+	frame = frames.front();
+	frames.pop_front();
+	return true;
+}
+
+
+void InputLog::finish()
+{
+	if (mode==Mode::Record) {
+		flush();
+	}
+	if (file.is_open()) {
+		file.close();
+	}
+	frames.clear();
+	mode = Mode::Off;
+}
+
+
+void InputLog::flush()
+{
+	//Serialize into our (pre-reserved) buffer, then write it all at once.
+	scratch.clear();
+	for (size_t i=0; i<frames.size(); i++) {
+		const Frame& fr = frames[i];
+		Put(scratch, fr.elapsedUs);
+		Put(scratch, fr.keys[0]);
+		Put(scratch, fr.keys[1]);
+		Put(scratch, static_cast<sf::Uint8>(fr.numEvents));
+		for (unsigned int ev=0; ev<fr.numEvents; ev++) {
+			const sf::Event::KeyEvent& key = fr.events[ev];
+			sf::Uint8 mods = (key.alt?Alt:0) | (key.control?Control:0) | (key.shift?Shift:0) | (key.system?System:0);
+			Put(scratch, static_cast<sf::Int8>(key.code));
+			Put(scratch, mods);
+		}
+	}
+	file.write(scratch.data(), scratch.size());
+	file.flush();
+	frames.clear();
+}
+
+
+void InputLog::refill()
+{
+	while (!frames.full()) {
+		Frame fr;
+		sf::Uint8 count = 0;
+		if (!(Get(file, fr.elapsedUs) && Get(file, fr.keys[0]) && Get(file, fr.keys[1]) && Get(file, count))) {
+			return;
+		}
+		for (unsigned int ev=0; ev<count; ev++) {
+			sf::Int8 code = 0;
+			sf::Uint8 mods = 0;
+			if (!(Get(file, code) && Get(file, mods))) { return; }
+
+			sf::Event::KeyEvent key;
+			key.code = static_cast<sf::Keyboard::Key>(code);
+			key.alt = mods&Alt;
+			key.control = mods&Control;
+			key.shift = mods&Shift;
+			key.system = mods&System;
+			fr.addEvent(key);
+		}
+		frames.push_back(fr);
+	}
+}
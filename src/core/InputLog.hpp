@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+
+#include <SFML/Window.hpp>
+
+#include "util/RingBuffer.hpp"
+
+
+/**
+ * Records everything the game loop consumes from the outside world (typed keys, which keys are
+ *   held down, and each frame's elapsed time) to a compact binary log, and plays it back.
+ *
+ * Replaying a log re-runs a session exactly, which makes real play sessions usable as repeatable
+ *   performance benchmarks. Frames are buffered in a pre-allocated ring and written (or read) in
+ *   batches, so nothing is allocated per frame.
+ *
+ * File format (host byte order): "PINP", uint32 version, then one record per frame:
+ *   int64 elapsed (microseconds), uint64[2] held-key bitmask, uint8 event count, and then
+ *   two bytes per typed key (int8 key code, so that sf::Keyboard::Unknown is kept as -1; modifier bits).
+ */
+class InputLog {
+public:
+	///How many typed keys we keep per frame; any more are dropped.
+	static const unsigned int MaxEvents = 32;
+
+	///Everything the game loop reads from the user in one frame.
+	struct Frame {
+		sf::Int64 elapsedUs;
+		sf::Uint64 keys[2];
+		unsigned int numEvents;
+		sf::Event::KeyEvent events[MaxEvents];
+
+		Frame();
+
+		bool isKeyPressed(sf::Keyboard::Key key) const;
+		void setKey(sf::Keyboard::Key key, bool pressed);
+		void addEvent(const sf::Event::KeyEvent& key);
+	};
+
+	enum class Mode { Off, Record, Replay };
+
+	InputLog();
+	~InputLog();
+
+	Mode getMode() const { return mode; }
+
+	///Start writing frames to "file". Returns false if the file can't be opened.
+	bool startRecording(const std::string& file);
+
+	///Start reading frames from "file". Returns false if the file can't be opened (or is invalid).
+	bool startReplay(const std::string& file);
+
+	///Record a frame (in Record mode).
+	void record(const Frame& frame);
+
+	///Get the next frame (in Replay mode). Returns false once the log is exhausted.
+	bool replay(Frame& frame);
+
+	///Flush and close the log.
+	void finish();
+
+private:
+	void flush();  //Write everything in "frames".
+	void refill(); //Read another batch into "frames".
+
+	Mode mode;
+	std::fstream file;
+	RingBuffer<Frame> frames;
+	std::string scratch; //Serialization buffer; reserved once.
+};
@@ -0,0 +1,232 @@
+#include "JobSystem.hpp"
+
+#include <sstream>
+#include <stdexcept>
+
+#include "core/Profiler.hpp"
+
+
+namespace {
+//Which JobSystem (if any) the current thread belongs to, and its index there.
+thread_local const JobSystem* currSystem = nullptr;
+thread_local unsigned int currIndex = 0;
+
+//No parallel_for() should be split into more pieces than this; it would risk wrapping the task ring.
+const size_t MaxPieces = JobSystem::MaxTasksPerThread/4;
+} //End un-named namespace
+
+
+JobSystem::ThreadData::ThreadData() : taskRing(new Task[MaxTasksPerThread]), nextTask(0)
+{
+}
+
+
+JobSystem::JobSystem(int numWorkers) : queued(0), running(true)
+{
+	if (numWorkers<0) {
+		unsigned int hw = boost::thread::hardware_concurrency();
+		numWorkers = hw>1 ? hw-1 : 0;
+	}
+
+	//The calling thread is thread 0.
+	for (int i=0; i<numWorkers+1; i++) {
+		threads.push_back(std::unique_ptr<ThreadData>(new ThreadData()));
+	}
+	currSystem = this;
+	currIndex = 0;
+
+	//Start our workers last, once everything is allocated.
+	for (int i=1; i<numWorkers+1; i++) {
+		workers.push_back(std::unique_ptr<boost::thread>(new boost::thread(&JobSystem::workerLoop, this, i)));
+	}
+}
+
+
+JobSystem::~JobSystem()
+{
+	//Wake everyone up and let them exit.
+	{
+	boost::mutex::scoped_lock lock(sleepMutex);
+	running = false;
+	}
+	wakeUp.notify_all();
+	for (auto& worker : workers) {
+		worker->join();
+	}
+
+	if (currSystem==this) {
+		currSystem = nullptr;
+	}
+}
+
+
+unsigned int JobSystem::threadCount() const
+{
+	return threads.size();
+}
+
+
+unsigned int JobSystem::currThreadIndex() const
+{
+	if (currSystem!=this) { throw std::runtime_error("JobSystem used from a thread it doesn't own."); }
+	return currIndex;
+}
+
+
+JobSystem::Task* JobSystem::create(const std::function<void()>& fn, Task* parent)
+{
+	ThreadData& td = *threads[currThreadIndex()];
+	Task* task = &td.taskRing[td.nextTask % MaxTasksPerThread];
+	if (task->unfinished.load()!=0) {
+		throw std::runtime_error("JobSystem task ring wrapped: too many tasks in flight on one thread.");
+	}
+	td.nextTask++;
+	task->fn = fn;
+	task->parent = parent;
+	task->unfinished = 1;
+	if (parent) {
+		parent->unfinished++;
+	}
+	return task;
+}
+
+
+void JobSystem::run(Task* task)
+{
+	ThreadData& td = *threads[currThreadIndex()];
+	{
+	boost::mutex::scoped_lock lock(td.mutex);
+	td.tasks.push_back(task);
+	}
+
+	//Wake a sleeping worker. Taking the lock avoids losing the wake-up to a worker about to sleep.
+	queued++;
+	{
+	boost::mutex::scoped_lock lock(sleepMutex);
+	}
+	wakeUp.notify_one();
+}
+
+
+bool JobSystem::finished(const Task* task) const
+{
+	return task->unfinished.load()==0;
+}
+
+
+void JobSystem::wait(const Task* task)
+{
+	unsigned int index = currThreadIndex();
+	while (!finished(task)) {
+		Task* next = getTask(index);
+		if (next) {
+			execute(next);
+		} else {
+			boost::this_thread::yield();
+		}
+	}
+}
+
+
+void JobSystem::parallel_for(size_t begin, size_t end, size_t grain, const std::function<void (size_t, size_t)>& fn)
+{
+	if (begin>=end) { return; }
+
+	//Figure out our pieces.
+	size_t count = end - begin;
+	grain = std::max<size_t>(grain, 1);
+	grain = std::max(grain, (count+MaxPieces-1)/MaxPieces);
+
+	//A single piece is just a function call.
+	if (count<=grain) {
+		fn(begin, end);
+		return;
+	}
+
+	//Else, spawn a child for each piece and wait on the parent.
+	PROFILE_SCOPE("JobSystem::parallel_for");
+	Task* root = create(std::function<void()>(), nullptr);
+	for (size_t first=begin; first<end; first+=grain) {
+		size_t last = std::min(end, first+grain);
+		run(create([&fn, first, last]() { fn(first, last); }, root));
+	}
+	run(root);
+	wait(root);
+}
+
+
+JobSystem::Task* JobSystem::getTask(unsigned int index)
+{
+	//Our own work first (newest first).
+	{
+	ThreadData& td = *threads[index];
+	boost::mutex::scoped_lock lock(td.mutex);
+	if (!td.tasks.empty()) {
+		Task* res = td.tasks.back();
+		td.tasks.pop_back();
+		queued--;
+		return res;
+	}
+	}
+
+	//Steal (oldest first), starting from our neighbor so that thieves spread out.
+	for (size_t i=1; i<threads.size(); i++) {
+		ThreadData& td = *threads[(index+i)%threads.size()];
+		boost::mutex::scoped_lock lock(td.mutex);
+		if (!td.tasks.empty()) {
+			Task* res = td.tasks.front();
+			td.tasks.pop_front();
+			queued--;
+			return res;
+		}
+	}
+
+	return nullptr;
+}
+
+
+void JobSystem::execute(Task* task)
+{
+	if (task->fn) {
+		PROFILE_SCOPE("JobSystem::task");
+		task->fn();
+	}
+	finish(task);
+}
+
+
+void JobSystem::finish(Task* task)
+{
+	//Propagate up to our parent once we (and all our children) are done.
+	//Read the parent first: once we hit zero, our slot may be recycled.
+	Task* parent = task->parent;
+	if (--task->unfinished==0 && parent) {
+		finish(parent);
+	}
+}
+
+
+void JobSystem::workerLoop(unsigned int index)
+{
+	currSystem = this;
+	currIndex = index;
+	{
+	std::stringstream name;
+	name <<"worker " <<index;
+	profiler::setThreadName(name.str());
+	}
+
+	while (running) {
+		Task* task = getTask(index);
+		if (task) {
+			execute(task);
+			continue;
+		}
+
+		//Nothing to do; sleep until something is queued.
+		boost::mutex::scoped_lock lock(sleepMutex);
+		while (running && queued.load()<=0) {
+			wakeUp.wait(lock);
+		}
+	}
+}
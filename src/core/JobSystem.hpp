@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <algorithm>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+
+/**
+ * A work-stealing task scheduler.
+ *
+ * Each thread (the workers, plus the thread which created the JobSystem) has its own deque of
+ *   tasks. A thread pushes and pops its own tasks at the back (so recently-spawned, cache-warm tasks
+ *   run first), and steals from the front of other threads' deques when it runs out of work.
+ *
+ * Tasks may have a parent; a task is only "finished" once it and all of its children have finished.
+ *   So, to wait for a batch of work, create a parent task, create the batch as its children, run
+ *   them all and wait() on the parent. wait() runs other tasks while it waits (it never just blocks).
+ *
+ * Tasks are allocated from a per-thread ring of MaxTasksPerThread entries, which are recycled
+ *   once the ring wraps around. So, a single thread should never have more than that many tasks in
+ *   flight at once (create() throws if the slot it would recycle hasn't finished).
+ *
+ * Only the thread which created the JobSystem, and the JobSystem's own workers, may create or run tasks.
+ *
+ * \note
+ * We use a mutex per deque, rather than a lock-free deque. Each lock is held only for a push or pop,
+ *   and tasks are expected to be reasonably coarse (see the "grain" of parallel_for()).
+ */
+class JobSystem {
+public:
+	struct Task;
+
+	///Tasks in flight (per thread) before the task ring wraps around.
+	static const size_t MaxTasksPerThread = 4096;
+
+	///Create a JobSystem with "numWorkers" background threads (-1 means one fewer than the number
+	/// of hardware threads). The calling thread is always an additional participant, so zero
+	/// workers is valid (everything runs on the calling thread, inside wait()).
+	explicit JobSystem(int numWorkers=-1);
+	~JobSystem();
+
+	///Number of threads that can run tasks (workers, plus the creating thread).
+	unsigned int threadCount() const;
+
+	///Create a task which will call "fn". If "parent" is given, the parent won't be finished until
+	/// this task is. Nothing happens until the task is passed to run(). Throws if the calling thread
+	/// already has MaxTasksPerThread tasks in flight.
+	Task* create(const std::function<void()>& fn, Task* parent=nullptr);
+
+	///Schedule a task to be run (on any thread).
+	void run(Task* task);
+
+	///Has this task (and all of its children) finished?
+	bool finished(const Task* task) const;
+
+	///Run other tasks until this one has finished.
+	void wait(const Task* task);
+
+	///Call fn(first, last) for sub-ranges of [begin, end) of at least "grain" items, in parallel,
+	/// and wait for all of them to finish.
+	void parallel_for(size_t begin, size_t end, size_t grain, const std::function<void (size_t, size_t)>& fn);
+
+private:
+	///Per-thread data: its deque, and its ring of tasks.
+	struct ThreadData {
+		ThreadData();
+
+		boost::mutex mutex;
+		std::deque<Task*> tasks;
+
+		std::unique_ptr<Task[]> taskRing;
+		size_t nextTask;
+	};
+
+	void workerLoop(unsigned int index);
+
+	//Get a task to run: our own (newest first), or someone else's (oldest first).
+	Task* getTask(unsigned int index);
+	void execute(Task* task);
+	void finish(Task* task);
+
+	//The calling thread's index into "threads". Throws if the calling thread doesn't belong to us.
+	unsigned int currThreadIndex() const;
+
+	std::vector<std::unique_ptr<ThreadData>> threads; //0 is the creating thread.
+	std::vector<std::unique_ptr<boost::thread>> workers;
+
+	//Idle workers sleep until there's something queued.
+	std::atomic<int> queued;
+	std::atomic<bool> running;
+	boost::mutex sleepMutex;
+	boost::condition_variable wakeUp;
+};
+
+
+struct JobSystem::Task {
+	Task() : parent(nullptr), unfinished(0) {}
+
+	std::function<void()> fn;
+	Task* parent;
+	std::atomic<int> unfinished; //This task, plus its unfinished children.
+};
+
@@ -2,11 +2,17 @@
 
 #include "core/GameEngine.hpp"
 #include "slices/WalkableMapSlice.hpp"
+#include "core/AllocTracker.hpp"
+#include "core/EntityBatch.hpp"
 
 extern "C" {
 	#include <lualib.h>
+	#include <lauxlib.h>
 }
 
+#include <cstdlib>
+#include <iostream>
+
 #include <luabind/luabind.hpp>
 
 using namespace luabind;
@@ -16,14 +22,32 @@ int get_num_args(int n1, int n2, int n3, int n4);
 GameEngine* get_game_engine();
 
 
-lua_State* NewLuaState()
+namespace {
+//Same as luaL_newstate()'s panic function.
+int LuaPanic(lua_State* L)
 {
-	//Lua state.
-	lua_State* L = luaL_newstate();
+	std::cout <<"PANIC: unprotected error in call to Lua API (" <<lua_tostring(L, -1) <<")\n";
+	return 0;
+}
+} //End un-named namespace
+
+
+lua_State* NewLuaState(LuaPool& pool)
+{
+	ALLOC_SCOPE(alloc::Subsystem::Lua);
+
+	//Lua state, allocating from our pool.
+	lua_State* L = lua_newstate(LuaPool::Alloc, &pool);
+	if (L) {
+		lua_atpanic(L, LuaPanic);
+	}
 
 	//Bind normal Lua API calls.
 	luaL_openlibs(L);
 
+	//Typed buffers, for batch (per-kind) NPC handlers.
+	EntityBatch::RegisterLua(L);
+
 	//Connect luabind to our lua state.
 	luabind::open(L);
 
@@ -40,6 +64,7 @@ lua_State* NewLuaState()
 
 			class_<WalkableMapSlice>("WalkableMapSlice")
 				.def("modify", &WalkableMapSlice::changeBgColor)
+				.def("tile_at", &WalkableMapSlice::tileAt)
 		]
 	];
 
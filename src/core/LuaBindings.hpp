@@ -4,5 +4,7 @@ extern "C" {
 	#include "lua.h"
 }
 
-///Register all game-related Lua functions.
-lua_State* NewLuaState();
+#include "core/LuaPool.hpp"
+
+///Create a Lua state which allocates from "pool" (which must outlive it), and register all game-related Lua functions.
+lua_State* NewLuaState(LuaPool& pool);
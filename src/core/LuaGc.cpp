@@ -0,0 +1,56 @@
+#include "LuaGc.hpp"
+
+#include <algorithm>
+
+
+LuaGc::LuaGc(lua_State* L, const Policy& policy) : L(L), heapAfterCycle(0), inCycle(false)
+{
+	setPolicy(policy);
+	heapAfterCycle = heapBytes();
+}
+
+
+void LuaGc::setPolicy(const Policy& policy)
+{
+	this->policy = policy;
+	lua_gc(L, LUA_GCSETPAUSE, policy.pause);
+	lua_gc(L, LUA_GCSETSTEPMUL, policy.stepmul);
+	lua_gc(L, policy.manual ? LUA_GCSTOP : LUA_GCRESTART, 0);
+}
+
+
+size_t LuaGc::heapBytes() const
+{
+	return static_cast<size_t>(lua_gc(L, LUA_GCCOUNT, 0))*1024 + lua_gc(L, LUA_GCCOUNTB, 0);
+}
+
+
+sf::Time LuaGc::step(const sf::Time& slack)
+{
+	if (!policy.manual) { return sf::Time::Zero; }
+
+	//Is a cycle due (or already under way)?
+	size_t heap = heapBytes();
+	size_t threshold = std::max<size_t>(heapAfterCycle, 64*1024) / 100 * policy.pause;
+	if (!inCycle && heap<threshold) { return sf::Time::Zero; }
+
+	//No time to spare? Only step if we're falling well behind.
+	bool behind = heap>=threshold*2;
+	if (slack<=sf::Time::Zero && !behind) { return sf::Time::Zero; }
+
+	sf::Clock clock;
+	do {
+		inCycle = true;
+		if (lua_gc(L, LUA_GCSTEP, policy.stepKb)) {
+			//Finished a cycle; wait for the heap to grow again.
+			inCycle = false;
+			heapAfterCycle = heapBytes();
+			break;
+		}
+	} while (clock.getElapsedTime()<slack);
+
+	//In Lua 5.1, stepping re-arms the automatic collector; stop it again.
+	lua_gc(L, LUA_GCSTOP, 0);
+
+	return clock.getElapsedTime();
+}
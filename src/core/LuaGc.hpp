@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+
+#include <SFML/System.hpp>
+
+extern "C" {
+	#include "lua.h"
+}
+
+
+/**
+ * Drives a Lua state's incremental garbage collector from the engine, instead of letting it run
+ *   whenever Lua happens to allocate (often in the middle of a frame).
+ *
+ * In manual mode, the collector is stopped and step() runs LUA_GCSTEPs in whatever time is left
+ *   over at the end of a frame. As with Lua's own policy, a new cycle is only started once the heap
+ *   has grown to "pause" percent of its size after the last cycle, and "stepmul" sets how much work
+ *   each step does. If there's no slack at all and the heap keeps growing (to twice that threshold),
+ *   we step anyway, so memory stays bounded.
+ * In automatic mode, we just pass pause/stepmul on to Lua and let it collect as usual.
+ */
+class LuaGc {
+public:
+	struct Policy {
+		bool manual;
+		int pause;        //Percent; see LUA_GCSETPAUSE.
+		int stepmul;      //Percent; see LUA_GCSETSTEPMUL.
+		int stepKb;       //Size of each LUA_GCSTEP.
+		Policy() : manual(true), pause(200), stepmul(200), stepKb(16) {}
+	};
+
+	explicit LuaGc(lua_State* L, const Policy& policy=Policy());
+
+	void setPolicy(const Policy& policy);
+	const Policy& getPolicy() const { return policy; }
+
+	///Collect for (up to) "slack". Returns the time spent.
+	sf::Time step(const sf::Time& slack);
+
+	///Current size of the Lua heap.
+	size_t heapBytes() const;
+
+private:
+	lua_State* L;
+	Policy policy;
+	size_t heapAfterCycle; //Heap size at the end of the last full cycle.
+	bool inCycle;
+};
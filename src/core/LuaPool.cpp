@@ -0,0 +1,125 @@
+#include "LuaPool.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+
+LuaPool::LuaPool(alloc::Subsystem subsystem) : inUse(0), subsystem(subsystem)
+{
+	std::fill(freeLists, freeLists+NumClasses, nullptr);
+}
+
+
+LuaPool::~LuaPool()
+{
+	for (char* page : pages) {
+		std::free(page);
+	}
+}
+
+
+void* LuaPool::Alloc(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+	LuaPool* pool = static_cast<LuaPool*>(ud);
+
+	//Lua passes the old size of "ptr" (if ptr isn't null), so we always know which class it's in.
+	if (!ptr) { osize = 0; }
+
+	//Free.
+	if (nsize==0) {
+		if (ptr) {
+			pool->free(ptr, osize);
+		}
+		return nullptr;
+	}
+
+	//Staying in the same size class (or shrinking within malloc) doesn't move anything.
+	if (ptr) {
+		bool oldPooled = osize<=MaxPooled;
+		bool newPooled = nsize<=MaxPooled;
+		if (oldPooled && newPooled && ClassOf(osize)==ClassOf(nsize)) {
+			alloc::noteFree(pool->subsystem, osize);
+			alloc::noteAlloc(pool->subsystem, nsize);
+			pool->inUse += nsize;
+			pool->inUse -= osize;
+			return ptr;
+		}
+		if (!oldPooled && !newPooled) {
+			void* res = std::realloc(ptr, nsize);
+			if (res) {
+				alloc::noteFree(pool->subsystem, osize);
+				alloc::noteAlloc(pool->subsystem, nsize);
+				pool->inUse += nsize;
+				pool->inUse -= osize;
+			}
+			return res;
+		}
+	}
+
+	//Otherwise, allocate, copy, and free.
+	void* res = pool->allocate(nsize);
+	if (res && ptr) {
+		std::memcpy(res, ptr, std::min(osize, nsize));
+		pool->free(ptr, osize);
+	}
+	return res;
+}
+
+
+void* LuaPool::allocate(size_t bytes)
+{
+	void* res = nullptr;
+	if (bytes>MaxPooled) {
+		res = std::malloc(bytes);
+	} else {
+		size_t sizeClass = ClassOf(bytes);
+		if (!freeLists[sizeClass]) {
+			refill(sizeClass);
+		}
+		FreeBlock* block = freeLists[sizeClass];
+		if (block) {
+			freeLists[sizeClass] = block->next;
+			res = block;
+		}
+	}
+
+	if (res) {
+		inUse += bytes;
+		alloc::noteAlloc(subsystem, bytes);
+	}
+	return res;
+}
+
+
+void LuaPool::free(void* ptr, size_t bytes)
+{
+	inUse -= bytes;
+	alloc::noteFree(subsystem, bytes);
+
+	if (bytes>MaxPooled) {
+		std::free(ptr);
+		return;
+	}
+
+	FreeBlock* block = static_cast<FreeBlock*>(ptr);
+	size_t sizeClass = ClassOf(bytes);
+	block->next = freeLists[sizeClass];
+	freeLists[sizeClass] = block;
+}
+
+
+void LuaPool::refill(size_t sizeClass)
+{
+	char* page = static_cast<char*>(std::malloc(PageSize));
+	if (!page) { return; }
+	pages.push_back(page);
+
+	//Thread the whole page onto the free list.
+	size_t blockSize = (sizeClass+1)*Granularity;
+	for (size_t offset=0; offset+blockSize<=PageSize; offset+=blockSize) {
+		FreeBlock* block = reinterpret_cast<FreeBlock*>(page+offset);
+		block->next = freeLists[sizeClass];
+		freeLists[sizeClass] = block;
+	}
+}
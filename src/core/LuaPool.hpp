@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "core/AllocTracker.hpp"
+
+
+/**
+ * A lua_Alloc backed by size-class pools. Most of what Lua allocates (strings, tables, closures,
+ *   upvalues) is small and short-lived, so blocks up to MaxPooled bytes come from free lists carved
+ *   out of large pages, and only bigger blocks go to malloc. Pages are never returned until the pool
+ *   is destroyed, which must happen after lua_close().
+ *
+ * A pool belongs to one Lua state (and, like the state, must only be used by one thread at a time).
+ *   All allocations are reported to the AllocTracker under the given subsystem.
+ */
+class LuaPool {
+public:
+	explicit LuaPool(alloc::Subsystem subsystem=alloc::Subsystem::Lua);
+	~LuaPool();
+
+	///The lua_Alloc function. Pass the pool as "ud": lua_newstate(LuaPool::Alloc, &pool).
+	static void* Alloc(void* ud, void* ptr, size_t osize, size_t nsize);
+
+	///Bytes Lua has allocated (and not freed), pooled or not.
+	size_t bytesInUse() const { return inUse; }
+
+	///Bytes reserved for pages (pooled blocks, used or free).
+	size_t bytesReserved() const { return pages.size()*PageSize; }
+
+	static const size_t MaxPooled = 256;
+	static const size_t PageSize = 64*1024;
+
+private:
+	//Blocks are rounded up to a multiple of this, so there are MaxPooled/Granularity classes.
+	static const size_t Granularity = 16;
+	static const size_t NumClasses = MaxPooled/Granularity;
+
+	struct FreeBlock {
+		FreeBlock* next;
+	};
+
+	static size_t ClassOf(size_t bytes) { return (bytes-1)/Granularity; }
+
+	void* allocate(size_t bytes);
+	void free(void* ptr, size_t bytes);
+	void refill(size_t sizeClass);
+
+	FreeBlock* freeLists[NumClasses];
+	std::vector<char*> pages;
+	size_t inUse;
+	alloc::Subsystem subsystem;
+};
@@ -0,0 +1,246 @@
+#include "LuaScript.hpp"
+
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <thread>
+#include <functional>
+
+#include <boost/filesystem.hpp>
+
+extern "C" {
+	#include "lauxlib.h"
+}
+
+#include "util/Hash.hpp"
+#include "core/ScriptMonitor.hpp"
+#include "pack/AssetPack.hpp"
+#include "platform/MappedFile.hpp"
+
+
+namespace {
+//Where to cache bytecode (empty means "don't").
+std::string cacheDir;
+
+///Stored at the start of each cache file.
+struct CacheHeader {
+	char magic[4];
+	uint32_t luaVersion;
+	uint64_t sourceHash;
+	uint64_t bytecodeSize;
+};
+const char CacheMagic[4] = {'P', 'L', 'B', 'C'};
+
+//lua_dump() writer: append to a std::string.
+int DumpToString(lua_State* L, const void* p, size_t sz, void* ud)
+{
+	static_cast<std::string*>(ud)->append(static_cast<const char*>(p), sz);
+	return 0;
+}
+
+///Hash everything that affects the compiled result: the code itself, its name, and the Lua release.
+uint64_t HashChunk(const std::string& code, const std::string& chunkName)
+{
+	uint64_t res = hash::Fnv1a(LUA_RELEASE);
+	res = hash::Fnv1a(chunkName, res);
+	return hash::Fnv1a(code, res);
+}
+
+std::string CachePath(uint64_t sourceHash)
+{
+	return cacheDir + "/" + hash::ToHex(sourceHash) + ".luac";
+}
+
+///Try to load a cached chunk. On success, pushes the function and returns true.
+bool LoadCached(lua_State* L, uint64_t sourceHash, const std::string& name)
+{
+	std::ifstream in(CachePath(sourceHash).c_str(), std::ios::binary);
+	if (!in) { return false; }
+
+	//Stale or corrupt?
+	CacheHeader head;
+	if (!in.read(reinterpret_cast<char*>(&head), sizeof(head))) { return false; }
+	if (!std::equal(CacheMagic, CacheMagic+4, head.magic) || head.luaVersion!=LUA_VERSION_NUM || head.sourceHash!=sourceHash) {
+		return false;
+	}
+
+	std::vector<char> bytecode(head.bytecodeSize);
+	if (bytecode.empty() || !in.read(&bytecode[0], bytecode.size())) { return false; }
+
+	//Lua checks the rest (e.g., word size and number format) itself.
+	if (luaL_loadbuffer(L, &bytecode[0], bytecode.size(), name.c_str())!=0) {
+		lua_pop(L, 1);
+		return false;
+	}
+	return true;
+}
+
+///Save the function on top of the stack to the cache. Failures are harmless; we just warn.
+void SaveCached(lua_State* L, uint64_t sourceHash)
+{
+	std::string bytecode;
+	if (lua_dump(L, DumpToString, &bytecode)!=0 || bytecode.empty()) {
+		std::cout <<"Warn: Can't dump Lua bytecode.\n";
+		return;
+	}
+
+	boost::system::error_code err;
+	boost::filesystem::create_directories(cacheDir, err);
+
+	CacheHeader head;
+	std::copy(CacheMagic, CacheMagic+4, head.magic);
+	head.luaVersion = LUA_VERSION_NUM;
+	head.sourceHash = sourceHash;
+	head.bytecodeSize = bytecode.size();
+
+	//Write to a temporary file and rename it, so that a crash (or a second copy of the game) can't leave half an entry.
+	//The temporary name is per-thread, since script domains may compile the same chunk at once.
+	std::string path = CachePath(sourceHash);
+	std::string tempPath = path + "." + hash::ToHex(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+	{
+	std::ofstream out(tempPath.c_str(), std::ios::binary|std::ios::trunc);
+	out.write(reinterpret_cast<const char*>(&head), sizeof(head));
+	out.write(bytecode.data(), bytecode.size());
+	if (!out) {
+		std::cout <<"Warn: Can't write Lua bytecode cache: " <<tempPath <<"\n";
+		return;
+	}
+	}
+	if (std::rename(tempPath.c_str(), path.c_str())!=0) {
+		std::remove(tempPath.c_str());
+	}
+}
+
+///Compile "code" (or load it from the cache), and leave the function on the stack. Returns false on error (also left on the stack).
+bool LoadChunk(lua_State* L, const std::string& code, const std::string& chunkName)
+{
+	std::string name = "=" + chunkName;
+	uint64_t sourceHash = 0;
+	if (!cacheDir.empty()) {
+		sourceHash = HashChunk(code, name);
+		if (LoadCached(L, sourceHash, name)) {
+			return true;
+		}
+	}
+
+	if (luaL_loadbuffer(L, code.c_str(), code.size(), name.c_str())!=0) {
+		return false;
+	}
+
+	if (!cacheDir.empty()) {
+		SaveCached(L, sourceHash);
+	}
+	return true;
+}
+} //End un-named namespace
+
+
+void lua::SetBytecodeCache(const std::string& dir)
+{
+	cacheDir = dir;
+}
+
+
+int lua::CompileChunk(lua_State* L, const std::string& source, const std::string& chunkName, const std::string& params)
+{
+	//Parameters arrive as varargs; name them on the first line (so that line numbers don't change).
+	std::string code = source;
+	if (!params.empty()) {
+		code = "local " + params + " = ...; " + source;
+	}
+
+	if (!LoadChunk(L, code, chunkName)) {
+		std::cout <<"Error compiling lua code: ##{" <<source <<"}##\n";
+		std::cout <<"Error is: \"" <<lua_tostring(L, -1) <<"\"\n";
+		lua_pop(L, 1);
+		return LUA_NOREF;
+	}
+
+	return RefTop(L);
+}
+
+
+int lua::RefTop(lua_State* L)
+{
+	return luaL_ref(L, LUA_REGISTRYINDEX);
+}
+
+
+void lua::Unref(lua_State* L, int ref)
+{
+	if (ref!=LUA_NOREF && ref!=LUA_REFNIL) {
+		luaL_unref(L, LUA_REGISTRYINDEX, ref);
+	}
+}
+
+
+bool lua::CallChunk(lua_State* L, int ref, int nargs, const std::string& chunkName)
+{
+	//Slide the function under its arguments.
+	lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+	lua_insert(L, -(nargs+1));
+
+	ScriptMonitor::Watch watch(L, chunkName.c_str());
+	if (lua_pcall(L, nargs, 0, 0)!=0) {
+		std::cout <<"Error running lua code: " <<chunkName <<"\n";
+		std::cout <<"Error is: \"" <<lua_tostring(L, -1) <<"\"\n";
+		lua_pop(L, 1);
+		return false;
+	}
+	return true;
+}
+
+
+bool lua::RunSource(lua_State* L, const std::string& code, const std::string& chunkName)
+{
+	ScriptMonitor::Watch watch(L, chunkName.c_str());
+	if (!LoadChunk(L, code, chunkName) || lua_pcall(L, 0, 0, 0)!=0) {
+		std::cout <<"Error running lua code: " <<chunkName <<"\n";
+		std::cout <<"Error is: \"" <<lua_tostring(L, -1) <<"\"\n";
+		lua_pop(L, 1);
+		return false;
+	}
+	return true;
+}
+
+
+bool lua::RunFile(lua_State* L, const std::string& path)
+{
+	platform::MappedFile file;
+	if (!file.open(path)) {
+		std::cout <<"Error: can't open lua file: " <<path <<"\n";
+		return false;
+	}
+	return RunSource(L, std::string(file.data(), file.size()), path);
+}
+
+
+int lua::RunDirectory(lua_State* L, const std::string& dir)
+{
+	namespace fs = boost::filesystem;
+
+	//Sort, so that load order doesn't depend on the file system.
+	//Packed scripts run along with any loose ones (each only once).
+	std::vector<std::string> files;
+	pack::List(dir, files);
+	files.erase(std::remove_if(files.begin(), files.end(), [](const std::string& file) {
+		return fs::path(file).extension()!=".lua";
+	}), files.end());
+	boost::system::error_code err;
+	for (fs::directory_iterator it(dir, err), end; !err && it!=end; it.increment(err)) {
+		if (fs::is_regular_file(it->status()) && it->path().extension()==".lua") {
+			files.push_back(it->path().string());
+		}
+	}
+	std::sort(files.begin(), files.end());
+	files.erase(std::unique(files.begin(), files.end()), files.end());
+
+	int failed = 0;
+	for (const std::string& file : files) {
+		if (!RunFile(L, file)) { failed++; }
+	}
+	return failed;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+
+extern "C" {
+	#include "lua.h"
+}
+
+
+/**
+ * Helpers for running Lua code repeatedly without re-compiling it.
+ *
+ * A chunk is compiled once (with luaL_loadbuffer) and the resulting function is kept in the Lua
+ *   registry; callers hold on to the registry reference and call it with lua_pcall. Chunks compiled
+ *   here take their parameters as varargs, so a handler with parameters ("this", "elapsed") sees
+ *   them as locals rather than as globals that have to be re-set before every call.
+ *
+ * If a bytecode cache is set (see SetBytecodeCache()), compiled chunks are also saved to disk with
+ *   lua_dump, named by a hash of their source, and later runs load the bytecode instead of parsing
+ *   the source again. Each cache file records the Lua version and the full source hash; a mismatch
+ *   (or bytecode Lua refuses to load) just means we compile from source and overwrite the entry.
+ */
+namespace lua {
+
+///Cache compiled chunks in "dir" (created if needed). An empty string disables the cache (the default).
+void SetBytecodeCache(const std::string& dir);
+
+///Compile "source" into a function taking "params" (a comma-separated list of names, or empty).
+/// Returns a registry reference, or LUA_NOREF if compilation failed (the error is printed).
+int CompileChunk(lua_State* L, const std::string& source, const std::string& chunkName, const std::string& params="");
+
+///Store the value on top of the stack in the registry (popping it), and return its reference.
+int RefTop(lua_State* L);
+
+///Release a reference from CompileChunk() or RefTop(). LUA_NOREF is ignored.
+void Unref(lua_State* L, int ref);
+
+///Call a compiled chunk with "nargs" arguments (already pushed). Prints errors (tagged with
+/// "chunkName") and returns false on failure. The stack is left as it was before the arguments.
+bool CallChunk(lua_State* L, int ref, int nargs, const std::string& chunkName);
+
+///Compile (or load from the cache) and run a chunk of code. Returns false on failure (the error is printed).
+bool RunSource(lua_State* L, const std::string& code, const std::string& chunkName);
+
+///Compile (or load from the cache) and run a Lua file. Returns false on failure (the error is printed).
+bool RunFile(lua_State* L, const std::string& path);
+
+///Run every ".lua" file in "dir", in alphabetical order. Returns the number that failed.
+int RunDirectory(lua_State* L, const std::string& dir);
+
+}
@@ -0,0 +1,200 @@
+#include "Profiler.hpp"
+
+#ifdef PORTENTIA_PROFILE
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+
+namespace {
+
+//Events recorded per thread, per capture. Anything past this is dropped (and counted).
+const size_t EventsPerThread = 1<<16;
+
+///A single complete ("X") event.
+struct Event {
+	const char* name;
+	long long startNs;
+	long long durNs;
+};
+
+///Events for one thread. Only the owning thread writes "events"; "count" is published with release
+/// semantics so that the writer (on the main thread) sees complete events without locking.
+struct ThreadBuffer {
+	ThreadBuffer(unsigned int tid) : events(EventsPerThread), count(0), dropped(0), tid(tid) {}
+
+	std::vector<Event> events;
+	std::atomic<size_t> count;
+	std::atomic<size_t> dropped;
+	unsigned int tid;
+	std::string name;
+};
+
+//All thread buffers, ever. Registration is the only time we lock.
+boost::mutex buffersMutex;
+std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+//The current thread's buffer.
+thread_local ThreadBuffer* localBuffer = nullptr;
+
+//Capture state.
+std::atomic<bool> capturing(false);
+unsigned int captureFirst = 1;
+unsigned int captureLast = 0;
+std::string captureFile;
+
+//Common time base, so that all threads line up.
+const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+long long nowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-epoch).count();
+}
+
+ThreadBuffer& getLocalBuffer()
+{
+	if (!localBuffer) {
+		boost::mutex::scoped_lock lock(buffersMutex);
+		buffers.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer(buffers.size()+1)));
+		localBuffer = buffers.back().get();
+	}
+	return *localBuffer;
+}
+
+//Names are almost always literals, but be safe.
+void writeEscaped(std::ostream& out, const std::string& str)
+{
+	for (char c : str) {
+		if (c=='"' || c=='\\') { out <<'\\'; }
+		out <<c;
+	}
+}
+
+} //End un-named namespace
+
+
+void profiler::setCaptureRange(unsigned int firstFrame, unsigned int lastFrame, const std::string& outFile)
+{
+	captureFirst = firstFrame;
+	captureLast = lastFrame;
+	captureFile = outFile;
+}
+
+
+void profiler::beginFrame(unsigned int frameNumber)
+{
+	bool inRange = frameNumber>=captureFirst && frameNumber<=captureLast;
+	bool wasCapturing = capturing.load(std::memory_order_relaxed);
+
+	//Starting? Clear out anything from a previous capture.
+	if (inRange && !wasCapturing) {
+		boost::mutex::scoped_lock lock(buffersMutex);
+		for (auto& buff : buffers) {
+			buff->count.store(0, std::memory_order_relaxed);
+			buff->dropped.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	capturing.store(inRange, std::memory_order_relaxed);
+
+	//Done? Write the results.
+	if (wasCapturing && !inRange) {
+		writeTrace(captureFile);
+	}
+}
+
+
+void profiler::finish()
+{
+	if (capturing.exchange(false)) {
+		writeTrace(captureFile);
+	}
+}
+
+
+void profiler::setThreadName(const std::string& name)
+{
+	getLocalBuffer().name = name;
+}
+
+
+void profiler::writeTrace(const std::string& outFile)
+{
+	std::ofstream out(outFile);
+	if (!out.is_open()) {
+		std::cout <<"Warn: couldn't write trace file: " <<outFile <<"\n";
+		return;
+	}
+
+	//Microseconds, to the nanosecond (the default 6 significant digits can't order events after a second).
+	out <<std::fixed <<std::setprecision(3);
+
+	boost::mutex::scoped_lock lock(buffersMutex);
+	out <<"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	std::string comma = "";
+	size_t dropped = 0;
+	for (const auto& buff : buffers) {
+		//Thread name metadata.
+		if (!buff->name.empty()) {
+			out <<comma <<"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" <<buff->tid <<",\"args\":{\"name\":\"";
+			writeEscaped(out, buff->name);
+			out <<"\"}}";
+			comma = ",\n";
+		}
+
+		//Events (timestamps are in microseconds).
+		size_t count = buff->count.load(std::memory_order_acquire);
+		for (size_t i=0; i<count; i++) {
+			const Event& ev = buff->events[i];
+			out <<comma <<"{\"name\":\"";
+			writeEscaped(out, ev.name);
+			out <<"\",\"cat\":\"portentia\",\"ph\":\"X\",\"pid\":1,\"tid\":" <<buff->tid
+				<<",\"ts\":" <<ev.startNs/1000.0 <<",\"dur\":" <<ev.durNs/1000.0 <<"}";
+			comma = ",\n";
+		}
+		dropped += buff->dropped.load(std::memory_order_relaxed);
+	}
+	out <<"\n]}\n";
+
+	if (dropped>0) {
+		std::cout <<"Warn: profiler dropped " <<dropped <<" events; try a shorter frame range.\n";
+	}
+}
+
+
+profiler::ScopedTimer::ScopedTimer(const char* name) : name(name), startNs(-1)
+{
+	if (capturing.load(std::memory_order_relaxed)) {
+		startNs = nowNs();
+	}
+}
+
+
+profiler::ScopedTimer::~ScopedTimer()
+{
+	if (startNs<0) { return; }
+
+	//Append; only this thread ever writes to its buffer.
+	ThreadBuffer& buff = getLocalBuffer();
+	size_t index = buff.count.load(std::memory_order_relaxed);
+	if (index>=buff.events.size()) {
+		buff.dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	Event& ev = buff.events[index];
+	ev.name = name;
+	ev.startNs = startNs;
+	ev.durNs = nowNs() - startNs;
+	buff.count.store(index+1, std::memory_order_release);
+}
+
+
+#endif //PORTENTIA_PROFILE
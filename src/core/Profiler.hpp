@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+
+/**
+ * A low-overhead, hierarchical scoped-timer profiler.
+ *
+ * Wrap any block in PROFILE_SCOPE("name") to time it. Nested scopes show up as nested slices in
+ *   the output, which is Chrome/Perfetto trace JSON (load it in chrome://tracing or ui.perfetto.dev).
+ *
+ * Each thread records into its own pre-allocated buffer, so recording never locks or allocates.
+ *   Nothing is recorded outside of the requested frame range; the cost of an idle scope is a single
+ *   relaxed atomic load.
+ *
+ * The profiler is only compiled in if PORTENTIA_PROFILE is defined (see the ENABLE_PROFILER option in
+ *   CMakeLists.txt, which is ignored for Release builds). Otherwise, every macro and function here
+ *   is an empty inline, and the profiler costs nothing.
+ */
+namespace profiler {
+
+#ifdef PORTENTIA_PROFILE
+
+///Record frames [firstFrame, lastFrame] (inclusive) and then write the trace to "outFile".
+void setCaptureRange(unsigned int firstFrame, unsigned int lastFrame, const std::string& outFile);
+
+///Mark the start of a new frame. Starts/stops capturing as required (and writes the trace when done).
+void beginFrame(unsigned int frameNumber);
+
+///Stop any capture still in progress (e.g., the window closed early) and write what we have.
+void finish();
+
+///Give the calling thread a name in the trace output.
+void setThreadName(const std::string& name);
+
+///Write everything recorded so far (called automatically at the end of the capture range).
+void writeTrace(const std::string& outFile);
+
+///Times its own lifetime. Use PROFILE_SCOPE instead of creating these directly.
+class ScopedTimer {
+public:
+	explicit ScopedTimer(const char* name);
+	~ScopedTimer();
+
+private:
+	const char* name;
+	long long startNs; //Negative if we weren't capturing when created.
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) profiler::ScopedTimer PROFILE_CONCAT(profileScope_, __LINE__)(name)
+
+#else
+
+inline void setCaptureRange(unsigned int, unsigned int, const std::string&) {}
+inline void beginFrame(unsigned int) {}
+inline void finish() {}
+inline void setThreadName(const std::string&) {}
+inline void writeTrace(const std::string&) {}
+
+#define PROFILE_SCOPE(name) ((void)0)
+
+#endif
+
+} //End namespace profiler
@@ -0,0 +1,241 @@
+#include "ScriptDomain.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+extern "C" {
+	#include "lualib.h"
+	#include "lauxlib.h"
+}
+
+#include "core/JobSystem.hpp"
+#include "core/EntityBatch.hpp"
+#include "core/ScriptScheduler.hpp"
+#include "core/Profiler.hpp"
+#include "core/AllocTracker.hpp"
+
+
+namespace {
+//post(to, body): queue a message from the Mailbox in our upvalue.
+int LuaPost(lua_State* L)
+{
+	Mailbox* box = static_cast<Mailbox*>(lua_touserdata(L, lua_upvalueindex(1)));
+	ScriptMessage msg;
+	msg.from = box->name;
+	msg.to = luaL_checkstring(L, 1);
+	size_t len = 0;
+	const char* body = luaL_optlstring(L, 2, "", &len);
+	msg.body.assign(body, len);
+	box->outbox.push_back(msg);
+	return 0;
+}
+} //End un-named namespace
+
+
+ScriptDomain::ScriptDomain(const std::string& name) : L(nullptr)
+{
+	ALLOC_SCOPE(alloc::Subsystem::Lua);
+	mail.name = name;
+
+	L = lua_newstate(LuaPool::Alloc, &pool);
+	if (!L) {
+		throw std::runtime_error("Can't create Lua state for domain: " + name);
+	}
+	luaL_openlibs(L);
+	EntityBatch::RegisterLua(L);
+	ScriptDomains::RegisterMailbox(L, mail);
+	scheduler.reset(new ScriptScheduler(L));
+}
+
+
+ScriptDomain::~ScriptDomain()
+{
+	//Our batches belong to someone else (who should have removed them already), so we leave them be.
+	scheduler.reset();
+	lua_close(L);
+}
+
+
+bool ScriptDomain::run(const std::string& code, const std::string& chunkName)
+{
+	ALLOC_SCOPE(alloc::Subsystem::Lua);
+	if (luaL_loadbuffer(L, code.c_str(), code.size(), ("="+chunkName).c_str())!=0 || lua_pcall(L, 0, 0, 0)!=0) {
+		std::cout <<"Error in Lua domain \"" <<getName() <<"\": \"" <<lua_tostring(L, -1) <<"\"\n";
+		lua_pop(L, 1);
+		return false;
+	}
+	return true;
+}
+
+
+void ScriptDomain::addBatch(EntityBatch* batch)
+{
+	if (std::find(batches.begin(), batches.end(), batch)==batches.end()) {
+		batches.push_back(batch);
+	}
+}
+
+
+void ScriptDomain::removeBatch(EntityBatch* batch)
+{
+	batches.erase(std::remove(batches.begin(), batches.end(), batch), batches.end());
+}
+
+
+void ScriptDomain::update(const sf::Time& elapsed)
+{
+	PROFILE_SCOPE("ScriptDomain::update");
+	ALLOC_SCOPE(alloc::Subsystem::Lua);
+
+	ScriptDomains::DeliverMail(L, mail);
+
+	//Per-frame script.
+	lua_getglobal(L, "update");
+	if (lua_isfunction(L, -1)) {
+		lua_pushinteger(L, elapsed.asMilliseconds());
+		if (lua_pcall(L, 1, 0, 0)!=0) {
+			std::cout <<"Error in update() of Lua domain \"" <<getName() <<"\": \"" <<lua_tostring(L, -1) <<"\"\n";
+			lua_pop(L, 1);
+		}
+	} else {
+		lua_pop(L, 1);
+	}
+
+	for (EntityBatch* batch : batches) {
+		batch->update(elapsed.asMilliseconds());
+	}
+
+	scheduler->update(elapsed);
+}
+
+
+ScriptDomains::ScriptDomains(lua_State* mainL) : mainL(mainL)
+{
+	mainMail.name = "main";
+	RegisterMailbox(mainL, mainMail);
+}
+
+
+ScriptDomains::~ScriptDomains()
+{
+}
+
+
+ScriptDomain& ScriptDomains::create(const std::string& name)
+{
+	remove(name);
+	domains.push_back(std::unique_ptr<ScriptDomain>(new ScriptDomain(name)));
+	return *domains.back();
+}
+
+
+ScriptDomain* ScriptDomains::find(const std::string& name)
+{
+	for (auto& domain : domains) {
+		if (domain->getName()==name) {
+			return domain.get();
+		}
+	}
+	return nullptr;
+}
+
+
+void ScriptDomains::remove(const std::string& name)
+{
+	for (auto it=domains.begin(); it!=domains.end(); it++) {
+		if ((*it)->getName()==name) {
+			domains.erase(it);
+			return;
+		}
+	}
+}
+
+
+void ScriptDomains::removeBatch(EntityBatch* batch)
+{
+	for (auto& domain : domains) {
+		domain->removeBatch(batch);
+	}
+}
+
+
+void ScriptDomains::update(JobSystem& jobs, const sf::Time& elapsed)
+{
+	if (!domains.empty()) {
+		PROFILE_SCOPE("script domains");
+		jobs.parallel_for(0, domains.size(), 1, [this, &elapsed](size_t first, size_t last) {
+			for (size_t i=first; i<last; i++) {
+				domains[i]->update(elapsed);
+			}
+		});
+	}
+
+	//Sync point: everyone's done, so we can move messages around.
+	sync();
+}
+
+
+void ScriptDomains::sync()
+{
+	route(mainMail.outbox);
+	for (auto& domain : domains) {
+		route(domain->mail.outbox);
+	}
+
+	//The main state gets its messages now.
+	DeliverMail(mainL, mainMail);
+}
+
+
+void ScriptDomains::route(std::vector<ScriptMessage>& outbox)
+{
+	for (ScriptMessage& msg : outbox) {
+		Mailbox* dest = nullptr;
+		if (msg.to==mainMail.name) {
+			dest = &mainMail;
+		} else if (ScriptDomain* domain = find(msg.to)) {
+			dest = &domain->mail;
+		}
+
+		if (dest) {
+			dest->inbox.push_back(msg);
+		} else {
+			std::cout <<"Warn: Lua message from \"" <<msg.from <<"\" to unknown domain \"" <<msg.to <<"\" dropped.\n";
+		}
+	}
+	outbox.clear();
+}
+
+
+void ScriptDomains::RegisterMailbox(lua_State* L, Mailbox& box)
+{
+	lua_pushlightuserdata(L, &box);
+	lua_pushcclosure(L, LuaPost, 1);
+	lua_setglobal(L, "post");
+}
+
+
+void ScriptDomains::DeliverMail(lua_State* L, Mailbox& box)
+{
+	if (box.inbox.empty()) { return; }
+
+	lua_getglobal(L, "on_message");
+	if (!lua_isfunction(L, -1)) {
+		lua_pop(L, 1);
+		box.inbox.clear();
+		return;
+	}
+
+	for (const ScriptMessage& msg : box.inbox) {
+		lua_pushvalue(L, -1);
+		lua_pushlstring(L, msg.from.data(), msg.from.size());
+		lua_pushlstring(L, msg.body.data(), msg.body.size());
+		if (lua_pcall(L, 2, 0, 0)!=0) {
+			std::cout <<"Error in on_message() of Lua state \"" <<box.name <<"\": \"" <<lua_tostring(L, -1) <<"\"\n";
+			lua_pop(L, 1);
+		}
+	}
+	lua_pop(L, 1);
+	box.inbox.clear();
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <SFML/System.hpp>
+
+extern "C" {
+	#include "lua.h"
+}
+
+#include "core/LuaPool.hpp"
+
+class JobSystem;
+class EntityBatch;
+class ScriptScheduler;
+
+
+///A message between Lua states. Bodies are strings (scripts can serialize anything else).
+struct ScriptMessage {
+	std::string from;
+	std::string to;
+	std::string body;
+};
+
+///Messages for one Lua state. Scripts send with post(to, body); they receive through a global on_message(from, body).
+struct Mailbox {
+	std::string name;
+	std::vector<ScriptMessage> inbox;
+	std::vector<ScriptMessage> outbox;
+};
+
+
+/**
+ * An isolated Lua state (with its own allocator pool and behaviour scheduler), for one slice or
+ *   script domain. Domains share nothing, so they can all be updated at once on worker threads.
+ *   Each update, a domain:
+ *    1. Delivers its inbox to on_message(from, body).
+ *    2. Calls its global update(elapsed), if it has one.
+ *    3. Runs its EntityBatches.
+ *    4. Resumes any behaviours that are due.
+ * Domains only see standard Lua, batch arrays, the scheduler's functions and post(); in particular,
+ *   they can't touch the engine. Everything else goes through messages.
+ */
+class ScriptDomain {
+public:
+	explicit ScriptDomain(const std::string& name);
+	~ScriptDomain();
+
+	const std::string& getName() const { return mail.name; }
+	lua_State* lua() { return L; }
+	ScriptScheduler& scripts() { return *scheduler; }
+
+	///Run a chunk of code in this domain (e.g., to define on_message or update). Returns false on error.
+	bool run(const std::string& code, const std::string& chunkName);
+
+	///Run this batch (whose handler must have been compiled in our state) on every update. We don't
+	/// own it: its owner must remove it (and release() it) before either of us goes away.
+	void addBatch(EntityBatch* batch);
+	void removeBatch(EntityBatch* batch);
+
+	///One update. Must not be called at the same time as anything else that touches this domain.
+	void update(const sf::Time& elapsed);
+
+private:
+	friend class ScriptDomains;
+
+	LuaPool pool; //Must outlive L.
+	lua_State* L;
+	std::unique_ptr<ScriptScheduler> scheduler;
+	Mailbox mail;
+	std::vector<EntityBatch*> batches;
+};
+
+
+/**
+ * All of the engine's script domains. update() runs every domain's update in parallel (on the
+ *   JobSystem) and then, back on the calling thread, routes every message posted this update
+ *   (including those posted by the main state, as domain "main") to its recipient's inbox.
+ *   Messages to "main" are delivered to the main state right away; those to other domains arrive
+ *   on their next update.
+ * Create and remove domains from the main thread, outside of update().
+ */
+class ScriptDomains {
+public:
+	///Registers post() with the main state.
+	explicit ScriptDomains(lua_State* mainL);
+	~ScriptDomains();
+
+	///Make a new domain (replacing any domain with the same name).
+	ScriptDomain& create(const std::string& name);
+
+	///Retrieve a domain, or null.
+	ScriptDomain* find(const std::string& name);
+
+	void remove(const std::string& name);
+
+	///Stop running "batch" in whichever domain it was added to (if any).
+	void removeBatch(EntityBatch* batch);
+
+	size_t size() const { return domains.size(); }
+
+	///Update every domain (in parallel), then exchange messages.
+	void update(JobSystem& jobs, const sf::Time& elapsed);
+
+	///Register post() with a state, sending from "box".
+	static void RegisterMailbox(lua_State* L, Mailbox& box);
+
+	///Call on_message() for everything in "box"'s inbox, then empty it.
+	static void DeliverMail(lua_State* L, Mailbox& box);
+
+private:
+	void sync();
+	void route(std::vector<ScriptMessage>& outbox);
+
+	lua_State* mainL;
+	Mailbox mainMail;
+	std::vector<std::unique_ptr<ScriptDomain>> domains;
+};
@@ -0,0 +1,245 @@
+#include "ScriptMonitor.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+extern "C" {
+	#include "lauxlib.h"
+}
+
+
+namespace {
+//Our monitor is stored in the registry under this key's address (shared by all of a state's coroutines).
+const char RegistryKey = 0;
+
+///Per-function sample counts, for the flat profile.
+struct FlatEntry {
+	std::string func;
+	unsigned long long self;
+	unsigned long long total;
+	FlatEntry() : self(0), total(0) {}
+};
+} //End un-named namespace
+
+
+ScriptMonitor::ScriptMonitor(lua_State* L) : L(L), hookInterval(1000), budgetOn(false), maxInstructions(0),
+	depth(0), instructions(0), profiling(false)
+{
+	lua_pushlightuserdata(L, const_cast<char*>(&RegistryKey));
+	lua_pushlightuserdata(L, this);
+	lua_rawset(L, LUA_REGISTRYINDEX);
+}
+
+
+ScriptMonitor::~ScriptMonitor()
+{
+	lua_sethook(L, nullptr, 0, 0);
+	lua_pushlightuserdata(L, const_cast<char*>(&RegistryKey));
+	lua_pushnil(L);
+	lua_rawset(L, LUA_REGISTRYINDEX);
+}
+
+
+ScriptMonitor* ScriptMonitor::Get(lua_State* L)
+{
+	lua_pushlightuserdata(L, const_cast<char*>(&RegistryKey));
+	lua_rawget(L, LUA_REGISTRYINDEX);
+	ScriptMonitor* res = static_cast<ScriptMonitor*>(lua_touserdata(L, -1));
+	lua_pop(L, 1);
+	return res;
+}
+
+
+void ScriptMonitor::setBudget(unsigned int maxInstructions, const sf::Time& maxTime)
+{
+	this->maxInstructions = maxInstructions;
+	this->maxTime = maxTime;
+	budgetOn = maxInstructions>0 || maxTime>sf::Time::Zero;
+	arm(L);
+}
+
+
+void ScriptMonitor::clearBudget()
+{
+	budgetOn = false;
+	arm(L);
+}
+
+
+void ScriptMonitor::startProfiling(unsigned int interval)
+{
+	hookInterval = std::max(1U, interval);
+	profiling = true;
+	arm(L);
+}
+
+
+void ScriptMonitor::stopProfiling()
+{
+	profiling = false;
+	arm(L);
+}
+
+
+void ScriptMonitor::clearResults()
+{
+	stacks.clear();
+	overruns.clear();
+}
+
+
+void ScriptMonitor::arm(lua_State* thread)
+{
+	if (budgetOn || profiling) {
+		lua_sethook(thread, Hook, LUA_MASKCOUNT, hookInterval);
+	} else {
+		lua_sethook(thread, nullptr, 0, 0);
+	}
+}
+
+
+ScriptMonitor::Watch::Watch(lua_State* L, const char* name) : monitor(Get(L))
+{
+	if (!monitor) { return; }
+
+	//Coroutines made before the hook was set don't have it, so (re-)arm whatever we're about to run.
+	monitor->arm(L);
+
+	if (monitor->depth++ == 0) {
+		monitor->currScript = name;
+		monitor->instructions = 0;
+		monitor->scriptStart = std::chrono::steady_clock::now();
+	}
+}
+
+
+ScriptMonitor::Watch::~Watch()
+{
+	if (monitor) {
+		monitor->depth--;
+	}
+}
+
+
+void ScriptMonitor::Hook(lua_State* L, lua_Debug* ar)
+{
+	ScriptMonitor* self = Get(L);
+	if (!self) { return; }
+
+	if (self->profiling) {
+		self->sample(L);
+	}
+	if (self->budgetOn && self->depth>0) {
+		self->checkBudget(L);
+	}
+}
+
+
+void ScriptMonitor::sample(lua_State* thread)
+{
+	//Walk the stack, innermost first.
+	frames.clear();
+	lua_Debug ar;
+	for (int level=0; lua_getstack(thread, level, &ar); level++) {
+		lua_getinfo(thread, "Sn", &ar);
+		std::stringstream frame;
+		frame <<(ar.name ? ar.name : (*ar.what=='m' ? "main" : "?")) <<" (" <<ar.short_src <<":" <<ar.linedefined <<")";
+		frames.push_back(frame.str());
+	}
+	if (depth>0) {
+		frames.push_back(currScript);
+	}
+
+	//Fold it, outermost first.
+	std::string key;
+	for (auto it=frames.rbegin(); it!=frames.rend(); it++) {
+		if (!key.empty()) { key += ";"; }
+		key += *it;
+	}
+	stacks[key]++;
+}
+
+
+void ScriptMonitor::checkBudget(lua_State* thread)
+{
+	instructions += hookInterval;
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-scriptStart).count();
+
+	bool overInstructions = maxInstructions>0 && instructions>maxInstructions;
+	bool overTime = maxTime>sf::Time::Zero && ms>maxTime.asMicroseconds()/1000.0;
+	if (!overInstructions && !overTime) { return; }
+
+	//Report it. The script may catch the error, but then it'll just hit the next one (we don't reset until it returns).
+	overruns[currScript]++;
+	std::cout <<"Warn: Lua script \"" <<currScript <<"\" exceeded its budget (" <<instructions <<" instructions, " <<ms <<" ms); aborting.\n";
+	luaL_error(thread, "script \"%s\" exceeded its budget", currScript.c_str());
+}
+
+
+void ScriptMonitor::printFlat(std::ostream& out, size_t maxRows) const
+{
+	//Self samples go to the innermost function; total samples to every function on the stack (once).
+	std::map<std::string, FlatEntry> funcs;
+	unsigned long long totalSamples = 0;
+	for (const auto& stack : stacks) {
+		totalSamples += stack.second;
+		std::vector<std::string> names;
+		std::stringstream in(stack.first);
+		std::string name;
+		std::string leaf;
+		while (std::getline(in, name, ';')) {
+			leaf = name;
+			if (std::find(names.begin(), names.end(), name)==names.end()) {
+				FlatEntry& entry = funcs[name];
+				entry.func = name;
+				entry.total += stack.second;
+				names.push_back(name);
+			}
+		}
+		if (!leaf.empty()) {
+			funcs[leaf].self += stack.second;
+		}
+	}
+
+	std::vector<FlatEntry> sorted;
+	for (const auto& func : funcs) {
+		sorted.push_back(func.second);
+	}
+	std::sort(sorted.begin(), sorted.end(), [](const FlatEntry& a, const FlatEntry& b) {
+		return a.self>b.self;
+	});
+
+	out <<totalSamples <<" samples\n";
+	out <<"   self   total  function\n";
+	for (size_t i=0; i<sorted.size() && i<maxRows; i++) {
+		out.width(7);
+		out <<sorted[i].self;
+		out.width(8);
+		out <<sorted[i].total;
+		out <<"  " <<sorted[i].func <<"\n";
+	}
+}
+
+
+bool ScriptMonitor::writeFolded(const std::string& file) const
+{
+	std::ofstream out(file.c_str());
+	if (!out) { return false; }
+	for (const auto& stack : stacks) {
+		out <<stack.first <<" " <<stack.second <<"\n";
+	}
+	return static_cast<bool>(out);
+}
+
+
+void ScriptMonitor::printOverruns(std::ostream& out) const
+{
+	if (overruns.empty()) {
+		out <<"No scripts have exceeded their budget.\n";
+	}
+	for (const auto& item : overruns) {
+		out <<item.first <<": " <<item.second <<" overrun(s)\n";
+	}
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <chrono>
+
+#include <SFML/System.hpp>
+
+extern "C" {
+	#include "lua.h"
+}
+
+
+/**
+ * Watches Lua code through a count hook (lua_sethook), for two things:
+ *    * Budgets: a script that runs more than N instructions, or for longer than T, is aborted with a
+ *      Lua error, and the overrun is reported (and counted, per script).
+ *    * Sampling: every N instructions, the current Lua call stack is recorded. Results can be printed
+ *      as a flat profile (self/total samples per function) or written as folded stacks, one
+ *      "outer;inner count" line per stack, for flame graph tools.
+ * The hook is only installed while one of these is on, so it costs nothing otherwise.
+ *
+ * A "script" is anything run inside a ScriptMonitor::Watch; lua::CallChunk(), lua::RunFile() and the
+ *   ScriptScheduler all watch what they run. Lua 5.1 hooks can't yield, so runaway scripts are
+ *   always aborted (a runaway behaviour is removed from the scheduler).
+ */
+class ScriptMonitor {
+public:
+	///Attach to a Lua state (and its coroutines). Only one monitor per state.
+	explicit ScriptMonitor(lua_State* L);
+	~ScriptMonitor();
+
+	///Limit each script to "maxInstructions" and "maxTime". Zero means "no limit".
+	void setBudget(unsigned int maxInstructions, const sf::Time& maxTime);
+	void clearBudget();
+	bool hasBudget() const { return budgetOn; }
+
+	///Sample the Lua stack every "interval" instructions.
+	void startProfiling(unsigned int interval=1000);
+	void stopProfiling();
+	bool isProfiling() const { return profiling; }
+
+	///Forget all samples and overruns.
+	void clearResults();
+
+	///Print the "maxRows" functions with the most self samples.
+	void printFlat(std::ostream& out, size_t maxRows=20) const;
+
+	///Write folded stacks (for flame graphs). Returns false if the file can't be written.
+	bool writeFolded(const std::string& file) const;
+
+	///Print every script that has overrun its budget, and how often.
+	void printOverruns(std::ostream& out) const;
+
+	///Marks a script as running for the lifetime of the scope. Nested watches count towards the outermost.
+	class Watch {
+	public:
+		Watch(lua_State* L, const char* name);
+		~Watch();
+	private:
+		ScriptMonitor* monitor;
+	};
+
+private:
+	static ScriptMonitor* Get(lua_State* L);
+	static void Hook(lua_State* L, lua_Debug* ar);
+
+	///Set (or remove) our hook on a thread, depending on what's turned on.
+	void arm(lua_State* thread);
+
+	void sample(lua_State* thread);
+	void checkBudget(lua_State* thread);
+
+	lua_State* L;
+	unsigned int hookInterval;
+
+	//Budget.
+	bool budgetOn;
+	unsigned int maxInstructions;
+	sf::Time maxTime;
+	std::map<std::string, unsigned int> overruns;
+
+	//The (outermost) script currently being watched.
+	int depth;
+	std::string currScript;
+	unsigned long long instructions;
+	std::chrono::steady_clock::time_point scriptStart;
+
+	//Profiling: sample counts per folded stack.
+	bool profiling;
+	std::map<std::string, unsigned long long> stacks;
+	std::vector<std::string> frames; //Scratch
+};
@@ -0,0 +1,239 @@
+#include "ScriptScheduler.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+
+extern "C" {
+	#include "lauxlib.h"
+}
+
+#include "core/ScriptMonitor.hpp"
+
+
+ScriptScheduler::ScriptScheduler(lua_State* L) : L(L), nowUs(0), frame(0), nextId(1), running(0)
+{
+	const lua_CFunction funcs[] = {LuaSpawn, LuaWait, LuaWaitFrames, LuaWaitUntil, LuaSignal};
+	const char* names[] = {"spawn", "wait", "wait_frames", "wait_until", "signal"};
+	for (int i=0; i<5; i++) {
+		lua_pushlightuserdata(L, this);
+		lua_pushcclosure(L, funcs[i], 1);
+		lua_setglobal(L, names[i]);
+	}
+}
+
+
+ScriptScheduler::~ScriptScheduler()
+{
+	for (auto& task : tasks) {
+		luaL_unref(L, LUA_REGISTRYINDEX, task.second.ref);
+	}
+}
+
+
+void ScriptScheduler::spawn(int nargs, const void* owner)
+{
+	spawnFrom(L, nargs, owner);
+}
+
+
+void ScriptScheduler::spawnFrom(lua_State* from, int nargs, const void* owner)
+{
+	//Make a thread, anchor it, and move the function and its arguments over.
+	lua_State* co = lua_newthread(from);
+	int ref = luaL_ref(from, LUA_REGISTRYINDEX);
+	lua_xmove(from, co, nargs+1);
+
+	Task task;
+	task.thread = co;
+	task.ref = ref;
+	task.nargs = nargs;
+	task.owner = owner;
+	task.suspended = false;
+	task.cancelled = false;
+	unsigned int id = nextId++;
+	tasks[id] = task;
+
+	//Start on the next update.
+	pushHeap(frameWaits, frame+1, id);
+}
+
+
+void ScriptScheduler::signal(const std::string& event)
+{
+	signalled.push_back(event);
+}
+
+
+void ScriptScheduler::cancel(const void* owner)
+{
+	std::vector<unsigned int> ids;
+	for (const auto& task : tasks) {
+		if (task.second.owner==owner) {
+			ids.push_back(task.first);
+		}
+	}
+	for (unsigned int id : ids) {
+		remove(id);
+	}
+}
+
+
+void ScriptScheduler::update(const sf::Time& elapsed)
+{
+	nowUs += elapsed.asMicroseconds();
+	frame++;
+
+	//Gather everything that's due: signalled events, then timers, then frame waits.
+	//Anything that becomes due while we're resuming (e.g., wait(0), or a new signal) waits for the next update.
+	ready.clear();
+	currSignals.swap(signalled);
+	for (const std::string& event : currSignals) {
+		auto it = waiting.find(event);
+		if (it!=waiting.end()) {
+			ready.insert(ready.end(), it->second.begin(), it->second.end());
+			waiting.erase(it);
+		}
+	}
+	currSignals.clear();
+	popDue(timers, nowUs, ready);
+	popDue(frameWaits, frame, ready);
+
+	for (unsigned int id : ready) {
+		resume(id);
+	}
+}
+
+
+void ScriptScheduler::resume(unsigned int id)
+{
+	//Cancelled since it was scheduled?
+	auto it = tasks.find(id);
+	if (it==tasks.end()) { return; }
+
+	Task& task = it->second;
+	int nargs = task.nargs;
+	task.nargs = 0;
+	task.suspended = false;
+	running = id;
+	int res;
+	{
+	ScriptMonitor::Watch watch(task.thread, "behaviour");
+	res = lua_resume(task.thread, nargs);
+	}
+	running = 0;
+
+	//It might have been moved (e.g., if it spawned something).
+	Task& after = tasks[id];
+	if (res==LUA_YIELD && !after.cancelled) {
+		//A plain coroutine.yield() means "resume me next frame".
+		if (!after.suspended) {
+			pushHeap(frameWaits, frame+1, id);
+		}
+		return;
+	}
+
+	if (res!=0 && res!=LUA_YIELD) {
+		std::cout <<"Error in Lua behaviour: \"" <<lua_tostring(after.thread, -1) <<"\"\n";
+	}
+	remove(id);
+}
+
+
+void ScriptScheduler::remove(unsigned int id)
+{
+	auto it = tasks.find(id);
+	if (it==tasks.end()) { return; }
+
+	//Can't drop a thread while it's running; finish up in resume().
+	if (id==running) {
+		it->second.cancelled = true;
+		return;
+	}
+
+	//Any heap entries are skipped when they come due.
+	luaL_unref(L, LUA_REGISTRYINDEX, it->second.ref);
+	tasks.erase(it);
+}
+
+
+void ScriptScheduler::pushHeap(std::vector<Wake>& heap, int64_t due, unsigned int id)
+{
+	Wake wake;
+	wake.due = due;
+	wake.id = id;
+	heap.push_back(wake);
+	std::push_heap(heap.begin(), heap.end(), std::greater<Wake>());
+}
+
+
+void ScriptScheduler::popDue(std::vector<Wake>& heap, int64_t now, std::vector<unsigned int>& out)
+{
+	while (!heap.empty() && heap.front().due<=now) {
+		out.push_back(heap.front().id);
+		std::pop_heap(heap.begin(), heap.end(), std::greater<Wake>());
+		heap.pop_back();
+	}
+}
+
+
+ScriptScheduler* ScriptScheduler::Self(lua_State* co)
+{
+	return static_cast<ScriptScheduler*>(lua_touserdata(co, lua_upvalueindex(1)));
+}
+
+
+ScriptScheduler::Task& ScriptScheduler::checkRunning(lua_State* co, const char* func)
+{
+	auto it = tasks.find(running);
+	if (it==tasks.end() || it->second.thread!=co) {
+		luaL_error(co, "%s() can only be called from a spawn()ed script", func);
+	}
+	it->second.suspended = true;
+	return it->second;
+}
+
+
+int ScriptScheduler::LuaSpawn(lua_State* co)
+{
+	luaL_checktype(co, 1, LUA_TFUNCTION);
+	Self(co)->spawnFrom(co, lua_gettop(co)-1, nullptr);
+	return 0;
+}
+
+
+int ScriptScheduler::LuaWait(lua_State* co)
+{
+	ScriptScheduler* self = Self(co);
+	lua_Number ms = luaL_checknumber(co, 1);
+	self->checkRunning(co, "wait");
+	pushHeap(self->timers, self->nowUs + static_cast<int64_t>(ms*1000), self->running);
+	return lua_yield(co, 0);
+}
+
+
+int ScriptScheduler::LuaWaitFrames(lua_State* co)
+{
+	ScriptScheduler* self = Self(co);
+	lua_Integer frames = std::max<lua_Integer>(1, luaL_optinteger(co, 1, 1));
+	self->checkRunning(co, "wait_frames");
+	pushHeap(self->frameWaits, self->frame + frames, self->running);
+	return lua_yield(co, 0);
+}
+
+
+int ScriptScheduler::LuaWaitUntil(lua_State* co)
+{
+	ScriptScheduler* self = Self(co);
+	std::string event = luaL_checkstring(co, 1);
+	self->checkRunning(co, "wait_until");
+	self->waiting[event].push_back(self->running);
+	return lua_yield(co, 0);
+}
+
+
+int ScriptScheduler::LuaSignal(lua_State* co)
+{
+	Self(co)->signal(luaL_checkstring(co, 1));
+	return 0;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include <SFML/System.hpp>
+
+extern "C" {
+	#include "lua.h"
+}
+
+
+/**
+ * Runs Lua behaviours as coroutines, so that scripts can wait instead of polling:
+ *
+ *     spawn(function(door)
+ *       wait_until("door_open")
+ *       wait(500)              --Milliseconds of game time.
+ *       door:close()
+ *       wait_frames(1)
+ *     end, door)
+ *
+ * Each wait registers the coroutine with a timer heap, a frame heap, or an event list, and yields.
+ *   update() only resumes coroutines that are due, so a waiting script costs nothing per frame.
+ *   signal("event") (from Lua or C++) wakes everything waiting on that event on the next update.
+ *
+ * Spawned scripts first run on the next update(). A script that calls coroutine.yield() directly
+ *   is treated as if it had called wait_frames(1).
+ */
+class ScriptScheduler {
+public:
+	///Registers spawn(), wait(), wait_frames(), wait_until() and signal() as globals in L.
+	explicit ScriptScheduler(lua_State* L);
+	~ScriptScheduler();
+
+	///Start a behaviour. The function and its "nargs" arguments must be on top of L's stack (they're popped).
+	/// "owner" lets you cancel() a group of behaviours later (e.g., when a map is unloaded).
+	void spawn(int nargs, const void* owner=nullptr);
+
+	///Wake everything waiting on "event" (on the next update).
+	void signal(const std::string& event);
+
+	///Stop every behaviour started by "owner".
+	void cancel(const void* owner);
+
+	///Advance game time and resume every coroutine that's due.
+	void update(const sf::Time& elapsed);
+
+	size_t numTasks() const { return tasks.size(); }
+
+private:
+	struct Task {
+		lua_State* thread;
+		int ref;            //Keeps the thread alive, in the registry.
+		int nargs;          //Arguments for the first resume.
+		const void* owner;
+		bool suspended;     //Set by our wait functions, so we know a yield came from us.
+		bool cancelled;     //Cancelled while running; removed after it yields.
+	};
+
+	///An entry in one of our heaps. "due" is game time (us) or a frame number.
+	struct Wake {
+		int64_t due;
+		unsigned int id;
+		bool operator>(const Wake& other) const { return due>other.due; }
+	};
+
+	void spawnFrom(lua_State* from, int nargs, const void* owner);
+	void resume(unsigned int id);
+	void remove(unsigned int id);
+	static void pushHeap(std::vector<Wake>& heap, int64_t due, unsigned int id);
+	static void popDue(std::vector<Wake>& heap, int64_t now, std::vector<unsigned int>& out);
+
+	//Lua-side functions. Each has us as its upvalue.
+	static ScriptScheduler* Self(lua_State* co);
+	Task& checkRunning(lua_State* co, const char* func);
+	static int LuaSpawn(lua_State* co);
+	static int LuaWait(lua_State* co);
+	static int LuaWaitFrames(lua_State* co);
+	static int LuaWaitUntil(lua_State* co);
+	static int LuaSignal(lua_State* co);
+
+	lua_State* L;
+	int64_t nowUs;
+	int64_t frame;
+	unsigned int nextId;
+	unsigned int running; //The task being resumed (0 if none).
+
+	std::unordered_map<unsigned int, Task> tasks;
+	std::vector<Wake> timers;     //Min-heap on game time.
+	std::vector<Wake> frameWaits; //Min-heap on frame number.
+	std::map<std::string, std::vector<unsigned int>> waiting; //By event.
+	std::vector<std::string> signalled;
+
+	//Scratch (kept, to avoid re-allocating every frame).
+	std::vector<unsigned int> ready;
+	std::vector<std::string> currSignals;
+};
@@ -12,6 +12,9 @@
 #include <utility>
 
 #include "geom/Geom.hpp"
+#include "core/Profiler.hpp"
+#include "core/FrameArena.hpp"
+#include "core/AllocTracker.hpp"
 
 
 /**
@@ -70,7 +73,10 @@ public:
 	double maxHeight;
 	int totalItems;
 
-	LazySpatialIndex() : maxWidth(0), maxHeight(0), totalItems(0) {}
+	LazySpatialIndex() : maxWidth(0), maxHeight(0), totalItems(0), scratchArena(nullptr) {}
+
+	///Use "arena" for temporary data during searches (instead of the heap). May be null.
+	void setScratchArena(FrameArena* arena) { scratchArena = arena; }
 
 	int getItemCount();
 
@@ -87,6 +93,13 @@ public:
 
 	void addItem(const ItemType& item, const geom::Rectangle& bounds);
 
+	///Add many items at once (e.g., a chunk of the world that has just streamed in).
+	void addItems(const std::vector<std::pair<ItemType, geom::Rectangle>>& items);
+
+	///Remove every item for which "pred" returns true, in a single pass over the index (rather than
+	/// one search per item). Returns the number of items removed.
+	int removeItems(const std::function<bool (const ItemType&)>& pred);
+
 
 	//BoundsHint can be null; searching is faster if it's not.
 	//TODO: We aren't using the bounds correctly right now; we need to search for MAX (whatever)
@@ -126,18 +139,23 @@ private:
 	std::pair<double, double> search_and_remove_item(AxisMap& axis, double minVal, double maxVal, ItemType searchFor);
 
 	//Helper: If we are removing the current maximum, we need to search for the new maximum.
-	double update_maximum(double currVal, double maxVal, std::map<double, std::vector<AxisPoint>> axis);
+	double update_maximum(double currVal, double maxVal, const std::map<double, std::vector<AxisPoint>>& axis);
 
 private:
 	//Helper class for matching
-	class AxisMatch {
-		AxisMatch() : matchX(false), matchY(false), isFalsePos(false) {}
+	struct AxisMatch {
+		AxisMatch() : matchX(false), isFalsePos(false), matchY(false) {}
 
 		bool matchX;
 		bool isFalsePos; //This must be set before disptach.
 		bool matchY;     //If "true", we've already dispatched this action()
 	};
 
+	//Per-search bookkeeping; allocated from the scratch arena (if any).
+	typedef std::map<ItemType, AxisMatch, std::less<ItemType>, ArenaAllocator<std::pair<const ItemType, AxisMatch>>> MatchMap;
+
+	FrameArena* scratchArena;
+
 };
 
 
@@ -181,11 +199,13 @@ geom::Point LazySpatialIndex<ItemType>::estimateHealth()
 template <class ItemType>
 void LazySpatialIndex<ItemType>::addItem(const ItemType& item, const geom::Rectangle& bounds)
 {
+	ALLOC_SCOPE(alloc::Subsystem::Index);
+
 	//TODO: What was this check for? It doesn't make sense... ~Seth
 	//if (bounds.getMin().x>0) { throw std::runtime_error("Boundary rectangle is out of bounds."); }
 
 	//We can easily support this later, if required.
-	if (bounds.width==0 || bounds.height==0) { std::runtime_error("width/height must be non-zero."); }
+	if (bounds.width==0 || bounds.height==0) { throw std::runtime_error("width/height must be non-zero."); }
 
 	//Insert start/end points into both the x and y axis.
 	add_to_axis(axis_x, bounds.getMin().x, AxisPoint(item, true, bounds.width));
@@ -200,9 +220,59 @@ void LazySpatialIndex<ItemType>::addItem(const ItemType& item, const geom::Recta
 }
 
 
+template <class ItemType>
+void LazySpatialIndex<ItemType>::addItems(const std::vector<std::pair<ItemType, geom::Rectangle>>& items)
+{
+	ALLOC_SCOPE(alloc::Subsystem::Index);
+	for (const auto& item : items) {
+		addItem(item.first, item.second);
+	}
+}
+
+
+template <class ItemType>
+int LazySpatialIndex<ItemType>::removeItems(const std::function<bool (const ItemType&)>& pred)
+{
+	ALLOC_SCOPE(alloc::Subsystem::Index);
+	PROFILE_SCOPE("LazySpatialIndex::removeItems");
+
+	//Each item has two points per axis, so count removed items by their x-axis start points.
+	//We also recompute the maximum width/height from whatever's left.
+	int removed = 0;
+	for (int i=0; i<2; i++) {
+		AxisMap& axis = i==0 ? axis_x : axis_y;
+		double& maxSize = i==0 ? maxWidth : maxHeight;
+		maxSize = 0;
+		for (auto it=axis.begin(); it!=axis.end(); ) {
+			std::vector<AxisPoint>& points = it->second;
+			auto last = std::remove_if(points.begin(), points.end(), [&pred, &removed, i](const AxisPoint& ap) {
+				if (!pred(ap.item)) { return false; }
+				if (i==0 && ap.isStart()) { removed++; }
+				return true;
+			});
+			points.erase(last, points.end());
+			for (const AxisPoint& ap : points) {
+				maxSize = std::max(maxSize, ap.size);
+			}
+
+			if (points.empty()) {
+				axis.erase(it++);
+			} else {
+				it++;
+			}
+		}
+	}
+
+	totalItems -= removed;
+	return removed;
+}
+
+
 template <class ItemType>
 void LazySpatialIndex<ItemType>::removeItem(const ItemType& item, bool useBoundsHint, geom::Rectangle boundsHint)
 {
+	ALLOC_SCOPE(alloc::Subsystem::Index);
+
 	//Search the whole area if no boundsHint is included.
 	if (!useBoundsHint) {
 		boundsHint = getBounds();
@@ -233,7 +303,7 @@ void LazySpatialIndex<ItemType>::removeItem(const ItemType& item, bool useBounds
 template <class ItemType>
 void LazySpatialIndex<ItemType>::moveItem(const ItemType& item, const geom::Rectangle& newBounds, const geom::Rectangle& oldBounds)
 {
-	removeItem(item, oldBounds);
+	removeItem(item, true, oldBounds);
 	addItem(item, newBounds);
 }
 
@@ -241,6 +311,8 @@ void LazySpatialIndex<ItemType>::moveItem(const ItemType& item, const geom::Rect
 template <class ItemType>
 void LazySpatialIndex<ItemType>::forAllItems(LazySpatialIndex<ItemType>::Action toDo)
 {
+	PROFILE_SCOPE("LazySpatialIndex::forAllItems");
+
 	//When scanning the entire axis, we only need to respond to "start" points.
 	//int foundPoints = 0;
 	for (const auto& ap : axis_x) {
@@ -267,6 +339,8 @@ void LazySpatialIndex<ItemType>::forAllItems(LazySpatialIndex<ItemType>::Action
 template <class ItemType>
 void LazySpatialIndex<ItemType>::forAllItems(LazySpatialIndex<ItemType>::ConstAction toDo) const
 {
+	PROFILE_SCOPE("LazySpatialIndex::forAllItems");
+
 	//When scanning the entire axis, we only need to respond to "start" points.
 	//int foundPoints = 0;
 	for (const auto& ap : axis_x) {
@@ -292,6 +366,9 @@ void LazySpatialIndex<ItemType>::forAllItems(LazySpatialIndex<ItemType>::ConstAc
 template <class ItemType>
 void LazySpatialIndex<ItemType>::forAllItemsInRange(geom::Rectangle orig_range, LazySpatialIndex<ItemType>::Action toDo, LazySpatialIndex<ItemType>::Action doOnFalsePositives)
 {
+	PROFILE_SCOPE("LazySpatialIndex::forAllItemsInRange");
+	ALLOC_SCOPE(alloc::Subsystem::Index);
+
 	//Sanity check
 	if (orig_range.isEmpty()) { return; }
 
@@ -312,22 +389,19 @@ void LazySpatialIndex<ItemType>::forAllItemsInRange(geom::Rectangle orig_range,
 	// in the y-direction.
 	//We don't strictly need to "save" which points have already been dispatched (we can recalculate it), but it
 	// makes for a much simpler algorithm (and we need to save data from the x-axis anyway, so it's not very wasteful).
-	std::map<ItemType, LazySpatialIndex<ItemType>::AxisMatch> matchedItems;
+	std::less<ItemType> compare;
+	MatchMap matchedItems(compare, ArenaAllocator<std::pair<const ItemType, AxisMatch>>(scratchArena));
 
 	//Add items on the x-axis, detecting whether they're false-positives or not.
 	{
-	auto& startIt = axis_x.lower_bound(match_range.getMin().x);
-	auto& endIt = axis_x.upper_bound(match_range.getMax().x);
-	for (auto& it=startIt; it!=endIt; it++) {
-		for (auto& ap : it->second) {
+	auto startIt = axis_x.lower_bound(match_range.getMin().x);
+	auto endIt = axis_x.upper_bound(match_range.getMax().x);
+	for (auto it=startIt; it!=endIt; it++) {
+		for (const auto& ap : it->second) {
 			//Expand the hashtable as required.
-			const ItemType& item = ap.item;
-			if (!matchedItems.containsKey(item)) {
-				matchedItems.put(item, new AxisMatch());
-			}
+			AxisMatch& match = matchedItems[ap.item];
 
 			//If we've already determined that this macthes, there's no need for further math.
-			AxisMatch match = matchedItems.get(item);
 			if (match.matchX) { continue; }
 
 			//Determine if this is actually a false-positive. Essentially, the shape is false if it doesn't fall
@@ -335,11 +409,11 @@ void LazySpatialIndex<ItemType>::forAllItemsInRange(geom::Rectangle orig_range,
 			if (possibleFP && !match.isFalsePos) {
 				double startPt = 0;
 				double endPt = 0;
-				if (ap.isStart) {
-					startPt = it.first;
+				if (ap.isStart()) {
+					startPt = it->first;
 					endPt = startPt + ap.size;
 				} else if (ap.isEnd()) {
-					endPt = it.first;
+					endPt = it->first;
 					startPt = endPt - ap.size;
 				}
 				match.isFalsePos = !(range.intersects(startPt, range.getCenter().y, endPt-startPt, 1));
@@ -354,14 +428,15 @@ void LazySpatialIndex<ItemType>::forAllItemsInRange(geom::Rectangle orig_range,
 	//Now match on the y-axis. Same logic, but this time we call the relevant function.
 	//TODO: We might want to put this code into a shared subroutine.
 	{
-	auto& startIt = axis_y.lower_bound(match_range.getMin().y);
-	auto& endIt = axis_y.upper_bound(match_range.getMax().y);
-	for (auto& it=startIt; it!=endIt; it++) {
-		for (auto& ap : it->second) {
+	auto startIt = axis_y.lower_bound(match_range.getMin().y);
+	auto endIt = axis_y.upper_bound(match_range.getMax().y);
+	for (auto it=startIt; it!=endIt; it++) {
+		for (const auto& ap : it->second) {
 			//Skip if already matched, or if there's no potential for a match (x didn't match)
 			ItemType item = ap.item;
-			if (!matchedItems.containsKey(item)) { continue; }
-			AxisMatch match = matchedItems.get(item);
+			auto found = matchedItems.find(item);
+			if (found==matchedItems.end()) { continue; }
+			AxisMatch& match = found->second;
 			if (match.matchY) { continue; }
 
 			//Determine if this is actually a false-positive. Essentially, the shape is false if it doesn't fall
@@ -369,11 +444,11 @@ void LazySpatialIndex<ItemType>::forAllItemsInRange(geom::Rectangle orig_range,
 			if (possibleFP && !match.isFalsePos) {
 				double startPt = 0;
 				double endPt = 0;
-				if (ap.isStart) {
-					startPt = it.first;
+				if (ap.isStart()) {
+					startPt = it->first;
 					endPt = startPt + ap.size;
 				} else if (ap.isEnd()) {
-					endPt = it.first;
+					endPt = it->first;
 					startPt = endPt - ap.size;
 				}
 				match.isFalsePos = !(range.intersects(range.getCenter().x, startPt, 1, endPt-startPt));
@@ -474,7 +549,7 @@ template <class ItemType>
 geom::Rectangle LazySpatialIndex<ItemType>::getActualSearchRectangle(geom::Rectangle src)
 	{
 		if (src.isEmpty()) { return src; }
-		geom::Rectangle res = new geom::Rectangle(src.x, src.y, src.width, src.height);
+		geom::Rectangle res(src.x, src.y, src.width, src.height);
 		expandRectangle(res, 0.001);
 		return res;
 	}
@@ -483,39 +558,39 @@ geom::Rectangle LazySpatialIndex<ItemType>::getActualSearchRectangle(geom::Recta
 template <class ItemType>
 std::pair<double, double> LazySpatialIndex<ItemType>::search_and_remove_item(AxisMap& axis, double minVal, double maxVal, ItemType searchFor)
 {
-	std::pair<bool, double> start(false, 0.0); //"found", value
-	std::pair<bool, double> end(false, 0.0);
+	std::pair<double, double> res(0.0, 0.0); //start, end
 
 	//Now, iterate with the min/max values as a guide.
-	auto& startIt = axis.lower_bound(minVal);
-	auto& endIt = axis.upper_bound(maxVal);
+	auto startIt = axis.lower_bound(minVal);
+	auto endIt = axis.upper_bound(maxVal);
 
-	//Iterate through.
-	int currResID = 1; //"Start" point.
-	std::pair<bool, double>* currRes = &start;
-	for (auto& it=startIt; it!=endIt; it++) {
+	//Iterate through. We should find exactly one start point and one end point.
+	int found = 0;
+	for (auto it=startIt; it!=endIt; it++) {
 		//Find/remove
-		auto remIt = it.second.find(searchFor);
-		if (remIt!=it.second.end()) {
-			it.second.erase(remIt);
-			if (currResID > 2) { throw std::runtime_error("Error: Possible duplicates"); }
-			if (currRes->first) { throw std::runtime_error("Error: Key overlap (unexpected)."); }
-			currRes->second = it.first;
-
-			//Increment
-			currResID++;
-			currRes = &end;
+		auto remIt = std::find_if(it->second.begin(), it->second.end(), [&searchFor](const AxisPoint& ap) {
+			return ap.item==searchFor;
+		});
+		if (remIt!=it->second.end()) {
+			if (found >= 2) { throw std::runtime_error("Error: Possible duplicates"); }
+			if (remIt->isStart()) {
+				res.first = it->first;
+			} else {
+				res.second = it->first;
+			}
+			it->second.erase(remIt);
+			found++;
 		}
 	}
 
-	if (currResID != 3) { throw std::runtime_error("Error: Couldn't find both keys."); }
+	if (found != 2) { throw std::runtime_error("Error: Couldn't find both keys."); }
 
-	return std::make_pair(start.second, end.second);
+	return res;
 }
 
 
 template <class ItemType>
-double LazySpatialIndex<ItemType>::update_maximum(double currVal, double maxVal, std::map<double, std::vector<AxisPoint>> axis)
+double LazySpatialIndex<ItemType>::update_maximum(double currVal, double maxVal, const std::map<double, std::vector<AxisPoint>>& axis)
 {
 	//TODO: We should actually perform a search. However, since we never actually remove "static"
 	//      network items (and these are the ones with large width/heights), we can just keep the "old"
@@ -4,11 +4,22 @@
 
 #include <stdexcept>
 #include <iostream>
+#include <string>
+#include <cstdlib>
 
 #include <SFML/Graphics.hpp>
 
 #include "widgets/FpsCounter.hpp"
 #include "core/GameEngine.hpp"
+#include "core/Profiler.hpp"
+#include "bench/Benchmarks.hpp"
+#include "core/AllocTracker.hpp"
+#include "core/LuaScript.hpp"
+#include "pack/AssetPack.hpp"
+
+//Anything still allocated once the engine (and everything else) is gone has leaked. Registered
+// before the engine is constructed, so that the report runs after it's destroyed.
+const bool LeakReport = (alloc::reportLeaksAtExit(), true);
 
 GameEngine engine;
 
@@ -25,6 +36,122 @@ GameEngine* get_game_engine()
 
 int main( int argc, const char* argv[] )
 {
+	//Command-line options.
+	std::string traceFile = "trace.json";
+	unsigned int traceFirst = 1;
+	unsigned int traceLast = 0;
+	std::string scriptCache = "cache/lua";
+	std::string packFile = "res.pack";
+	bool packRequired = false;
+	LuaGc::Policy gcPolicy;
+	for (int i=1; i<argc; i++) {
+		std::string arg = argv[i];
+		if (arg=="--tick-rate" && i+1<argc) {
+			//Run the simulation at a fixed rate (in Hz), interpolating rendering.
+			int rate = std::atoi(argv[++i]);
+			if (rate<=0) {
+				std::cout <<"Invalid --tick-rate (must be a positive number of Hz): " <<argv[i] <<"\n";
+				return 1;
+			}
+			engine.setFixedTimestep(rate);
+		} else if (arg=="--trace-frames" && i+1<argc) {
+			//Profile a range of frames ("first:last") to a Chrome trace file (see --trace-out).
+			std::string range = argv[++i];
+			size_t colon = range.find(':');
+			traceFirst = std::atoi(range.substr(0, colon).c_str());
+			traceLast = colon==std::string::npos ? traceFirst : std::atoi(range.substr(colon+1).c_str());
+		} else if (arg=="--trace-out" && i+1<argc) {
+			traceFile = argv[++i];
+		} else if (arg=="--record" && i+1<argc) {
+			//Record all input to a file.
+			if (!engine.recordInput(argv[++i])) {
+				std::cout <<"Can't record input to: " <<argv[i] <<"\n";
+				return 1;
+			}
+		} else if (arg=="--replay" && i+1<argc) {
+			//Replay recorded input (hidden, as fast as possible) and report the time taken.
+			if (!engine.replayInput(argv[++i])) {
+				std::cout <<"Can't replay input from: " <<argv[i] <<"\n";
+				return 1;
+			}
+		} else if (arg=="--script-cache" && i+1<argc) {
+			//Where to cache compiled Lua bytecode.
+			scriptCache = argv[++i];
+		} else if (arg=="--no-script-cache") {
+			//Always compile Lua from source.
+			scriptCache = "";
+		} else if (arg=="--pack" && i+1<argc) {
+			//Load assets from this pack (built by "assetpack"; by default, "res.pack" is used if it's there).
+			packFile = argv[++i];
+			packRequired = true;
+		} else if (arg=="--no-pack") {
+			//Only use loose files (e.g., while editing them).
+			packFile = "";
+		} else if (arg=="--no-hot-reload") {
+			//Don't watch res/ and script/ for changes.
+			engine.setHotReload(false);
+		} else if (arg=="--asset-budget" && i+1<argc) {
+			//Keep up to this many MB of unused textures (etc.) cached.
+			engine.assets().setBudget(size_t(std::atoi(argv[++i]))*1024*1024);
+		} else if (arg=="--gc-auto") {
+			//Let Lua collect garbage whenever it likes (instead of at the end of each frame).
+			gcPolicy.manual = false;
+		} else if (arg=="--gc-pause" && i+1<argc) {
+			gcPolicy.pause = std::atoi(argv[++i]);
+		} else if (arg=="--gc-stepmul" && i+1<argc) {
+			gcPolicy.stepmul = std::atoi(argv[++i]);
+		} else if (arg=="--alloc-budget" && i+1<argc) {
+			//Abort if any frame (after a warm-up) makes more than this many heap allocations.
+			//Requires ENABLE_ALLOC_TRACKING (without it, there's nothing to check the budget against).
+#ifdef PORTENTIA_ALLOC_TRACKING
+			alloc::setSteadyStateBudget(std::atoi(argv[++i]), 120);
+#else
+			std::cout <<"Can't check --alloc-budget: this build doesn't track allocations (see ENABLE_ALLOC_TRACKING).\n";
+			return 1;
+#endif
+		} else if (arg=="--bench-startup") {
+			//Benchmark: start the game, report the time to its first frame (and per start-up task), and exit.
+			engine.setStartupBenchmark(true);
+		} else if (arg=="--bench-jobs") {
+			//Benchmark: JobSystem scaling (optionally, up to a given number of threads).
+			unsigned int threads = (i+1<argc) ? std::atoi(argv[i+1]) : 0;
+			return bench::JobScaling(threads);
+		} else if (arg=="--bench-lua") {
+			//Benchmark: re-compiled vs. cached onupdate handlers (optionally, for a given number of objects).
+			unsigned int objects = (i+1<argc) ? std::atoi(argv[i+1]) : 0;
+			return bench::LuaOnUpdate(objects);
+		} else if (arg=="--bench-npcs") {
+			//Benchmark: per-NPC vs. batched Lua handlers (optionally, for a given number of NPCs).
+			unsigned int npcs = (i+1<argc) ? std::atoi(argv[i+1]) : 0;
+			return bench::LuaBatch(npcs);
+		} else if (arg=="--bench-domains") {
+			//Benchmark: script domain scaling (optionally, up to a given number of threads).
+			unsigned int threads = (i+1<argc) ? std::atoi(argv[i+1]) : 0;
+			return bench::DomainScaling(threads);
+		} else if (arg=="--bench-mapload") {
+			//Benchmark: streamed vs. JSON-tree map loading (optionally, for a given number of tiles).
+			unsigned int tiles = (i+1<argc) ? std::atoi(argv[i+1]) : 0;
+			return bench::MapLoad(tiles);
+		} else {
+			std::cout <<"Unknown argument: " <<arg <<"\n";
+		}
+	}
+
+	//Packed files take precedence over loose ones, so there's nothing to hot-reload.
+	if (!packFile.empty()) {
+		if (pack::Mount(packFile)) {
+			engine.setHotReload(false);
+		} else if (packRequired) {
+			std::cout <<"Can't load asset pack: " <<packFile <<"\n";
+			return 1;
+		}
+	}
+
+	profiler::setCaptureRange(traceFirst, traceLast, traceFile);
+	lua::SetBytecodeCache(scriptCache);
+	engine.setLuaGcPolicy(gcPolicy);
+	profiler::setThreadName("main");
+
 	//A GameEngine encapsulates our sfml calls.
 	engine.createGameWindow({800, 600}, "Portentia", GameEngine::Position::Center);
 
@@ -0,0 +1,234 @@
+#include "ChunkStreamer.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+#include "map/MapCompiler.hpp"
+#include "core/Profiler.hpp"
+#include "core/AllocTracker.hpp"
+
+
+namespace {
+//We load chunks around where we'll be in this many seconds, as well as where we are.
+const float LookAheadSeconds = 1.0;
+
+int ChunkOf(float pos, unsigned int chunkSize)
+{
+	return static_cast<int>(std::floor(pos / chunkSize));
+}
+} //End un-named namespace
+
+
+ChunkStreamer::ChunkStreamer() : chunkSize(0), radius(1), running(false)
+{
+}
+
+
+ChunkStreamer::~ChunkStreamer()
+{
+	close();
+}
+
+
+uint32_t ChunkStreamer::Key(int cx, int cy)
+{
+	return ((static_cast<uint32_t>(cx+32768)&0xFFFF)<<16) | (static_cast<uint32_t>(cy+32768)&0xFFFF);
+}
+
+
+void ChunkStreamer::open(const std::string& dir, unsigned int chunkSize, unsigned int radius)
+{
+	close();
+	this->dir = dir;
+	this->chunkSize = std::max(1U, chunkSize);
+	this->radius = radius;
+
+	running = true;
+	thread = boost::thread(&ChunkStreamer::run, this);
+}
+
+
+void ChunkStreamer::close()
+{
+	if (running) {
+		{
+		boost::mutex::scoped_lock lock(mutex);
+		running = false;
+		}
+		wakeUp.notify_all();
+		thread.join();
+	}
+
+	todo.clear();
+	loaded.clear();
+	requested.clear();
+	index.removeItems([](const TileRef&) { return true; });
+	chunks.clear();
+	chunkSize = 0;
+}
+
+
+void ChunkStreamer::run()
+{
+	profiler::setThreadName("chunk loader");
+	for (;;) {
+		//Wait for a request.
+		std::pair<int, int> pos;
+		{
+		boost::mutex::scoped_lock lock(mutex);
+		while (running && todo.empty()) {
+			wakeUp.wait(lock);
+		}
+		if (!running) { return; }
+		pos = todo.front();
+		todo.pop_front();
+		}
+
+		//Map it. Chunks with no tiles have no file; that's fine.
+		ALLOC_SCOPE(alloc::Subsystem::Assets);
+		std::unique_ptr<Chunk> chunk(new Chunk());
+		chunk->cx = pos.first;
+		chunk->cy = pos.second;
+		chunk->map.open(mapfile::ChunkPath(dir, pos.first, pos.second));
+
+		boost::mutex::scoped_lock lock(mutex);
+		loaded.push_back(std::move(chunk));
+	}
+}
+
+
+bool ChunkStreamer::near(int cx, int cy, int ax, int ay, int bx, int by, int slack) const
+{
+	int r = radius + slack;
+	return (std::abs(cx-ax)<=r && std::abs(cy-ay)<=r) || (std::abs(cx-bx)<=r && std::abs(cy-by)<=r);
+}
+
+
+void ChunkStreamer::update(float x, float y, float vx, float vy)
+{
+	if (!isOpen()) { return; }
+	PROFILE_SCOPE("ChunkStreamer::update");
+	ALLOC_SCOPE(alloc::Subsystem::Index);
+
+	//Where we are, and where we're heading.
+	int cx = ChunkOf(x, chunkSize);
+	int cy = ChunkOf(y, chunkSize);
+	int ax = ChunkOf(x + vx*LookAheadSeconds, chunkSize);
+	int ay = ChunkOf(y + vy*LookAheadSeconds, chunkSize);
+
+	//Add any chunks that have finished loading (unless we've moved away from them since).
+	{
+	boost::mutex::scoped_lock lock(mutex);
+	scratchLoaded.swap(loaded);
+	}
+	for (auto& chunk : scratchLoaded) {
+		requested.erase(Key(chunk->cx, chunk->cy));
+		if (near(chunk->cx, chunk->cy, cx, cy, ax, ay, 1)) {
+			addChunk(std::move(chunk));
+		}
+	}
+	scratchLoaded.clear();
+
+	//Evict far-away chunks (with one chunk of slack, so we don't thrash along a boundary), and remove all of
+	// their tiles from the index in one pass.
+	scratchEvicted.clear();
+	for (auto it=chunks.begin(); it!=chunks.end(); ) {
+		if (near(it->second->cx, it->second->cy, cx, cy, ax, ay, 1)) {
+			it++;
+			continue;
+		}
+		if (it->second->map.isOpen()) {
+			scratchEvicted.push_back(it->first);
+		}
+		chunks.erase(it++);
+	}
+	if (!scratchEvicted.empty()) {
+		index.removeItems([this](const TileRef& ref) {
+			return std::find(scratchEvicted.begin(), scratchEvicted.end(), static_cast<uint32_t>(ref>>32))!=scratchEvicted.end();
+		});
+	}
+
+	//Request missing chunks, nearest first.
+	scratchWanted.clear();
+	for (int dy=-radius; dy<=radius; dy++) {
+		for (int dx=-radius; dx<=radius; dx++) {
+			scratchWanted.push_back(std::make_pair(cx+dx, cy+dy));
+			if (ax!=cx || ay!=cy) {
+				scratchWanted.push_back(std::make_pair(ax+dx, ay+dy));
+			}
+		}
+	}
+	std::sort(scratchWanted.begin(), scratchWanted.end(), [cx, cy](const std::pair<int, int>& a, const std::pair<int, int>& b) {
+		return std::max(std::abs(a.first-cx), std::abs(a.second-cy)) < std::max(std::abs(b.first-cx), std::abs(b.second-cy));
+	});
+
+	bool wake = false;
+	{
+	boost::mutex::scoped_lock lock(mutex);
+
+	//Drop requests we no longer need.
+	for (auto it=todo.begin(); it!=todo.end(); ) {
+		if (near(it->first, it->second, cx, cy, ax, ay, 0)) {
+			it++;
+		} else {
+			requested.erase(Key(it->first, it->second));
+			it = todo.erase(it);
+		}
+	}
+
+	for (const auto& pos : scratchWanted) {
+		uint32_t key = Key(pos.first, pos.second);
+		if (chunks.count(key)==0 && requested.count(key)==0) {
+			requested.insert(key);
+			todo.push_back(pos);
+			wake = true;
+		}
+	}
+	}
+	if (wake) {
+		wakeUp.notify_one();
+	}
+}
+
+
+void ChunkStreamer::addChunk(std::unique_ptr<Chunk> chunk)
+{
+	uint32_t key = Key(chunk->cx, chunk->cy);
+	if (chunks.count(key)>0) { return; }
+
+	//Index all of its tiles at once (by position; they're drawn at their texture's size).
+	if (chunk->map.isOpen()) {
+		scratchItems.clear();
+		for (size_t i=0; i<chunk->map.numTiles(); i++) {
+			const mapfile::Tile& t = chunk->map.tile(i);
+			scratchItems.push_back(std::make_pair((static_cast<TileRef>(key)<<32) | i, geom::Rectangle(t.x, t.y, 1, 1)));
+		}
+		index.addItems(scratchItems);
+	}
+	chunks[key] = std::move(chunk);
+}
+
+
+void ChunkStreamer::findTiles(float left, float top, float right, float bottom, std::vector<TileRef>& res)
+{
+	if (index.getItemCount()==0) { return; }
+
+	//Tiles that cross a chunk boundary must still overlap as they were authored, so sort by map order
+	// (not by TileRef, which groups them by chunk).
+	scratchFound.clear();
+	index.forAllItemsInRange(geom::Rectangle(left, top, right-left, bottom-top), [this](TileRef ref) {
+		const CompiledMap& map = chunks.find(static_cast<uint32_t>(ref>>32))->second->map;
+		scratchFound.push_back(std::make_pair(map.tileOrder(static_cast<uint32_t>(ref)), ref));
+	}, nullptr);
+	std::sort(scratchFound.begin(), scratchFound.end());
+	for (const auto& found : scratchFound) {
+		res.push_back(found.second);
+	}
+}
+
+
+const mapfile::Tile& ChunkStreamer::tile(TileRef ref) const
+{
+	return chunks.find(static_cast<uint32_t>(ref>>32))->second->map.tile(static_cast<uint32_t>(ref));
+}
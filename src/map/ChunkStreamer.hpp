@@ -0,0 +1,99 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <deque>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "map/CompiledMap.hpp"
+#include "index/LazySpatialIndex.hpp"
+
+
+/**
+ * Streams the tiles of a large map in and out, a chunk at a time, around a moving point (e.g., the
+ *   camera). Each chunk is a separate compiled map (see mapfile::Compile()); only the chunks within
+ *   "radius" chunks of the point (and of where it's heading) are kept loaded, so memory use and load
+ *   times depend on the view distance, not the size of the world.
+ *
+ * Chunks are opened (memory-mapped and validated) on a background thread. When one arrives, all of
+ *   its tiles are added to our spatial index at once; when one is evicted, they're all removed in a
+ *   single pass. Tiles are identified by a TileRef (their chunk and index).
+ */
+class ChunkStreamer {
+public:
+	///A tile in a loaded chunk: the chunk's key in the high 32 bits, and the tile's index in the low 32.
+	typedef uint64_t TileRef;
+
+	ChunkStreamer();
+	~ChunkStreamer();
+
+	///Start streaming chunks (chunkSize pixels square) from "dir". Any previous map is closed.
+	void open(const std::string& dir, unsigned int chunkSize, unsigned int radius);
+	void close();
+	bool isOpen() const { return chunkSize>0; }
+
+	///Load chunks around (x,y), and ahead of it if it's moving (velocity is in pixels/second), and evict
+	/// far-away ones. Chunks that have finished loading are added to the index. Call once per tick.
+	void update(float x, float y, float vx, float vy);
+
+	///Use "arena" for temporary data while searching the index.
+	void setScratchArena(FrameArena* arena) { index.setScratchArena(arena); }
+
+	///Append every loaded tile positioned within [left,right] x [top,bottom] to "res", in drawing order
+	/// (their order in the whole map, across chunks).
+	void findTiles(float left, float top, float right, float bottom, std::vector<TileRef>& res);
+
+	///Retrieve a tile found by findTiles().
+	const mapfile::Tile& tile(TileRef ref) const;
+
+	///Number of chunks loaded (including empty ones), and loading.
+	size_t loadedChunks() const { return chunks.size(); }
+	size_t pendingChunks() const { return requested.size(); }
+
+private:
+	struct Chunk {
+		int cx;
+		int cy;
+		CompiledMap map; //Not open if the chunk is empty (i.e., has no file).
+	};
+
+	static uint32_t Key(int cx, int cy);
+
+	///Is chunk (cx,cy) within "radius" (plus "slack") of either chunk a or b?
+	bool near(int cx, int cy, int ax, int ay, int bx, int by, int slack) const;
+
+	void run();
+	void addChunk(std::unique_ptr<Chunk> chunk);
+
+	std::string dir;
+	unsigned int chunkSize;
+	int radius;
+
+	//Loaded chunks, and their tiles.
+	std::map<uint32_t, std::unique_ptr<Chunk>> chunks;
+	LazySpatialIndex<TileRef> index;
+	std::vector<std::pair<TileRef, geom::Rectangle>> scratchItems;
+	std::vector<uint32_t> scratchEvicted;
+	std::vector<std::pair<int, int>> scratchWanted;
+	std::vector<std::pair<uint32_t, TileRef>> scratchFound; //By drawing order.
+
+	//Chunks we've asked for (main thread only).
+	std::set<uint32_t> requested;
+
+	//The loader thread.
+	boost::thread thread;
+	std::atomic<bool> running;
+	boost::mutex mutex;
+	boost::condition_variable wakeUp;
+	std::deque<std::pair<int, int>> todo;         //Guarded by mutex.
+	std::vector<std::unique_ptr<Chunk>> loaded;   //Guarded by mutex.
+	std::vector<std::unique_ptr<Chunk>> scratchLoaded;
+};
@@ -0,0 +1,148 @@
+#include "CompiledMap.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+#include "pack/AssetPack.hpp"
+#include "map/MapReader.hpp"
+
+
+CompiledMap::CompiledMap() : head(nullptr), stringOffsets(nullptr), stringData(nullptr), tileTypes(nullptr),
+	tiles(nullptr), cellStarts(nullptr), cellItems(nullptr), layerIds(nullptr), tileOrders(nullptr)
+{
+}
+
+
+bool CompiledMap::IsStale(const std::string& jsonFile, const std::string& binFile)
+{
+	//Packed maps were compiled when the pack was built.
+	if (pack::Contains(binFile)) { return false; }
+
+	//Compare the JSON with the stamp we took of it when compiling (not with the compiled file's own
+	// time, which is only as precise as the file system, and misses edits made while compiling).
+	platform::MappedFile bin;
+	if (!bin.open(binFile)) { return true; }
+	const mapfile::Header* head = reinterpret_cast<const mapfile::Header*>(bin.data());
+	if (bin.size()<sizeof(mapfile::Header) || !std::equal(mapfile::Magic, mapfile::Magic+4, head->magic) || head->version!=mapfile::Version) {
+		return true;
+	}
+
+	mapfile::SourceStamp json = mapfile::Stamp(jsonFile);
+	if (json.size==0 && json.mtimeNs==0) { return false; } //No JSON: use what we have.
+	return json.size!=head->source.size || json.mtimeNs!=head->source.mtimeNs;
+}
+
+
+template <class T>
+const T* CompiledMap::section(const mapfile::Section& sect) const
+{
+	//Must be aligned (to 4 bytes, even for smaller types), and fit in the file.
+	if (sect.offset%4!=0 || sect.offset>file.size() || sect.count>(file.size()-sect.offset)/sizeof(T)) {
+		return nullptr;
+	}
+	return reinterpret_cast<const T*>(file.data()+sect.offset);
+}
+
+
+bool CompiledMap::open(const std::string& path)
+{
+	close();
+	if (!file.open(path)) { return false; }
+
+	head = reinterpret_cast<const mapfile::Header*>(file.data());
+	if (file.size()<sizeof(mapfile::Header) || !std::equal(mapfile::Magic, mapfile::Magic+4, head->magic)
+		|| head->version!=mapfile::Version || head->fileSize!=file.size()) {
+		close();
+		return false;
+	}
+
+	stringOffsets = section<uint32_t>(head->strings);
+	stringData = section<char>(head->stringData);
+	tileTypes = section<mapfile::TileType>(head->tileTypes);
+	tiles = section<mapfile::Tile>(head->tiles);
+	cellStarts = section<uint32_t>(head->cellStarts);
+	cellItems = section<uint32_t>(head->cellItems);
+	layerIds = section<uint16_t>(head->layerTiles);
+	tileOrders = section<uint32_t>(head->tileOrder);
+	if (!validate()) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+
+bool CompiledMap::validate() const
+{
+	//Every section must be present, and every id must be in range (so that lookups needn't check).
+	if (!stringOffsets || !stringData || !tileTypes || !tiles || !cellStarts || !cellItems || !layerIds || !tileOrders) { return false; }
+
+	const mapfile::Header& h = *head;
+	if (h.stringData.count==0 || stringData[h.stringData.count-1]!='\0' || h.extra>=h.strings.count) { return false; }
+	for (uint32_t i=0; i<h.strings.count; i++) {
+		if (stringOffsets[i]>=h.stringData.count) { return false; }
+	}
+	for (uint32_t i=0; i<h.tileTypes.count; i++) {
+		if (tileTypes[i].name>=h.strings.count || tileTypes[i].file>=h.strings.count) { return false; }
+	}
+	for (uint32_t i=0; i<h.tiles.count; i++) {
+		if (tiles[i].type>=h.tileTypes.count) { return false; }
+	}
+	if (h.tileOrder.count!=0 && h.tileOrder.count!=h.tiles.count) { return false; }
+
+	//The grid.
+	if (h.grid.cellSize==0 || h.cellStarts.count!=uint64_t(h.grid.cols)*h.grid.rows+1 || cellStarts[0]!=0
+		|| cellStarts[h.cellStarts.count-1]!=h.cellItems.count) { return false; }
+	for (uint32_t i=1; i<h.cellStarts.count; i++) {
+		if (cellStarts[i]<cellStarts[i-1]) { return false; }
+	}
+	for (uint32_t i=0; i<h.cellItems.count; i++) {
+		if (cellItems[i]>=h.tiles.count) { return false; }
+	}
+
+	//The ground layer (tile ids are checked against the tileset when drawn, since that's not loaded yet).
+	if (h.layer.tileset>=h.strings.count || h.layerTiles.count!=uint64_t(h.layer.cols)*h.layer.rows
+		|| (h.layerTiles.count>0 && h.layer.tileSize==0)) { return false; }
+	return true;
+}
+
+
+void CompiledMap::close()
+{
+	file.close();
+	head = nullptr;
+	stringOffsets = nullptr;
+	stringData = nullptr;
+	tileTypes = nullptr;
+	tiles = nullptr;
+	cellStarts = nullptr;
+	cellItems = nullptr;
+	layerIds = nullptr;
+	tileOrders = nullptr;
+}
+
+
+void CompiledMap::findTiles(float left, float top, float right, float bottom, std::vector<uint32_t>& res) const
+{
+	const mapfile::Grid& grid = head->grid;
+	if (grid.cols==0 || grid.rows==0) { return; }
+
+	//Cells overlapping the range (clamped to the grid).
+	int minCx = std::max(0, static_cast<int>(std::floor((left-grid.originX)/grid.cellSize)));
+	int minCy = std::max(0, static_cast<int>(std::floor((top-grid.originY)/grid.cellSize)));
+	int maxCx = std::min(static_cast<int>(grid.cols)-1, static_cast<int>(std::floor((right-grid.originX)/grid.cellSize)));
+	int maxCy = std::min(static_cast<int>(grid.rows)-1, static_cast<int>(std::floor((bottom-grid.originY)/grid.cellSize)));
+
+	//Check each tile in those cells (only the border cells can have tiles outside the range).
+	for (int cy=minCy; cy<=maxCy; cy++) {
+		for (int cx=minCx; cx<=maxCx; cx++) {
+			size_t cell = cy*grid.cols + cx;
+			for (uint32_t i=cellStarts[cell]; i<cellStarts[cell+1]; i++) {
+				const mapfile::Tile& t = tiles[cellItems[i]];
+				if (t.x>=left && t.x<=right && t.y>=top && t.y<=bottom) {
+					res.push_back(cellItems[i]);
+				}
+			}
+		}
+	}
+}
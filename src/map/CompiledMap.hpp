@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "map/MapFormat.hpp"
+#include "platform/MappedFile.hpp"
+
+
+/**
+ * A compiled map (see MapFormat.hpp), memory-mapped and used in place: strings, tiles and the
+ *   spatial index all point straight into the file. Opening a map only checks that it's valid.
+ */
+class CompiledMap {
+public:
+	CompiledMap();
+
+	///Map and validate "path". Returns false (and stays closed) if it's missing, out of date or corrupt.
+	bool open(const std::string& path);
+	void close();
+	bool isOpen() const { return head!=nullptr; }
+
+	///True if "binFile" is missing, out of date, or wasn't compiled from "jsonFile" as it is now (its size
+	/// and modification time, to the nanosecond), i.e., it needs to be re-compiled. Never true for a packed "binFile".
+	static bool IsStale(const std::string& jsonFile, const std::string& binFile);
+
+	const char* string(uint32_t id) const { return stringData + stringOffsets[id]; }
+
+	///Everything except the tiles, as JSON.
+	const char* extra() const { return string(head->extra); }
+
+	///mapfile::TileHash() of the map this was compiled from.
+	uint64_t tileHash() const { return head->tileHash; }
+
+	size_t numTileTypes() const { return head->tileTypes.count; }
+	const mapfile::TileType& tileType(size_t id) const { return tileTypes[id]; }
+
+	size_t numTiles() const { return head->tiles.count; }
+	const mapfile::Tile& tile(size_t id) const { return tiles[id]; }
+
+	///Where tile "id" is drawn, relative to the others: its index in the whole map (which, for a streamed
+	/// map's chunk, isn't its index in the chunk).
+	uint32_t tileOrder(size_t id) const { return head->tileOrder.count>0 ? tileOrders[id] : id; }
+
+	///The ground layer (empty if it has no columns), and its tile ids (row-major).
+	const mapfile::Layer& layer() const { return head->layer; }
+	const uint16_t* layerTiles() const { return layerIds; }
+
+	///Append the index of every tile positioned within [left,right] x [top,bottom] to "res".
+	/// Results are grouped by grid cell; sort them to get drawing order.
+	void findTiles(float left, float top, float right, float bottom, std::vector<uint32_t>& res) const;
+
+private:
+	template <class T>
+	const T* section(const mapfile::Section& sect) const;
+
+	bool validate() const;
+
+	platform::MappedFile file;
+	const mapfile::Header* head;
+	const uint32_t* stringOffsets;
+	const char* stringData;
+	const mapfile::TileType* tileTypes;
+	const mapfile::Tile* tiles;
+	const uint32_t* cellStarts;
+	const uint32_t* cellItems;
+	const uint16_t* layerIds;
+	const uint32_t* tileOrders;
+};
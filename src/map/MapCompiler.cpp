@@ -0,0 +1,333 @@
+#include "MapCompiler.hpp"
+
+#include <map>
+#include <vector>
+#include <limits>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+#include "map/MapFormat.hpp"
+#include "map/MapReader.hpp"
+#include "util/Hash.hpp"
+
+
+namespace {
+
+///Builds the string table, giving each distinct string one id.
+class StringTable {
+public:
+	uint32_t intern(const std::string& str) {
+		auto it = ids.find(str);
+		if (it!=ids.end()) { return it->second; }
+		uint32_t id = offsets.size();
+		offsets.push_back(data.size());
+		data.insert(data.end(), str.begin(), str.end());
+		data.push_back('\0');
+		ids[str] = id;
+		return id;
+	}
+
+	std::vector<uint32_t> offsets;
+	std::vector<char> data;
+
+private:
+	std::map<std::string, uint32_t> ids;
+};
+
+
+///Append a section of "items" to "out" (4-byte aligned) and return where it went.
+template <class T>
+mapfile::Section Append(std::vector<char>& out, const std::vector<T>& items)
+{
+	out.resize((out.size()+3) & ~size_t(3), '\0');
+	mapfile::Section res;
+	res.offset = out.size();
+	res.count = items.size();
+	const char* bytes = reinterpret_cast<const char*>(items.data());
+	out.insert(out.end(), bytes, bytes+items.size()*sizeof(T));
+	return res;
+}
+
+///Which row/column "pos" is in (positions are never less than the grid's origin).
+uint32_t CellOf(int32_t pos, int32_t origin)
+{
+	return (static_cast<int64_t>(pos)-origin) / mapfile::CellSize;
+}
+
+
+///Compile one file: a whole map, or (if "whole" isn't set) just the tiles of one chunk of a streamed map,
+/// where "mapOrder" gives each tile's index in the whole map.
+void CompileOne(const mapfile::MapData& map, const std::vector<mapfile::MapTile>& mapTiles, const std::vector<uint32_t>& mapOrder,
+	bool whole, const std::string& outFile)
+{
+	using namespace mapfile;
+
+	StringTable strings;
+
+	//Tile types, by name.
+	std::vector<TileType> types;
+	std::map<std::string, uint32_t> typeIds;
+	for (const auto& tt : map.tileTypes) {
+		TileType type;
+		type.name = strings.intern(tt.first);
+		type.file = strings.intern(tt.second);
+		typeIds[tt.first] = types.size();
+		types.push_back(type);
+	}
+
+	//The type of each name used by the tiles (or NoType, if it's unknown).
+	const uint32_t NoType = std::numeric_limits<uint32_t>::max();
+	std::vector<uint32_t> nameTypes;
+	for (const std::string& name : map.tileNames) {
+		auto type = typeIds.find(name);
+		nameTypes.push_back(type!=typeIds.end() ? type->second : NoType);
+	}
+
+	//Tiles, in order.
+	std::vector<Tile> tiles;
+	std::vector<uint32_t> tileOrder;
+	tiles.reserve(mapTiles.size());
+	for (size_t i=0; i<mapTiles.size(); i++) {
+		const MapTile& item = mapTiles[i];
+		if (nameTypes[item.name]==NoType) {
+			std::cout <<"Warn: unknown tile: " <<map.tileNames[item.name] <<"\n";
+			continue;
+		}
+		Tile tile;
+		tile.type = nameTypes[item.name];
+		tile.x = item.x;
+		tile.y = item.y;
+		tiles.push_back(tile);
+		if (!mapOrder.empty()) {
+			tileOrder.push_back(mapOrder[i]);
+		}
+	}
+
+	//Spatial index: a grid over the tiles' positions, aligned to CellSize.
+	Grid grid;
+	grid.cellSize = CellSize;
+	grid.originX = grid.originY = 0;
+	grid.cols = grid.rows = 0;
+	if (!tiles.empty()) {
+		int32_t minX = std::numeric_limits<int32_t>::max(), minY = minX;
+		int32_t maxX = std::numeric_limits<int32_t>::min(), maxY = maxX;
+		for (const Tile& tile : tiles) {
+			minX = std::min(minX, tile.x);
+			minY = std::min(minY, tile.y);
+			maxX = std::max(maxX, tile.x);
+			maxY = std::max(maxY, tile.y);
+		}
+		uint64_t cols = (static_cast<int64_t>(maxX)-minX) / CellSize + 1;
+		uint64_t rows = (static_cast<int64_t>(maxY)-minY) / CellSize + 1;
+		if (cols*rows > MaxCells) {
+			std::stringstream msg;
+			msg <<"Map's tiles are spread too far apart to index (" <<cols <<"x" <<rows <<" cells): " <<outFile;
+			throw std::runtime_error(msg.str());
+		}
+		grid.originX = minX;
+		grid.originY = minY;
+		grid.cols = cols;
+		grid.rows = rows;
+	}
+
+	//Bucket the tiles by cell (a counting sort, so each cell's tiles stay in drawing order).
+	std::vector<uint32_t> cellStarts(grid.cols*grid.rows+1, 0);
+	std::vector<uint32_t> cellItems(tiles.size());
+	for (const Tile& tile : tiles) {
+		cellStarts[CellOf(tile.y, grid.originY)*grid.cols + CellOf(tile.x, grid.originX) + 1]++;
+	}
+	for (size_t i=1; i<cellStarts.size(); i++) {
+		cellStarts[i] += cellStarts[i-1];
+	}
+	{
+	std::vector<uint32_t> next(cellStarts.begin(), cellStarts.end()-1);
+	for (size_t i=0; i<tiles.size(); i++) {
+		cellItems[next[CellOf(tiles[i].y, grid.originY)*grid.cols + CellOf(tiles[i].x, grid.originX)]++] = i;
+	}
+	}
+
+	//The ground layer, and everything else (as JSON), go in the map's own file.
+	Layer layer = whole ? map.layer : Layer();
+	layer.tileset = strings.intern(whole ? map.tileset : "");
+	const std::vector<uint16_t> noLayerTiles;
+	Json::FastWriter writer;
+
+	//Lay it all out.
+	Header head = Header();
+	std::copy(Magic, Magic+4, head.magic);
+	head.version = Version;
+	head.extra = strings.intern(writer.write(whole ? map.rest : Json::Value(Json::objectValue)));
+	head.grid = grid;
+	head.source = whole ? map.source : SourceStamp();
+	head.tileHash = whole ? TileHash(map) : 0;
+	std::vector<char> out(sizeof(Header), '\0');
+	head.strings = Append(out, strings.offsets);
+	head.stringData = Append(out, strings.data);
+	head.tileTypes = Append(out, types);
+	head.tiles = Append(out, tiles);
+	head.cellStarts = Append(out, cellStarts);
+	head.cellItems = Append(out, cellItems);
+	head.layer = layer;
+	head.layerTiles = Append(out, whole ? map.layerTiles : noLayerTiles);
+	head.tileOrder = Append(out, tileOrder);
+	head.fileSize = out.size();
+	std::copy(reinterpret_cast<const char*>(&head), reinterpret_cast<const char*>(&head)+sizeof(head), out.begin());
+
+	//Write it to a temporary file and rename it, so a running game never maps half a file.
+	std::string tempPath = outFile + ".tmp";
+	{
+	std::ofstream file(tempPath.c_str(), std::ios::binary|std::ios::trunc);
+	file.write(out.data(), out.size());
+	if (!file) {
+		throw std::runtime_error("Can't write compiled map: " + tempPath);
+	}
+	}
+	if (std::rename(tempPath.c_str(), outFile.c_str())!=0) {
+		std::remove(tempPath.c_str());
+		throw std::runtime_error("Can't write compiled map: " + outFile);
+	}
+}
+
+} //End un-named namespace
+
+
+std::string mapfile::ReadLayer(const Json::Value& grid, Layer& layer, std::vector<uint16_t>& ids)
+{
+	ids.clear();
+	layer.originX = layer.originY = 0;
+	layer.tileSize = 0;
+	layer.cols = layer.rows = 0;
+	if (!grid.isObject() || grid["tileSize"].asInt()<=0 || grid["cols"].asInt()<=0 || grid["rows"].asInt()<=0) {
+		return "";
+	}
+
+	layer.originX = grid["x"].asInt();
+	layer.originY = grid["y"].asInt();
+	layer.tileSize = grid["tileSize"].asUInt();
+	layer.cols = grid["cols"].asUInt();
+	layer.rows = grid["rows"].asUInt();
+	ids.resize(size_t(layer.cols)*layer.rows, 0);
+
+	const Json::Value& data = grid["data"];
+	if (data.size()>ids.size()) {
+		std::cout <<"Warn: grid has " <<data.size() <<" tiles, but only room for " <<ids.size() <<"\n";
+	}
+	for (unsigned int i=0; i<data.size() && i<ids.size(); i++) {
+		unsigned int id = data[i].asUInt();
+		if (id>std::numeric_limits<uint16_t>::max()) {
+			std::cout <<"Warn: grid tile id out of range: " <<id <<"\n";
+			continue;
+		}
+		ids[i] = id;
+	}
+	return grid["tileset"].asString();
+}
+
+
+uint64_t mapfile::TileHash(const MapData& map)
+{
+	//Strings are hashed with their terminators, so that neighbours can't run together.
+	uint64_t res = hash::FnvOffset;
+	for (const auto& tt : map.tileTypes) {
+		res = hash::Fnv1a(tt.first.c_str(), tt.first.size()+1, res);
+		res = hash::Fnv1a(tt.second.c_str(), tt.second.size()+1, res);
+	}
+
+	//Tiles by name, since names are numbered in the order they're read.
+	for (const MapTile& tile : map.tiles) {
+		const std::string& name = map.tileNames[tile.name];
+		res = hash::Fnv1a(name.c_str(), name.size()+1, res);
+		res = hash::Fnv1a(&tile.x, sizeof(tile.x), res);
+		res = hash::Fnv1a(&tile.y, sizeof(tile.y), res);
+	}
+
+	const int32_t layer[] = {map.layer.originX, map.layer.originY};
+	const uint32_t size[] = {map.layer.tileSize, map.layer.cols, map.layer.rows};
+	res = hash::Fnv1a(layer, sizeof(layer), res);
+	res = hash::Fnv1a(size, sizeof(size), res);
+	res = hash::Fnv1a(map.tileset.c_str(), map.tileset.size()+1, res);
+	res = hash::Fnv1a(map.layerTiles.data(), map.layerTiles.size()*sizeof(uint16_t), res);
+
+	Json::FastWriter writer;
+	return hash::Fnv1a(writer.write(map.rest["streaming"]), res);
+}
+
+
+std::string mapfile::CompiledPath(const std::string& jsonFile)
+{
+	size_t dot = jsonFile.rfind('.');
+	size_t sl = jsonFile.rfind('/');
+	if (dot==std::string::npos || (sl!=std::string::npos && dot<sl)) {
+		return jsonFile + ".pmap";
+	}
+	return jsonFile.substr(0, dot) + ".pmap";
+}
+
+
+std::string mapfile::ChunkDir(const std::string& binFile)
+{
+	return binFile + ".chunks";
+}
+
+
+std::string mapfile::ChunkPath(const std::string& chunkDir, int cx, int cy)
+{
+	std::stringstream res;
+	res <<chunkDir <<"/" <<cx <<"_" <<cy <<".pmap";
+	return res.str();
+}
+
+
+void mapfile::Compile(const Json::Value& root, const std::string& outFile)
+{
+	MapData map;
+	FromJson(root, map);
+	Compile(map, outFile);
+}
+
+
+void mapfile::Compile(const MapData& map, const std::string& outFile)
+{
+	//Normal maps are compiled into one file.
+	int chunkSize = map.rest["streaming"]["chunkSize"].asInt();
+	if (chunkSize<=0) {
+		CompileOne(map, map.tiles, std::vector<uint32_t>(), true, outFile);
+		return;
+	}
+
+	//Streamed maps put their tiles in one file per chunk (each with the full list of tile types, so ids
+	// match), and keep everything else in the map's own file. Old chunks are removed first.
+	//The ground layer stays in the map's own file: at two bytes per square, it's cheap to map in full.
+	namespace fs = boost::filesystem;
+	std::string dir = ChunkDir(outFile);
+	boost::system::error_code err;
+	fs::remove_all(dir, err);
+	fs::create_directories(dir, err);
+	if (err) {
+		throw std::runtime_error("Can't create chunk directory: " + dir);
+	}
+
+	//Each chunk's tiles, and their indices in the whole map (their drawing order across chunks).
+	std::map<std::pair<int, int>, std::pair<std::vector<MapTile>, std::vector<uint32_t>>> chunks;
+	for (size_t i=0; i<map.tiles.size(); i++) {
+		const MapTile& tile = map.tiles[i];
+		int cx = static_cast<int>(std::floor(static_cast<double>(tile.x) / chunkSize));
+		int cy = static_cast<int>(std::floor(static_cast<double>(tile.y) / chunkSize));
+		auto& chunk = chunks[std::make_pair(cx, cy)];
+		chunk.first.push_back(tile);
+		chunk.second.push_back(i);
+	}
+	for (const auto& chunk : chunks) {
+		CompileOne(map, chunk.second.first, chunk.second.second, false, ChunkPath(dir, chunk.first.first, chunk.first.second));
+	}
+
+	//The map itself goes last (it's the file that's checked to see if we're out of date).
+	CompileOne(map, std::vector<MapTile>(), std::vector<uint32_t>(), true, outFile);
+}
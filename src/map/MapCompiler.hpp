@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <jsoncpp/json/json.h>
+
+#include "map/MapFormat.hpp"
+
+
+namespace mapfile {
+
+struct MapData;
+
+///Compile a (parsed) map into its binary form (see MapFormat.hpp) and write it to "outFile".
+/// Tiles of an unknown type are skipped, with a warning. Throws std::runtime_error if the file can't be written.
+///If the map has "streaming": {"chunkSize": N}, its tiles are split into N-by-N pixel chunks, each compiled
+/// into its own file (see ChunkPath()), and "outFile" holds everything else (see ChunkStreamer).
+void Compile(const Json::Value& root, const std::string& outFile);
+
+///The same, for a map read with ReadMapFile() (see MapReader.hpp), which never builds a JSON tree of its tiles.
+void Compile(const MapData& map, const std::string& outFile);
+
+///A hash of everything in "map" that its compiled tiles, tile types, ground layer and chunks are built from
+/// (but not the rest of its JSON). Maps that hash the same compile to the same tiles.
+uint64_t TileHash(const MapData& map);
+
+///Read a map's "grid" (its ground layer) into "layer" and "ids", and return its tileset (empty if there's none).
+/// "layer.tileset" is left alone. Ids past the end of "data" are empty; ids that don't fit in 16 bits are
+/// skipped, with a warning.
+std::string ReadLayer(const Json::Value& grid, Layer& layer, std::vector<uint16_t>& ids);
+
+///Where the compiled form of "jsonFile" lives: next to it, with a ".pmap" extension.
+std::string CompiledPath(const std::string& jsonFile);
+
+///Where the chunks of a streamed map (compiled to "binFile") live.
+std::string ChunkDir(const std::string& binFile);
+
+///The compiled form of chunk (cx,cy), covering [cx*chunkSize, (cx+1)*chunkSize) in x (similarly in y).
+std::string ChunkPath(const std::string& chunkDir, int cx, int cy);
+
+}
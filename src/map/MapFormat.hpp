@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+
+
+/**
+ * The compiled ("binary") form of a map_*.json file. Maps are authored as JSON, but parsing that
+ *   into a DOM and looking up every tile by name is slow for large maps. The map compiler (see
+ *   MapCompiler.hpp, and the "mapc" tool) flattens a map into this layout, which CompiledMap then
+ *   memory-maps and uses in place:
+ *    * Header, at offset 0.
+ *    * A string table: one offset per string, then all strings (null-terminated).
+ *    * Tile types ("tiles" in the JSON), with their names and files interned as string ids.
+ *    * Tiles ("tmap" in the JSON), in their original (drawing) order, referring to tile types by id.
+ *      The chunks of a streamed map also keep each tile's index in the whole map, so tiles from
+ *      different chunks can still be drawn in order.
+ *    * The ground layer ("grid" in the JSON), if any: one 16-bit tile id per grid square, row by row.
+ *    * A prebuilt spatial index: a uniform grid over tile positions, stored as one list of tile
+ *      indices per cell (each tile is in the cell containing its position).
+ *    * Everything else in the map (scripts, NPCs, etc.) as a JSON string; it's small.
+ * The header also stamps the JSON the map was compiled from (its size and modification time), so a
+ *   compiled map is re-built whenever its JSON changes, however soon after it was compiled, and a
+ *   hash of its tiles, so a reloaded map can tell whether they've changed without its JSON.
+ * Every section starts on a 4-byte boundary. Values are stored in native byte order, since
+ *   compiled maps are built on (and for) the machine that uses them.
+ */
+namespace mapfile {
+
+const char Magic[4] = {'P','M','A','P'};
+
+///Bump this whenever the layout changes; old files are then re-compiled.
+const uint32_t Version = 5;
+
+///Size (in pixels) of each spatial index cell.
+const uint32_t CellSize = 256;
+
+///Most cells (cols*rows) in a spatial index. Maps whose tiles are spread wider than this (e.g., one
+/// stray tile far from the rest) aren't compiled, rather than allocating a huge, mostly-empty index.
+const uint64_t MaxCells = 1<<22;
+
+///"count" items, starting "offset" bytes into the file.
+struct Section {
+	uint32_t offset;
+	uint32_t count;
+};
+
+///The spatial index's grid. Cell (cx,cy) covers [origin+cx*cellSize, origin+(cx+1)*cellSize) in x (similarly in y).
+struct Grid {
+	int32_t originX;
+	int32_t originY;
+	uint32_t cellSize;
+	uint32_t cols;
+	uint32_t rows;
+};
+
+///A dense layer of tiles, all cut from one image (the "tileset"). Square (col,row) is drawn at
+/// origin+(col,row)*tileSize, with tile id n being the n-th tileSize square of the tileset (counting
+/// from 1, left to right and then top to bottom). Id 0 is empty.
+struct Layer {
+	int32_t originX;
+	int32_t originY;
+	uint32_t tileSize;
+	uint32_t cols;
+	uint32_t rows;
+	uint32_t tileset;   //String id of the tileset's file, relative to the map ("" if there's no layer).
+};
+
+///A source file's size and modification time (in nanoseconds since the epoch, where the file system
+/// keeps them). All zeroes if there's no file.
+struct SourceStamp {
+	uint64_t size;
+	int64_t mtimeNs;
+};
+
+struct Header {
+	char magic[4];
+	uint32_t version;
+	uint32_t fileSize;
+	uint32_t extra;         //String id of the rest of the map, as JSON.
+	Section strings;        //uint32_t offsets into stringData.
+	Section stringData;     //chars.
+	Section tileTypes;      //TileType
+	Section tiles;          //Tile
+	Grid grid;
+	Section cellStarts;     //uint32_t, cols*rows+1 of them: cell i holds cellItems[cellStarts[i] .. cellStarts[i+1]).
+	Section cellItems;      //uint32_t tile indices, ascending within each cell.
+	Layer layer;
+	Section layerTiles;     //uint16_t, cols*rows of them, row-major.
+	SourceStamp source;     //The JSON this was compiled from, as it was then (all zeroes for chunks).
+	uint64_t tileHash;      //TileHash() of the map this was compiled from (zero for chunks).
+	Section tileOrder;      //uint32_t, one per tile: its index in the whole map's "tmap" (chunks only; empty otherwise).
+};
+
+///A texture that tiles can use. Both are string ids; "file" is relative to the map.
+struct TileType {
+	uint32_t name;
+	uint32_t file;
+};
+
+///One placed tile.
+struct Tile {
+	uint32_t type;
+	int32_t x;
+	int32_t y;
+};
+
+}
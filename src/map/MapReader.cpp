@@ -0,0 +1,304 @@
+#include "MapReader.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#include "map/MapCompiler.hpp"
+#include "platform/MappedFile.hpp"
+#include "util/JsonEventReader.hpp"
+
+#if defined(unix) || defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#define PORTENTIA_STAT
+#else
+#include <boost/filesystem.hpp>
+#endif
+
+
+namespace {
+typedef JsonEventReader::Event Event;
+
+///Intern a tile type's name (as used in "tmap").
+uint32_t NameId(mapfile::MapData& res, std::map<std::string, uint32_t>& ids, const std::string& name)
+{
+	auto it = ids.find(name);
+	if (it!=ids.end()) { return it->second; }
+	uint32_t id = res.tileNames.size();
+	res.tileNames.push_back(name);
+	ids[name] = id;
+	return id;
+}
+
+
+///Build the JSON value starting with "ev" (for the small parts of a map).
+Json::Value ReadValue(JsonEventReader& in, Event ev)
+{
+	switch (ev) {
+		case Event::BeginObject: {
+			Json::Value res(Json::objectValue);
+			for (Event e=in.next(); e!=Event::EndObject; e=in.next()) {
+				std::string key = in.string();
+				res[key] = ReadValue(in, in.next());
+			}
+			return res;
+		}
+		case Event::BeginArray: {
+			Json::Value res(Json::arrayValue);
+			for (Event e=in.next(); e!=Event::EndArray; e=in.next()) {
+				res.append(ReadValue(in, e));
+			}
+			return res;
+		}
+		case Event::String:
+			return Json::Value(in.string());
+		case Event::Number: {
+			//Type numbers by how they're written, exactly as JsonCpp does: integers are ints (or unsigned, if
+			// they only fit that way) unless they overflow 64 bits, and anything else is a real (so 1e3 is too).
+			const char* text = in.numberText();
+			if (!std::strpbrk(text+1, ".eE+-") && text[0]!='.' && text[0]!='+') {
+				char* stop = nullptr;
+				errno = 0;
+				if (text[0]=='-') {
+					long long num = std::strtoll(text, &stop, 10);
+					if (errno==0 && *stop=='\0') { return Json::Value(static_cast<Json::Int64>(num)); }
+				} else {
+					unsigned long long num = std::strtoull(text, &stop, 10);
+					if (errno==0 && *stop=='\0') {
+						if (num<=static_cast<unsigned long long>(std::numeric_limits<Json::Int>::max())) {
+							return Json::Value(static_cast<Json::Int64>(num));
+						}
+						return Json::Value(static_cast<Json::UInt64>(num));
+					}
+				}
+			}
+			return Json::Value(in.number());
+		}
+		case Event::Bool:
+			return Json::Value(in.boolean());
+		default:
+			return Json::Value();
+	}
+}
+
+
+///"tiles": {name: file, ...}
+void ReadTileTypes(JsonEventReader& in, Event ev, mapfile::MapData& res)
+{
+	if (ev!=Event::BeginObject) {
+		in.skip(ev);
+		return;
+	}
+	for (Event e=in.next(); e!=Event::EndObject; e=in.next()) {
+		std::string name = in.string();
+		Json::Value file = ReadValue(in, in.next());
+		res.tileTypes[name] = file.isString() ? file.asString() : "";
+	}
+}
+
+
+///"tmap": [{"tile":name, "x":x, "y":y}, ...]
+void ReadTiles(JsonEventReader& in, Event ev, mapfile::MapData& res, std::map<std::string, uint32_t>& names)
+{
+	if (ev!=Event::BeginArray) {
+		in.skip(ev);
+		return;
+	}
+
+	size_t start = in.offset();
+	for (Event item=in.next(); item!=Event::EndArray; item=in.next()) {
+		if (item!=Event::BeginObject) {
+			in.skip(item);
+			continue;
+		}
+
+		//Anything besides "tile", "x" and "y" is ignored. Tiles without all three are skipped.
+		mapfile::MapTile tile;
+		bool hasTile = false, hasX = false, hasY = false;
+		for (Event e=in.next(); e!=Event::EndObject; e=in.next()) {
+			bool isTile = in.string()=="tile";
+			bool isX = in.string()=="x";
+			bool isY = in.string()=="y";
+			Event val = in.next();
+			if (isTile && val==Event::String) {
+				tile.name = NameId(res, names, in.string());
+				hasTile = true;
+			} else if ((isX || isY) && val==Event::Number) {
+				(isX ? tile.x : tile.y) = static_cast<int32_t>(in.number());
+				(isX ? hasX : hasY) = true;
+			} else {
+				in.skip(val);
+			}
+		}
+		if (hasTile && hasX && hasY) {
+			res.tiles.push_back(tile);
+		}
+
+		//Once we've read one tile, guess how many there are from how long it was, and make room for them all.
+		if (res.tiles.size()==1) {
+			size_t perTile = std::max(size_t(1), in.offset()-start);
+			res.tiles.reserve((in.size()-start)/perTile + 1);
+		}
+	}
+}
+
+
+///"grid": {"tileset":file, "tileSize":n, "x":x, "y":y, "cols":n, "rows":n, "data":[id, ...]}
+/// Follows the same rules as mapfile::ReadLayer().
+void ReadGrid(JsonEventReader& in, Event ev, mapfile::MapData& res)
+{
+	if (ev!=Event::BeginObject) {
+		in.skip(ev);
+		return;
+	}
+
+	int tileSize = 0, cols = 0, rows = 0;
+	int x = 0, y = 0;
+	for (Event e=in.next(); e!=Event::EndObject; e=in.next()) {
+		std::string key = in.string();
+		Event val = in.next();
+		if (key=="data" && val==Event::BeginArray) {
+			if (cols>0 && rows>0) {
+				res.layerTiles.reserve(size_t(cols)*rows);
+			}
+			for (Event id=in.next(); id!=Event::EndArray; id=in.next()) {
+				double num = id==Event::Number ? in.number() : 0;
+				if (num<0 || num>std::numeric_limits<uint16_t>::max()) {
+					std::cout <<"Warn: grid tile id out of range: " <<num <<"\n";
+					num = 0;
+				}
+				res.layerTiles.push_back(static_cast<uint16_t>(num));
+				in.skip(id);
+			}
+		} else if (key=="tileset" && val==Event::String) {
+			res.tileset = in.string();
+		} else if (val==Event::Number) {
+			int num = static_cast<int>(in.number());
+			if (key=="tileSize") { tileSize = num; }
+			if (key=="cols") { cols = num; }
+			if (key=="rows") { rows = num; }
+			if (key=="x") { x = num; }
+			if (key=="y") { y = num; }
+		} else {
+			in.skip(val);
+		}
+	}
+
+	if (tileSize<=0 || cols<=0 || rows<=0) {
+		res.tileset.clear();
+		res.layerTiles.clear();
+		return;
+	}
+	res.layer.originX = x;
+	res.layer.originY = y;
+	res.layer.tileSize = tileSize;
+	res.layer.cols = cols;
+	res.layer.rows = rows;
+	size_t size = size_t(cols)*rows;
+	if (res.layerTiles.size()>size) {
+		std::cout <<"Warn: grid has " <<res.layerTiles.size() <<" tiles, but only room for " <<size <<"\n";
+	}
+	res.layerTiles.resize(size, 0);
+}
+
+} //End un-named namespace
+
+
+void mapfile::ReadMapFile(const std::string& file, MapData& res)
+{
+	SourceStamp source = Stamp(file); //Before we read it, so a later save always looks newer.
+	platform::MappedFile mapped;
+	if (!mapped.open(file)) {
+		throw std::runtime_error("Can't load file; doesn't exist.");
+	}
+
+	res = MapData();
+	res.source = source;
+	JsonEventReader in(mapped.data(), mapped.data()+mapped.size());
+	if (in.next()!=Event::BeginObject) {
+		throw std::runtime_error("Map isn't a JSON object: " + file);
+	}
+
+	//The tile sections are read straight into arrays; everything else is small, and kept as JSON.
+	std::map<std::string, uint32_t> names;
+	for (Event e=in.next(); e!=Event::EndObject; e=in.next()) {
+		std::string key = in.string();
+		Event val = in.next();
+		if (key=="tiles") {
+			ReadTileTypes(in, val, res);
+		} else if (key=="tmap") {
+			ReadTiles(in, val, res, names);
+		} else if (key=="grid") {
+			ReadGrid(in, val, res);
+		} else {
+			res.rest[key] = ReadValue(in, val);
+		}
+	}
+	in.next(); //Nothing may follow.
+}
+
+
+void mapfile::FromJson(const Json::Value& root, MapData& res)
+{
+	res = MapData();
+
+	const Json::Value& ts = root["tiles"];
+	if (ts.isObject()) {
+		for (const std::string& key : ts.getMemberNames()) {
+			res.tileTypes[key] = ts[key].asString();
+		}
+	}
+
+	std::map<std::string, uint32_t> names;
+	const Json::Value& tm = root["tmap"];
+	if (tm.isArray()) {
+		res.tiles.reserve(tm.size());
+		for (unsigned int i=0; i<tm.size(); i++) {
+			const Json::Value& item = tm[i];
+			if (!item.isObject() || !(item.isMember("tile") && item.isMember("x") && item.isMember("y"))) { continue; }
+			MapTile tile;
+			tile.name = NameId(res, names, item["tile"].asString());
+			tile.x = item["x"].asInt();
+			tile.y = item["y"].asInt();
+			res.tiles.push_back(tile);
+		}
+	}
+
+	res.tileset = ReadLayer(root["grid"], res.layer, res.layerTiles);
+
+	res.rest = root;
+	res.rest.removeMember("tiles");
+	res.rest.removeMember("tmap");
+	res.rest.removeMember("grid");
+}
+
+
+mapfile::SourceStamp mapfile::Stamp(const std::string& file)
+{
+	SourceStamp res = SourceStamp();
+#ifdef PORTENTIA_STAT
+	struct stat st;
+	if (stat(file.c_str(), &st)!=0) { return res; }
+	res.size = st.st_size;
+#ifdef __APPLE__
+	res.mtimeNs = static_cast<int64_t>(st.st_mtimespec.tv_sec)*1000000000 + st.st_mtimespec.tv_nsec;
+#else
+	res.mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec)*1000000000 + st.st_mtim.tv_nsec;
+#endif
+#else
+	//Only to the second, but the size usually changes too.
+	namespace fs = boost::filesystem;
+	boost::system::error_code err;
+	uintmax_t size = fs::file_size(file, err);
+	if (err) { return res; }
+	std::time_t time = fs::last_write_time(file, err);
+	if (err) { return res; }
+	res.size = size;
+	res.mtimeNs = static_cast<int64_t>(time)*1000000000;
+#endif
+	return res;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <jsoncpp/json/json.h>
+
+#include "map/MapFormat.hpp"
+
+
+namespace mapfile {
+
+///One tile from a map's "tmap". Its type is given by name, as an index into MapData::tileNames.
+struct MapTile {
+	uint32_t name;
+	int32_t x;
+	int32_t y;
+};
+
+///A map's contents, ready to compile. Tiles are kept in flat arrays; only the (small) rest of the map is JSON.
+struct MapData {
+	std::map<std::string, std::string> tileTypes; //"tiles": name -> file.
+	std::vector<std::string> tileNames;           //Every tile type named in "tmap" (once each).
+	std::vector<MapTile> tiles;                   //"tmap", in order.
+
+	Layer layer;                                  //"grid", if any (layer.tileset is unused).
+	std::string tileset;
+	std::vector<uint16_t> layerTiles;
+
+	Json::Value rest;                             //Everything else, as JSON.
+
+	SourceStamp source;                           //The file it was read from (see Stamp()), if any.
+
+	MapData() : layer(Layer()), rest(Json::objectValue), source(SourceStamp()) {}
+};
+
+///Read the map in "file" into "res" as it's parsed, without ever building a JSON tree of its tiles
+/// (or holding the whole file in memory; it's mapped). Space for the tiles is reserved up front, from
+/// the size of the file. Throws std::runtime_error if the file can't be read or isn't valid JSON.
+void ReadMapFile(const std::string& file, MapData& res);
+
+///The same, for a map that's already been parsed (e.g., a hot-reloaded one). "res.source" is left empty.
+void FromJson(const Json::Value& root, MapData& res);
+
+///The size and modification time of "file", as compiled maps record them (all zeroes if it doesn't exist).
+SourceStamp Stamp(const std::string& file);
+
+}
@@ -0,0 +1,125 @@
+#include "TileGrid.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+#include "core/Profiler.hpp"
+
+
+TileGrid::TileGrid() : layer(mapfile::Layer()), ids(nullptr), builtTex(nullptr), verts(sf::Quads)
+{
+}
+
+
+void TileGrid::assign(const mapfile::Layer& layer, std::vector<uint16_t>& ids)
+{
+	clear();
+	this->layer = layer;
+	owned.swap(ids);
+	this->ids = owned.data();
+}
+
+
+void TileGrid::view(const mapfile::Layer& layer, const uint16_t* ids)
+{
+	clear();
+	this->layer = layer;
+	this->ids = ids;
+}
+
+
+void TileGrid::clear()
+{
+	layer = mapfile::Layer();
+	owned.clear();
+	ids = nullptr;
+	built = sf::IntRect();
+	builtTex = nullptr;
+	verts.clear();
+}
+
+
+void TileGrid::setTileset(const AssetManager::TextureHandle& tileset)
+{
+	this->tileset = tileset;
+	builtTex = nullptr;
+	verts.clear();
+}
+
+
+uint16_t TileGrid::at(int col, int row) const
+{
+	if (col<0 || row<0 || col>=static_cast<int>(layer.cols) || row>=static_cast<int>(layer.rows)) {
+		return 0;
+	}
+	return ids[size_t(row)*layer.cols + col];
+}
+
+
+uint16_t TileGrid::tileAt(float x, float y) const
+{
+	if (empty()) { return 0; }
+	return at(static_cast<int>(std::floor((x-layer.originX)/layer.tileSize)), static_cast<int>(std::floor((y-layer.originY)/layer.tileSize)));
+}
+
+
+void TileGrid::setVisible(float left, float top, float right, float bottom)
+{
+	if (empty() || !tileset.valid()) { return; }
+
+	//The squares in view, clamped to the grid.
+	int minCol = std::max(0, static_cast<int>(std::floor((left-layer.originX)/layer.tileSize)));
+	int minRow = std::max(0, static_cast<int>(std::floor((top-layer.originY)/layer.tileSize)));
+	int maxCol = std::min(static_cast<int>(layer.cols)-1, static_cast<int>(std::floor((right-layer.originX)/layer.tileSize)));
+	int maxRow = std::min(static_cast<int>(layer.rows)-1, static_cast<int>(std::floor((bottom-layer.originY)/layer.tileSize)));
+	sf::IntRect visible(minCol, minRow, std::max(0, maxCol-minCol+1), std::max(0, maxRow-minRow+1));
+
+	//Most frames, the view is still over the same squares.
+	const sf::Texture& tex = tileset.get();
+	if (visible==built && &tex==builtTex && tex.getSize()==builtTexSize) { return; }
+	built = visible;
+	builtTex = &tex;
+	builtTexSize = tex.getSize();
+	rebuild();
+}
+
+
+void TileGrid::rebuild()
+{
+	PROFILE_SCOPE("TileGrid::rebuild");
+	verts.clear();
+
+	//Until the tileset loads, every tile shows its placeholder (in full).
+	const float size = layer.tileSize;
+	unsigned int atlasCols = tileset.ready() ? builtTexSize.x/layer.tileSize : 1;
+	unsigned int atlasRows = tileset.ready() ? builtTexSize.y/layer.tileSize : 1;
+	sf::Vector2f texSize = tileset.ready() ? sf::Vector2f(size, size) : sf::Vector2f(builtTexSize.x, builtTexSize.y);
+
+	for (int row=built.top; row<built.top+built.height; row++) {
+		const uint16_t* line = ids + size_t(row)*layer.cols;
+		float y = layer.originY + row*size;
+		for (int col=built.left; col<built.left+built.width; col++) {
+			//Skip empty squares, and ids that aren't in the tileset.
+			unsigned int id = line[col];
+			if (id==0) { continue; }
+			id = tileset.ready() ? id-1 : 0;
+			if (id>=atlasCols*atlasRows) { continue; }
+
+			float x = layer.originX + col*size;
+			float tx = (id%atlasCols) * texSize.x;
+			float ty = (id/atlasCols) * texSize.y;
+			verts.append(sf::Vertex(sf::Vector2f(x, y), sf::Vector2f(tx, ty)));
+			verts.append(sf::Vertex(sf::Vector2f(x+size, y), sf::Vector2f(tx+texSize.x, ty)));
+			verts.append(sf::Vertex(sf::Vector2f(x+size, y+size), sf::Vector2f(tx+texSize.x, ty+texSize.y)));
+			verts.append(sf::Vertex(sf::Vector2f(x, y+size), sf::Vector2f(tx, ty+texSize.y)));
+		}
+	}
+}
+
+
+void TileGrid::draw(sf::RenderTarget& target, sf::RenderStates states) const
+{
+	if (verts.getVertexCount()==0) { return; }
+	states.texture = builtTex;
+	target.draw(verts, states);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <SFML/Graphics.hpp>
+
+#include "map/MapFormat.hpp"
+#include "core/AssetManager.hpp"
+
+
+/**
+ * A dense tile layer (see mapfile::Layer): one 16-bit tile id per grid square, row by row, with every
+ *   tile cut from one tileset texture. At two bytes per square, this is far smaller than placing each
+ *   tile on its own, and the tiles in a rectangle (or under a point) are found by arithmetic.
+ *
+ * Nothing is kept per tile besides its id. Vertices are only built for the squares in view, and only
+ *   re-built when the view moves onto different squares (or the tileset finishes loading), so the
+ *   whole visible layer is drawn in one call.
+ *
+ * The ids are either owned (loaded from JSON) or point into a compiled map, which must then outlive the grid.
+ */
+class TileGrid : public sf::Drawable {
+public:
+	TileGrid();
+
+	///Use (and own) "ids", laid out as "layer" says.
+	void assign(const mapfile::Layer& layer, std::vector<uint16_t>& ids);
+
+	///Use "ids" in place (e.g., from a CompiledMap).
+	void view(const mapfile::Layer& layer, const uint16_t* ids);
+
+	void clear();
+	bool empty() const { return layer.cols==0 || layer.rows==0; }
+
+	void setTileset(const AssetManager::TextureHandle& tileset);
+	const AssetManager::TextureHandle& getTileset() const { return tileset; }
+
+	///The id at square (col,row), or 0 (empty) if that's off the grid.
+	uint16_t at(int col, int row) const;
+
+	///The id of the tile under pixel (x,y), or 0 if there's none. Useful for collision.
+	uint16_t tileAt(float x, float y) const;
+
+	///Prepare to draw the squares overlapping [left,right] x [top,bottom]. Call before each draw.
+	void setVisible(float left, float top, float right, float bottom);
+
+	const mapfile::Layer& getLayer() const { return layer; }
+
+protected:
+	virtual void draw(sf::RenderTarget& target, sf::RenderStates states) const;
+
+private:
+	void rebuild();
+
+	mapfile::Layer layer;
+	std::vector<uint16_t> owned;
+	const uint16_t* ids;
+	AssetManager::TextureHandle tileset;
+
+	//The squares we last built vertices for, and the texture (and its size) we built them for.
+	sf::IntRect built;
+	const sf::Texture* builtTex;
+	sf::Vector2u builtTexSize;
+	sf::VertexArray verts;
+};
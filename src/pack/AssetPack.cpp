@@ -0,0 +1,211 @@
+#include "AssetPack.hpp"
+
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <boost/filesystem.hpp>
+
+#include "pack/PackFormat.hpp"
+#include "platform/MappedFile.hpp"
+#include "util/Hash.hpp"
+
+
+namespace {
+namespace fs = boost::filesystem;
+
+///The mounted pack.
+struct Pack {
+	platform::MappedFile file;
+	const packfile::Header* head;
+	const char* names;
+	const packfile::Entry* entries;
+	const uint32_t* slots;
+
+	fs::path workDir;                  //Relative paths are relative to this.
+	std::vector<std::string> baseDir;  //The pack's directory, split into parts.
+
+	Pack() : head(nullptr), names(nullptr), entries(nullptr), slots(nullptr) {}
+} mounted;
+
+
+///"path" split into parts, made absolute, with "." and ".." resolved (without touching the disk).
+std::vector<std::string> SplitPath(const fs::path& path)
+{
+	std::vector<std::string> res;
+	fs::path full = path.is_absolute() ? path : mounted.workDir/path;
+	for (const fs::path& part : full.relative_path()) {
+		std::string name = part.string();
+		if (name.empty() || name==".") { continue; }
+		if (name=="..") {
+			if (!res.empty()) { res.pop_back(); }
+			continue;
+		}
+		res.push_back(name);
+	}
+	return res;
+}
+
+
+///"path" as named in the pack (relative to its directory, with '/' separators; "" for the directory
+/// itself). False if it's outside of it.
+bool PackName(const std::string& path, std::string& res)
+{
+	std::vector<std::string> parts = SplitPath(path);
+	const std::vector<std::string>& base = mounted.baseDir;
+	if (parts.size()<base.size() || !std::equal(base.begin(), base.end(), parts.begin())) { return false; }
+
+	res.clear();
+	for (size_t i=base.size(); i<parts.size(); i++) {
+		if (!res.empty()) { res += "/"; }
+		res += parts[i];
+	}
+	return true;
+}
+
+
+template <class T>
+const T* Section(const packfile::Section& sect)
+{
+	//Must be aligned (to 8 bytes, even for smaller types), and fit in the file.
+	const platform::MappedFile& file = mounted.file;
+	if (sect.offset%8!=0 || sect.offset>file.size() || sect.count>(file.size()-sect.offset)/sizeof(T)) {
+		return nullptr;
+	}
+	return reinterpret_cast<const T*>(file.data()+sect.offset);
+}
+
+
+///Every section must be present, and every name, file and slot in range (so that lookups needn't check).
+bool Validate()
+{
+	const platform::MappedFile& file = mounted.file;
+	if (file.size()<sizeof(packfile::Header)) { return false; }
+	const packfile::Header& h = *reinterpret_cast<const packfile::Header*>(file.data());
+	if (!std::equal(packfile::Magic, packfile::Magic+4, h.magic) || h.version!=packfile::Version || h.fileSize!=file.size()) { return false; }
+
+	mounted.head = &h;
+	mounted.names = Section<char>(h.names);
+	mounted.entries = Section<packfile::Entry>(h.entries);
+	mounted.slots = Section<uint32_t>(h.slots);
+	if (!mounted.names || !mounted.entries || !mounted.slots) { return false; }
+
+	for (uint64_t i=0; i<h.entries.count; i++) {
+		const packfile::Entry& e = mounted.entries[i];
+		if (e.offset>file.size() || e.size>file.size()-e.offset) { return false; }
+		if (e.name>=h.names.count || e.nameLength>=h.names.count-e.name || mounted.names[e.name+e.nameLength]!='\0') { return false; }
+	}
+
+	//A power of two in size, with at least one empty slot (so that probing always stops).
+	if (h.slots.count==0 || (h.slots.count&(h.slots.count-1))!=0 || h.slots.count<=h.entries.count) { return false; }
+	for (uint64_t i=0; i<h.slots.count; i++) {
+		if (mounted.slots[i]>h.entries.count) { return false; }
+	}
+	return true;
+}
+
+
+///The entry named "name", or null.
+const packfile::Entry* Lookup(const std::string& name)
+{
+	uint64_t key = hash::Fnv1a(name);
+	uint64_t mask = mounted.head->slots.count-1;
+	for (uint64_t slot=key&mask; mounted.slots[slot]!=0; slot=(slot+1)&mask) {
+		const packfile::Entry& e = mounted.entries[mounted.slots[slot]-1];
+		if (e.hash==key && e.nameLength==name.size() && std::memcmp(mounted.names+e.name, name.data(), name.size())==0) {
+			return &e;
+		}
+	}
+	return nullptr;
+}
+
+} //End un-named namespace
+
+
+bool pack::Mount(const std::string& file)
+{
+	Unmount();
+
+	//Open the pack itself from disk (not from the pack).
+	platform::MappedFile& mapped = mounted.file;
+	if (!mapped.open(file)) { return false; }
+	if (!Validate()) {
+		std::cout <<"Warn: asset pack is corrupt, or from another version; ignoring it: " <<file <<"\n";
+		Unmount();
+		return false;
+	}
+
+	boost::system::error_code err;
+	mounted.workDir = fs::current_path(err);
+	fs::path dir = fs::canonical(file, err).parent_path();
+	if (err) {
+		Unmount();
+		return false;
+	}
+	mounted.baseDir = SplitPath(dir);
+	return true;
+}
+
+
+void pack::Unmount()
+{
+	mounted.head = nullptr;
+	mounted.names = nullptr;
+	mounted.entries = nullptr;
+	mounted.slots = nullptr;
+	mounted.baseDir.clear();
+	mounted.file.close();
+}
+
+
+bool pack::IsMounted()
+{
+	return mounted.head!=nullptr;
+}
+
+
+bool pack::Find(const std::string& path, const char*& data, size_t& size)
+{
+	std::string name;
+	if (!IsMounted() || !PackName(path, name)) { return false; }
+	const packfile::Entry* e = Lookup(name);
+	if (!e) { return false; }
+
+	data = mounted.file.data()+e->offset;
+	size = e->size;
+	return true;
+}
+
+
+bool pack::Contains(const std::string& path)
+{
+	const char* data;
+	size_t size;
+	return Find(path, data, size);
+}
+
+
+std::string pack::Absolute(const std::string& path)
+{
+	if (!IsMounted()) { return path; }
+	fs::path res = fs::path(path).is_absolute() ? fs::path(path).root_path() : mounted.workDir.root_path();
+	for (const std::string& part : SplitPath(path)) {
+		res /= part;
+	}
+	return res.string();
+}
+
+
+void pack::List(const std::string& dir, std::vector<std::string>& res)
+{
+	std::string prefix;
+	if (!IsMounted() || !PackName(dir, prefix)) { return; }
+	if (!prefix.empty()) { prefix += "/"; }
+
+	for (uint64_t i=0; i<mounted.head->entries.count; i++) {
+		const packfile::Entry& e = mounted.entries[i];
+		std::string name(mounted.names+e.name, e.nameLength);
+		if (name.compare(0, prefix.size(), prefix)!=0 || name.find('/', prefix.size())!=std::string::npos) { continue; }
+		//Joined the way directory_iterator joins them (so "script/" doesn't give "script//a.lua").
+		res.push_back((fs::path(dir)/name.substr(prefix.size())).string());
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+
+/**
+ * The mounted asset pack (see PackFormat.hpp), if any. The pack is memory-mapped, and files in it are
+ *   handed out as views straight into the mapping: platform::MappedFile checks here first, so every
+ *   loader that reads through it (textures, fonts, scripts and maps) uses the pack without copying.
+ *   Anything not in the pack (or everything, if there's no pack, e.g. during development) is read
+ *   from loose files as usual.
+ *
+ * Paths are matched relative to the pack's directory, after resolving "." and "..", so "res/a.png",
+ *   "./res/a.png" and "/path/to/game/res/a.png" are all the same file.
+ *
+ * Mount (or unmount) before any other threads might load files; finding files is then thread-safe.
+ */
+namespace pack {
+
+///Map and validate "file", replacing any pack mounted before. Returns false (mounting nothing) if it
+/// is missing or corrupt.
+bool Mount(const std::string& file);
+void Unmount();
+bool IsMounted();
+
+///Find "path" in the pack. Returns false if it's not there (or there's no pack).
+bool Find(const std::string& path, const char*& data, size_t& size);
+bool Contains(const std::string& path);
+
+///"path" made absolute, with "." and ".." resolved, without touching the disk (for naming packed files,
+/// which can't be symlinks, in place of boost::filesystem::canonical()).
+std::string Absolute(const std::string& path);
+
+///Append the path of every packed file directly inside "dir" (as "dir/name", named as
+/// boost::filesystem::directory_iterator would name the loose file) to "res", sorted by name.
+void List(const std::string& dir, std::vector<std::string>& res);
+
+}
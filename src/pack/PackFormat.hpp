@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+
+/**
+ * An asset pack: every file the game loads (textures, fonts, maps, compiled maps and scripts) in one
+ *   file, so that starting the game opens (and maps) one file instead of hundreds. Built by the
+ *   "assetpack" tool; used through pack::Mount() (see AssetPack.hpp).
+ *    * Header, at offset 0.
+ *    * Each file's contents, starting on an Alignment boundary (so that, e.g., compiled maps can be
+ *      used in place).
+ *    * Names: each file's path, relative to the pack's directory, with '/' separators (null-terminated).
+ *    * Entries, sorted by name.
+ *    * A hash table of entries by name: open addressing with linear probing, a power of two in size,
+ *      and at most half full. Each slot holds an entry's index plus one (zero is empty).
+ * Values are stored in native byte order (like compiled maps).
+ */
+namespace packfile {
+
+const char Magic[4] = {'P','P','A','K'};
+
+///Bump this whenever the layout changes.
+const uint32_t Version = 1;
+
+///File contents start on a multiple of this many bytes.
+const uint64_t Alignment = 16;
+
+///The debug font, if one was packed (so that the game needn't go looking for one).
+const char MonoFont[] = "res/fonts/mono";
+
+///"count" items, starting "offset" bytes into the file.
+struct Section {
+	uint64_t offset;
+	uint64_t count;
+};
+
+struct Header {
+	char magic[4];
+	uint32_t version;
+	uint64_t fileSize;
+	Section names;   //chars.
+	Section entries; //Entry
+	Section slots;   //uint32_t
+};
+
+///One packed file.
+struct Entry {
+	uint64_t hash;       //Of its name (hash::Fnv1a).
+	uint64_t offset;     //Of its contents.
+	uint64_t size;
+	uint32_t name;       //Offset into names.
+	uint32_t nameLength;
+};
+
+}
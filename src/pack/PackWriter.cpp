@@ -0,0 +1,115 @@
+#include "PackWriter.hpp"
+
+#include <fstream>
+#include <cstdio>
+#include <algorithm>
+#include <stdexcept>
+
+#include "pack/PackFormat.hpp"
+#include "util/Hash.hpp"
+
+
+namespace {
+
+///Pad "out" with zeroes up to a multiple of "align".
+uint64_t Pad(std::ofstream& out, uint64_t pos, uint64_t align)
+{
+	while (pos%align!=0) {
+		out.put('\0');
+		pos++;
+	}
+	return pos;
+}
+
+///Write a section of "items" (8-byte aligned) at "pos", and return where it went.
+template <class T>
+packfile::Section Put(std::ofstream& out, uint64_t& pos, const std::vector<T>& items)
+{
+	pos = Pad(out, pos, 8);
+	packfile::Section res;
+	res.offset = pos;
+	res.count = items.size();
+	out.write(reinterpret_cast<const char*>(items.data()), items.size()*sizeof(T));
+	pos += items.size()*sizeof(T);
+	return res;
+}
+
+} //End un-named namespace
+
+
+void packfile::Write(const std::string& outFile, std::vector<Source> files)
+{
+	//Entries are sorted by name (so listing a directory is one pass).
+	std::sort(files.begin(), files.end());
+	for (size_t i=1; i<files.size(); i++) {
+		if (files[i].first==files[i-1].first) {
+			throw std::runtime_error("Two files packed as: " + files[i].first);
+		}
+	}
+
+	//Write it to a temporary file and rename it, so a running game never maps half a pack.
+	std::string tempPath = outFile + ".tmp";
+	std::ofstream out(tempPath.c_str(), std::ios::binary|std::ios::trunc);
+	Header head = Header();
+	out.write(reinterpret_cast<const char*>(&head), sizeof(head));
+	uint64_t pos = sizeof(head);
+
+	//Contents, one file at a time.
+	std::vector<Entry> entries;
+	std::vector<char> names;
+	std::vector<char> buffer(1<<16);
+	for (const Source& file : files) {
+		std::ifstream in(file.second.c_str(), std::ios::binary);
+		if (!in) {
+			throw std::runtime_error("Can't read file to pack: " + file.second);
+		}
+
+		Entry entry = Entry();
+		entry.hash = hash::Fnv1a(file.first);
+		entry.offset = pos = Pad(out, pos, Alignment);
+		while (in) {
+			in.read(buffer.data(), buffer.size());
+			out.write(buffer.data(), in.gcount());
+			entry.size += in.gcount();
+		}
+		pos += entry.size;
+
+		entry.name = names.size();
+		entry.nameLength = file.first.size();
+		names.insert(names.end(), file.first.begin(), file.first.end());
+		names.push_back('\0');
+		entries.push_back(entry);
+	}
+
+	//The hash table: at least twice as many slots as entries.
+	size_t numSlots = 1;
+	while (numSlots<entries.size()*2) {
+		numSlots *= 2;
+	}
+	std::vector<uint32_t> slots(numSlots, 0);
+	for (size_t i=0; i<entries.size(); i++) {
+		size_t slot = entries[i].hash & (numSlots-1);
+		while (slots[slot]!=0) {
+			slot = (slot+1) & (numSlots-1);
+		}
+		slots[slot] = i+1;
+	}
+
+	std::copy(Magic, Magic+4, head.magic);
+	head.version = Version;
+	head.names = Put(out, pos, names);
+	head.entries = Put(out, pos, entries);
+	head.slots = Put(out, pos, slots);
+	head.fileSize = pos;
+	out.seekp(0);
+	out.write(reinterpret_cast<const char*>(&head), sizeof(head));
+	out.close();
+	if (!out) {
+		std::remove(tempPath.c_str());
+		throw std::runtime_error("Can't write asset pack: " + tempPath);
+	}
+	if (std::rename(tempPath.c_str(), outFile.c_str())!=0) {
+		std::remove(tempPath.c_str());
+		throw std::runtime_error("Can't write asset pack: " + outFile);
+	}
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+
+
+namespace packfile {
+
+///A file to pack: the name it's found by (relative to the pack's directory, with '/' separators),
+/// and where to read it from now.
+typedef std::pair<std::string, std::string> Source;
+
+/**
+ * Write an asset pack (see PackFormat.hpp) holding each of "files" to "outFile". Files are copied
+ *   one at a time, so the whole pack is never held in memory. Throws if a file can't be read, or
+ *   if two files have the same name.
+ */
+void Write(const std::string& outFile, std::vector<Source> files);
+
+}
@@ -0,0 +1,133 @@
+#include "FileWatcher.hpp"
+
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
+
+#if defined(linux) || defined(__linux)
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#define PORTENTIA_INOTIFY
+#endif
+
+
+namespace {
+//After the first event, keep collecting for this long (so that one save is one change).
+const int CoalesceMs = 50;
+} //End un-named namespace
+
+
+#ifdef PORTENTIA_INOTIFY
+
+platform::FileWatcher::FileWatcher() : fd(inotify_init1(IN_NONBLOCK|IN_CLOEXEC))
+{
+}
+
+
+platform::FileWatcher::~FileWatcher()
+{
+	if (fd>=0) {
+		close(fd);
+	}
+}
+
+
+bool platform::FileWatcher::addOne(const std::string& dir)
+{
+	int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE|IN_MOVED_TO|IN_CREATE);
+	if (wd<0) { return false; }
+	dirs[wd] = dir;
+	return true;
+}
+
+
+bool platform::FileWatcher::addDirectory(const std::string& dir)
+{
+	namespace fs = boost::filesystem;
+	if (fd<0 || !addOne(dir)) { return false; }
+
+	boost::system::error_code err;
+	for (fs::recursive_directory_iterator it(dir, err), end; !err && it!=end; it.increment(err)) {
+		if (fs::is_directory(it->status())) {
+			addOne(it->path().string());
+		}
+	}
+	return true;
+}
+
+
+bool platform::FileWatcher::wait(std::vector<std::string>& changed, int timeoutMs)
+{
+	if (fd<0) {
+		boost::this_thread::sleep(boost::posix_time::milliseconds(timeoutMs));
+		return false;
+	}
+
+	size_t oldSize = changed.size();
+	pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	int timeout = timeoutMs;
+	while (poll(&pfd, 1, timeout)>0) {
+		alignas(inotify_event) char buf[4096];
+		ssize_t len = read(fd, buf, sizeof(buf));
+		for (ssize_t pos=0; pos<len; ) {
+			const inotify_event* ev = reinterpret_cast<const inotify_event*>(buf+pos);
+			pos += sizeof(inotify_event) + ev->len;
+
+			auto dir = dirs.find(ev->wd);
+			if (dir==dirs.end() || ev->len==0) { continue; }
+			std::string path = dir->second + "/" + ev->name;
+
+			//New directories are watched too; new files are reported when they're closed (or moved in).
+			if (ev->mask & IN_ISDIR) {
+				if (ev->mask & (IN_CREATE|IN_MOVED_TO)) {
+					addDirectory(path);
+				}
+			} else if (ev->mask & (IN_CLOSE_WRITE|IN_MOVED_TO)) {
+				if (std::find(changed.begin()+oldSize, changed.end(), path)==changed.end()) {
+					changed.push_back(path);
+				}
+			}
+		}
+
+		//Keep listening, briefly, for the rest of the burst.
+		timeout = CoalesceMs;
+	}
+
+	return changed.size()>oldSize;
+}
+
+#else
+
+platform::FileWatcher::FileWatcher() : fd(-1)
+{
+}
+
+
+platform::FileWatcher::~FileWatcher()
+{
+}
+
+
+bool platform::FileWatcher::addOne(const std::string& dir)
+{
+	return false;
+}
+
+
+bool platform::FileWatcher::addDirectory(const std::string& dir)
+{
+	return false;
+}
+
+
+bool platform::FileWatcher::wait(std::vector<std::string>& changed, int timeoutMs)
+{
+	boost::this_thread::sleep(boost::posix_time::milliseconds(timeoutMs));
+	return false;
+}
+
+#endif //PORTENTIA_INOTIFY
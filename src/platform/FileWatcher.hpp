@@ -0,0 +1,34 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+
+namespace platform {
+
+/**
+ * Reports files that have been written (or moved into place) under a set of directories.
+ * On Linux, this uses inotify; sub-directories are watched too, including new ones. On other
+ *   platforms, addDirectory() fails and wait() never reports anything.
+ */
+class FileWatcher {
+public:
+	FileWatcher();
+	~FileWatcher();
+
+	///Watch "dir" and everything under it. Returns false if it can't be watched.
+	bool addDirectory(const std::string& dir);
+
+	///Wait up to "timeoutMs" for changes, and append each changed file (once) to "changed".
+	/// Bursts of events (e.g., an editor's save) are coalesced. Returns true if anything changed.
+	bool wait(std::vector<std::string>& changed, int timeoutMs);
+
+private:
+	bool addOne(const std::string& dir);
+
+	int fd;
+	std::map<int, std::string> dirs; //By watch descriptor.
+};
+
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <sstream>
+#include <fstream>
 #include <string>
 #include <cstdio>
 #include <cstdlib>
@@ -37,5 +38,24 @@ std::string GuessMonoFont() {
 }
 
 
+/**
+ * Like GuessMonoFont(), but the answer is remembered in "cacheFile" (asking the system can take a
+ *   while). A cached font which no longer exists is guessed again.
+ */
+inline std::string CachedMonoFont(const std::string& cacheFile) {
+	std::string res;
+	std::ifstream in(cacheFile.c_str());
+	if (std::getline(in, res) && !res.empty() && std::ifstream(res.c_str()).good()) {
+		return res;
+	}
+
+	res = GuessMonoFont();
+	if (!res.empty()) {
+		std::ofstream out(cacheFile.c_str(), std::ios::trunc);
+		out <<res <<"\n";
+	}
+	return res;
+}
+
 
 }
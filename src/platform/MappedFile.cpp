@@ -0,0 +1,100 @@
+#include "MappedFile.hpp"
+
+#include <fstream>
+#include <iterator>
+
+#include "pack/AssetPack.hpp"
+
+#if defined(unix) || defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define PORTENTIA_MMAP
+#endif
+
+
+platform::MappedFile::MappedFile() : bytes(nullptr), length(0), borrowed(false)
+{
+}
+
+
+namespace {
+///Point "bytes" into the asset pack, if "path" is in it.
+bool OpenPacked(const std::string& path, const char*& bytes, size_t& length, bool& borrowed)
+{
+	if (!pack::Find(path, bytes, length)) { return false; }
+	borrowed = true;
+	return true;
+}
+} //End un-named namespace
+
+
+platform::MappedFile::~MappedFile()
+{
+	close();
+}
+
+
+#ifdef PORTENTIA_MMAP
+
+bool platform::MappedFile::open(const std::string& path)
+{
+	close();
+	if (OpenPacked(path, bytes, length, borrowed)) { return true; }
+	int fd = ::open(path.c_str(), O_RDONLY|O_CLOEXEC);
+	if (fd<0) { return false; }
+
+	struct stat st;
+	if (fstat(fd, &st)!=0 || st.st_size<=0) {
+		::close(fd);
+		return false;
+	}
+
+	//The mapping stays valid after we close the descriptor.
+	void* res = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (res==MAP_FAILED) { return false; }
+
+	bytes = static_cast<const char*>(res);
+	length = st.st_size;
+	return true;
+}
+
+
+void platform::MappedFile::close()
+{
+	if (bytes && !borrowed) {
+		munmap(const_cast<char*>(bytes), length);
+	}
+	bytes = nullptr;
+	length = 0;
+	borrowed = false;
+}
+
+#else
+
+bool platform::MappedFile::open(const std::string& path)
+{
+	close();
+	if (OpenPacked(path, bytes, length, borrowed)) { return true; }
+	std::ifstream in(path.c_str(), std::ios::binary);
+	if (!in) { return false; }
+	copy.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	if (copy.empty()) { return false; }
+
+	bytes = copy.data();
+	length = copy.size();
+	return true;
+}
+
+
+void platform::MappedFile::close()
+{
+	std::vector<char>().swap(copy);
+	bytes = nullptr;
+	length = 0;
+	borrowed = false;
+}
+
+#endif //PORTENTIA_MMAP
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+namespace platform {
+
+/**
+ * A read-only view of a whole file. On POSIX systems the file is memory-mapped (so "reading" it
+ *   costs nothing until a page is touched, and the OS can share/evict those pages); elsewhere, it
+ *   is simply read into memory. Files in the mounted asset pack (see pack/AssetPack.hpp) are viewed
+ *   in place, without touching the disk.
+ */
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	///Map "path". Any previously-mapped file is closed first. Returns false if it can't be mapped.
+	bool open(const std::string& path);
+	void close();
+
+	bool isOpen() const { return bytes!=nullptr; }
+	const char* data() const { return bytes; }
+	size_t size() const { return length; }
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	const char* bytes;
+	size_t length;
+	bool borrowed;          //A view into the asset pack (which owns it).
+	std::vector<char> copy; //Only used if we can't mmap.
+};
+
+}
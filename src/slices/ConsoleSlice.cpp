@@ -1,6 +1,7 @@
 #include "ConsoleSlice.hpp"
 
 #include <locale>
+#include <algorithm>
 #include <iostream>
 #include <stdexcept>
 #include <boost/algorithm/string.hpp>
@@ -8,7 +9,55 @@
 #include "core/GameEngine.hpp"
 
 
-ConsoleSlice::ConsoleSlice(const std::string& text, const std::list<std::string>& commands) : Slice(), window(nullptr), geControl(nullptr), headerText(text), commands(commands)
+namespace {
+//Marks a row that isn't showing any line.
+const size_t NoLine = static_cast<size_t>(-1);
+
+//Size of our text.
+const unsigned int CharSize = 15;
+
+///The character a key types (assuming a US layout), or 0 if it doesn't type one.
+///We work from key presses (not TextEntered events), since those are what the engine records and replays.
+char KeyToChar(const sf::Event::KeyEvent& key)
+{
+	if (key.control || key.alt || key.system) { return 0; }
+
+	if (key.code>=sf::Keyboard::A && key.code<=sf::Keyboard::Z) {
+		return (key.shift ? 'A' : 'a') + (key.code-sf::Keyboard::A);
+	}
+	if (key.code>=sf::Keyboard::Num0 && key.code<=sf::Keyboard::Num9) {
+		const char* Shifted = ")!@#$%^&*(";
+		return key.shift ? Shifted[key.code-sf::Keyboard::Num0] : '0' + (key.code-sf::Keyboard::Num0);
+	}
+	if (key.code>=sf::Keyboard::Numpad0 && key.code<=sf::Keyboard::Numpad9) {
+		return '0' + (key.code-sf::Keyboard::Numpad0);
+	}
+
+	switch (key.code) {
+		case sf::Keyboard::Space:     return ' ';
+		case sf::Keyboard::Period:    return key.shift ? '>' : '.';
+		case sf::Keyboard::Comma:     return key.shift ? '<' : ',';
+		case sf::Keyboard::Dash:      return key.shift ? '_' : '-';
+		case sf::Keyboard::Equal:     return key.shift ? '+' : '=';
+		case sf::Keyboard::Quote:     return key.shift ? '"' : '\'';
+		case sf::Keyboard::SemiColon: return key.shift ? ':' : ';';
+		case sf::Keyboard::Slash:     return key.shift ? '?' : '/';
+		case sf::Keyboard::BackSlash: return key.shift ? '|' : '\\';
+		case sf::Keyboard::LBracket:  return key.shift ? '{' : '[';
+		case sf::Keyboard::RBracket:  return key.shift ? '}' : ']';
+		case sf::Keyboard::Tilde:     return key.shift ? '~' : '`';
+		case sf::Keyboard::Add:       return '+';
+		case sf::Keyboard::Subtract:  return '-';
+		case sf::Keyboard::Multiply:  return '*';
+		case sf::Keyboard::Divide:    return '/';
+		default: return 0;
+	}
+}
+} //End un-named namespace
+
+
+ConsoleSlice::ConsoleSlice(const std::string& text, const std::list<std::string>& commands, size_t scrollback) : Slice(), window(nullptr), geControl(nullptr), headerText(text), commands(commands),
+	out_buffer(scrollback), scrollOffset(0), linesDirty(true)
 {
 	//Background color.
 	bkgrd.setFillColor(sf::Color(0x00, 0x00, 0x66, 0x66));
@@ -24,13 +73,24 @@ void ConsoleSlice::reset()
 {
 	//Reset our buffer and initialize it.
 	out_buffer.clear();
-	currLine.str("");
+	currLine.clear();
+	scrollOffset = 0;
 
-	//Separate by newline
-	boost::split(out_buffer, headerText, boost::is_any_of("\n"));
+	//Line ids restart after a clear, so forget what every row was showing.
+	std::fill(rowLineIds.begin(), rowLineIds.end(), NoLine);
+	linesDirty = true;
 
 	//Text shared to all Consoles.
-	out_buffer.push_front("This is a simple Console. Use Tab, Enter, and Esc.");
+	out_buffer.push_back("This is a simple Console. Use Tab, Enter, and Esc.");
+
+	//Separate by newline
+	std::vector<std::string> header;
+	boost::split(header, headerText, boost::is_any_of("\n"));
+	for (const std::string& line : header) {
+		out_buffer.push_back(line);
+	}
+
+	refreshInput();
 }
 
 
@@ -44,29 +104,77 @@ void ConsoleSlice::resizeConsole()
 	bkgrd.setSize(sf::Vector2f(size.x-3, size.y/2-2));
 	bkgrd.setPosition(1, size.y/2);
 
-	//Our text is anchored to the upper-left of the console
-	text.setPosition(1, size.y/2);
+	//Fit as many rows as we can above the input line. This is the only place rows are (re-)allocated.
+	const sf::Font& font = geControl->getMonoFont();
+	float lineHeight = font.getLineSpacing(CharSize);
+	size_t numRows = std::max<int>(1, static_cast<int>((size.y/2-2)/lineHeight)-1);
+	rows.resize(numRows);
+	rowLineIds.assign(numRows, NoLine);
+	for (size_t i=0; i<numRows; i++) {
+		rows[i].setFont(font);
+		rows[i].setColor(sf::Color::White);
+		rows[i].setCharacterSize(CharSize);
+		rows[i].setPosition(1, size.y/2 + i*lineHeight);
+	}
+
+	//Our input line is anchored below the last row.
+	inputText.setFont(font);
+	inputText.setColor(sf::Color::White);
+	inputText.setCharacterSize(CharSize);
+	inputText.setPosition(1, size.y/2 + numRows*lineHeight);
+
+	linesDirty = true;
 }
 
-void ConsoleSlice::refreshText()
+
+void ConsoleSlice::refreshLines()
 {
-	//First, get the last X items.
-	const size_t Num = 5;
-	std::list<std::string> toShow;
-	for (auto it=out_buffer.rbegin(); it!=out_buffer.rend(); it++) {
-		toShow.push_back(*it);
-		if (toShow.size()>=Num) { break; }
+	if (!linesDirty) { return; }
+	linesDirty = false;
+
+	//Don't scroll past the oldest line.
+	scrollOffset = std::min(scrollOffset, out_buffer.size()>rows.size() ? out_buffer.size()-rows.size() : 0);
+
+	//The bottom row shows the newest (un-scrolled) line; rows above it count backwards.
+	const int last = static_cast<int>(out_buffer.size()) - 1 - static_cast<int>(scrollOffset);
+	for (size_t i=0; i<rows.size(); i++) {
+		int index = last - static_cast<int>(rows.size()-1-i);
+		size_t lineId = index>=0 ? out_buffer.firstId()+index : NoLine;
+
+		//Only re-lay out the row if it's showing a different line.
+		if (lineId != rowLineIds[i]) {
+			rows[i].setString(lineId!=NoLine ? out_buffer[index] : std::string());
+			rowLineIds[i] = lineId;
+		}
 	}
+}
 
-	//We've got our last X messages.
-	std::stringstream msg;
-	for (auto it=toShow.rbegin(); it!=toShow.rend(); it++) {
-		msg <<*it <<"\n";
-	}
 
-	//And now our current line.
-	msg <<"$ " <<currLine.str();
-	text.setString(msg.str());
+void ConsoleSlice::refreshInput()
+{
+	inputText.setString("$ " + currLine);
+}
+
+
+void ConsoleSlice::appendLine(const std::string& line)
+{
+	out_buffer.push_back(line);
+	linesDirty = true;
+}
+
+
+void ConsoleSlice::setScrollback(size_t lines)
+{
+	out_buffer.setCapacity(lines);
+	std::fill(rowLineIds.begin(), rowLineIds.end(), NoLine);
+	linesDirty = true;
+}
+
+
+void ConsoleSlice::scroll(int lines)
+{
+	scrollOffset = static_cast<size_t>(std::max<int>(0, static_cast<int>(scrollOffset)+lines));
+	linesDirty = true;
 }
 
 
@@ -76,28 +184,21 @@ YieldAction ConsoleSlice::activated(GameEngineControl& geControl, Slice* prevSli
 	this->window = &window;
 	this->geControl = &geControl;
 
-	//Resize our background
+	//Resize our background and rows (this also sets our font).
 	resizeConsole();
 
-	//Set our font
-	text.setFont(geControl.getMonoFont());
-	text.setColor(sf::Color::White);
-	text.setCharacterSize(15);
-
 	//The last line is always the start of a new command.
-	//out_buffer.push_back("$ ");
-	refreshText();
+	refreshInput();
 	return YieldAction();
 }
 
 
 void ConsoleSlice::appendCurrCommand(bool clearCmd)
 {
-	std::stringstream newLine;
-	newLine <<"$ " <<currLine.str();
-	out_buffer.push_back(newLine.str());
+	appendLine("$ " + currLine);
 	if (clearCmd) {
-		currLine.str("");
+		currLine.clear();
+		refreshInput();
 	}
 }
 
@@ -105,7 +206,7 @@ void ConsoleSlice::appendCurrCommand(bool clearCmd)
 void ConsoleSlice::matchCommands()
 {
 	//Match any commands that start with currLine.
-	std::string pre = currLine.str();
+	const std::string& pre = currLine;
 	std::list<std::string> found;
 	for (const std::string& line : commands) {
 		if (line.find(pre)==0) {
@@ -115,19 +216,18 @@ void ConsoleSlice::matchCommands()
 
 	//If there's only one command, we auto-complete. Else, we list the commands.
 	if (found.size()==1) {
-		currLine.str("");
-		currLine <<found.front();
+		currLine = found.front();
+		refreshInput();
 	} else if (!found.empty()) {
 		//Put "$ command"
 		appendCurrCommand(false);
-		std::stringstream newLine;
+		std::string newLine;
 
 		//Put the options.
 		for (const auto& item : found) {
-			newLine <<"   " <<item;
+			newLine += "   " + item;
 		}
-		out_buffer.push_back(newLine.str());
-		refreshText();
+		appendLine(newLine);
 	}
 }
 
@@ -136,17 +236,40 @@ std::list<std::string> ConsoleSlice::getCurrCommand()
 {
 	//Split by spaces, remove duplicates (multiple spaces).
 	std::list<std::string> res;
-	std::string line = currLine.str();
-	boost::split(res, line, boost::is_any_of(" "), boost::token_compress_on);
+	boost::split(res, currLine, boost::is_any_of(" "), boost::token_compress_on);
 
 	return res;
 }
 
 
+std::string ConsoleSlice::getCurrCommandArgs() const
+{
+	//Skip the first word, and the spaces after it.
+	size_t start = currLine.find(' ');
+	if (start!=std::string::npos) {
+		start = currLine.find_first_not_of(' ', start);
+	}
+	return start==std::string::npos ? "" : currLine.substr(start);
+}
+
+
 void ConsoleSlice::appendCommandErrorMessage(const std::string& line)
 {
 	appendCurrCommand(false);
-	out_buffer.push_back(line);
+	appendLine(line);
+}
+
+
+void ConsoleSlice::appendCommandResult(const std::string& text)
+{
+	appendCurrCommand(true);
+
+	std::vector<std::string> lines;
+	boost::split(lines, text, boost::is_any_of("\n"));
+	if (!lines.empty() && lines.back().empty()) { lines.pop_back(); }
+	for (const std::string& line : lines) {
+		appendLine(line);
+	}
 }
 
 
@@ -157,8 +280,7 @@ bool ConsoleSlice::processCurrCommand()
 	std::list<std::string>  cmds = getCurrCommand();
 
 
-	std::string word = currLine.str();
-	word = word.substr(0, word.find(' '));
+	std::string word = currLine.substr(0, currLine.find(' '));
 
 	//Avoid the insanity.
 	if (word.empty()) {
@@ -176,36 +298,35 @@ bool ConsoleSlice::processCurrCommand()
 
 	//We also have some console-level commands. For now, we allow user-level commands to take precedence.
 	if (word=="exit") {
-		currLine.str(""); //Force reset.
+		currLine.clear(); //Force reset.
+		refreshInput();
 		return false;
 	}
 
 	//If not, inform the user that their command is invalid.
 	appendCurrCommand(false);
-	out_buffer.push_back("Unknown command!");
+	appendLine("Unknown command!");
 
 	return true;
 }
 
 
-void ConsoleSlice::update(const sf::Time& elapsed, const std::vector<sf::Event::KeyEvent>& typed)
+YieldAction ConsoleSlice::update(const sf::Time& elapsed, const std::vector<sf::Event::KeyEvent>& typed)
 {
-	//TODO: Need a way to handle these events seamlessly; TextEntered handles *actual* typing by the user.
-	/*case sf::Event::TextEntered:
-		if (std::isprint(event.text.unicode)) {
-			currLine <<std::string(1, event.text.unicode);
+	for (const auto& key : typed) {
+		//Typing?
+		char letter = KeyToChar(key);
+		if (letter) {
+			currLine += letter;
+			refreshInput();
+			continue;
 		}
-		refreshText();
-		break;*/
 
-
-	//TODO: A lot of this logic doesn't really work any more; the Console is useful, but it will likely just be a Lua terminal.
-	for (const auto& key : typed) {
 		if (key.code==sf::Keyboard::Return) {
 			if (NoModifiers(key)) {
 				bool keep = processCurrCommand();
 				if (!keep) {
-					return; //YieldAction(YieldAction::Remove);
+					return YieldAction(YieldAction::Remove);
 				}
 			}
 		} else if (key.code==sf::Keyboard::Tab) {
@@ -214,20 +335,27 @@ void ConsoleSlice::update(const sf::Time& elapsed, const std::vector<sf::Event::
 			}
 		} else if (key.code==sf::Keyboard::Escape) {
 			if (NoModifiers(key)) {
-				return; //YieldAction(YieldAction::Remove);
+				currLine.clear(); //The parent sees "no command".
+				refreshInput();
+				return YieldAction(YieldAction::Remove);
 			}
 		} else if (key.code==sf::Keyboard::BackSpace) {
 			if (NoModifiers(key)) {
-				if (!currLine.str().empty()) {
-					std::string prev = currLine.str();
-					prev = prev.substr(0, prev.length()-1);
-					currLine.str("");
-					currLine <<prev;
+				if (!currLine.empty()) {
+					currLine.erase(currLine.length()-1);
+					refreshInput();
 				}
 			}
+		} else if (key.code==sf::Keyboard::PageUp) {
+			scroll(static_cast<int>(rows.size()));
+		} else if (key.code==sf::Keyboard::PageDown) {
+			scroll(-static_cast<int>(rows.size()));
+		} else if (key.code==sf::Keyboard::End) {
+			scrollOffset = 0;
+			linesDirty = true;
 		}
-		refreshText();
 	}
+	return YieldAction();
 }
 
 
@@ -237,9 +365,15 @@ void ConsoleSlice::render()
 	//Nothing to draw.
 	if (!window) { return; }
 
+	//Pick up any output printed since the last frame.
+	refreshLines();
+
 	//Draw the background.
 	window->draw(bkgrd);
 
 	//Draw the text.
-	window->draw(text);
+	for (const sf::Text& row : rows) {
+		window->draw(row);
+	}
+	window->draw(inputText);
 }
@@ -2,21 +2,30 @@
 
 #include "Slice.hpp"
 
-#include <sstream>
 #include <string>
+#include <vector>
 #include <list>
 
 #include <SFML/Graphics.hpp>
 
+#include "util/RingBuffer.hpp"
+
 
 /**
  * A "console" slice is almost always used on top of another Slice in "Debug" mode to add new
- *   elements or edit the current world. "Enter" typically confirms a command. Simple tab completion
- *   exists.
+ *   elements or edit the current world. "Enter" typically confirms a command (which is handed back to
+ *   the parent Slice, via activated()), and "Esc" closes the console. Simple tab completion exists.
+ * Text is typed from key presses (US layout), so console input is recorded and replayed like any other.
+ * Output is kept in a fixed-size scrollback (PageUp/PageDown/End to scroll). Each visible row has
+ *   its own sf::Text, which is only re-laid out when the line it shows changes; typing only
+ *   re-lays out the input line.
  */
 class ConsoleSlice : public Slice {
 public:
-	ConsoleSlice(const std::string& text, const std::list<std::string>& commands={});
+	///Default number of lines kept in the scrollback.
+	static const size_t DefaultScrollback = 1000;
+
+	ConsoleSlice(const std::string& text, const std::list<std::string>& commands={}, size_t scrollback=DefaultScrollback);
 
 	virtual ~ConsoleSlice() {}
 
@@ -24,18 +33,34 @@ public:
 
 	//virtual YieldAction processEvent(const sf::Event& event, const sf::Time& elapsed);
 
-	virtual void update(const sf::Time& elapsed, const std::vector<sf::Event::KeyEvent>& typed);
+	virtual YieldAction update(const sf::Time& elapsed, const std::vector<sf::Event::KeyEvent>& typed);
 
 	virtual void render();
 
 	void reset();
 
 	std::list<std::string> getCurrCommand();
+
+	///Everything after the current command's first word, exactly as typed (getCurrCommand() collapses spaces).
+	std::string getCurrCommandArgs() const;
 	void appendCommandErrorMessage(const std::string& line);
 
+	///Echo the current command, clear it, and print its (possibly multi-line) output.
+	void appendCommandResult(const std::string& text);
+
+	///Print a line of output. Cheap; visible rows are only refreshed once per render.
+	void appendLine(const std::string& line);
+
+	///Change the number of lines kept in the scrollback (the newest lines are retained).
+	void setScrollback(size_t lines);
+
+	///Scroll the output by "lines" (positive is "up", towards older output).
+	void scroll(int lines);
+
 private:
 	void resizeConsole();
-	void refreshText();
+	void refreshLines(); //Only touches rows whose line has changed.
+	void refreshInput();
 
 	void appendCurrCommand(bool clearCmd=true);
 	void matchCommands();
@@ -47,10 +72,15 @@ private:
 	GameEngineControl* geControl;
 	sf::RenderWindow* window;
 
-	std::stringstream currLine; //Current input line, sans the $
+	std::string currLine; //Current input line, sans the $
 	sf::RectangleShape bkgrd;
-	sf::Text text;
+	sf::Text inputText;   //The "$ " line.
 
-	std::list<std::string> out_buffer; //Recently printed lines.
-};
+	RingBuffer<std::string> out_buffer; //Recently printed lines.
+	size_t scrollOffset; //Number of lines scrolled up from the newest.
+	bool linesDirty;     //Output (or the scroll position) changed since the last refresh.
 
+	//One row per visible line, and the (absolute) id of the line it currently shows.
+	std::vector<sf::Text> rows;
+	std::vector<size_t> rowLineIds;
+};
@@ -4,7 +4,8 @@
 #include <algorithm>
 #include <utility>
 #include <iostream>
-#include <fstream>
+#include <memory>
+#include <sstream>
 #include <stdexcept>
 
 #include "core/GameEngine.hpp"
@@ -14,8 +15,14 @@
 #include "widgets/RectangleGameObject.hpp"
 
 
+namespace {
+//How often a saved (or loaded) layout is saved again.
+const sf::Time AutosaveInterval = sf::seconds(10);
+} //End un-named namespace
+
+
 EuclideanMenuSlice::EuclideanMenuSlice() : Slice(), window(nullptr), geControl(nullptr),
-	console(new ConsoleSlice("Add menu items with \"additem\".", {"additem", "save", "clear"}))
+	console(new ConsoleSlice("Add menu items with \"additem\".", {"additem", "save", "load", "clear"})), saver("shapes")
 {
 	//TEMP
 	CircleGameObject* circ = new CircleGameObject(100, 10.0);
@@ -26,30 +33,61 @@ EuclideanMenuSlice::EuclideanMenuSlice() : Slice(), window(nullptr), geControl(n
 
 void EuclideanMenuSlice::load(const std::string& file)
 {
-	//TODO
+	std::map<uint64_t, Json::Value> objects;
+	if (!AutoSaver::Load(file, "shapes", objects)) {
+		throw std::runtime_error("Can't load layout: " + file);
+	}
+
+	//Saved ids are restored, so anything we have now (even the placeholder) could share one.
+	clearItems();
+	for (const auto& obj : objects) {
+		std::string type = obj.second["type"].asString();
+		AbstractGameObject* item = nullptr;
+		if (type=="circle") {
+			item = CircleGameObject::FromJson(obj.second);
+		} else if (type=="rectangle") {
+			item = RectangleGameObject::FromJson(obj.second);
+		} else {
+			std::cout <<"Warn: unknown shape type: \"" <<type <<"\"\n";
+			continue;
+		}
+		addItem(item, item->getBounds());
+	}
+
+	currFileName = file;
+	resizeViews();
 }
 
 void EuclideanMenuSlice::save(const std::string& file)
 {
-	const std::string Q = "\"";
-
-	std::ofstream out(file);
-	out <<"{\n";
-	out <<"  " <<Q <<"filename" <<Q <<" : " <<Q <<file <<Q <<",\n";
-	out <<"  " <<Q <<"shapes" <<Q <<" : " <<"\n";
-
-	//Use our comma trick to print items.
-	out <<"    [";
-	std::string comma = "";
-	items_sp.forAllItems([&out,&Q,&comma](AbstractGameObject* item) {
-		out <<comma <<"\n";
-		item->save(out, 6);
-		comma = ",";
-	});
-	out <<"\n    ]\n";
+	saver.save(file, snapshot());
+	sinceSave = sf::Time::Zero;
+}
 
-	//Done
-	out <<"}\n";
+AutoSaver::Snapshot EuclideanMenuSlice::snapshot()
+{
+	//Only items that have changed are saved again; the rest share their records with the last snapshot.
+	AutoSaver::Snapshot res;
+	for (const AbstractGameObject* item : items) {
+		SavedItem& saved = savedItems[item->getId()];
+		if (!saved.record || saved.version!=item->getVersion()) {
+			std::stringstream out;
+			item->save(out, 6);
+			saved.record = std::make_shared<const std::string>(out.str());
+			saved.version = item->getVersion();
+		}
+		res[item->getId()] = saved.record;
+	}
+
+	//Forget items that are gone.
+	for (auto it=savedItems.begin(); it!=savedItems.end(); ) {
+		if (res.find(it->first)==res.end()) {
+			savedItems.erase(it++);
+		} else {
+			it++;
+		}
+	}
+	return res;
 }
 
 
@@ -85,6 +123,25 @@ YieldAction EuclideanMenuSlice::saveToFile(const std::list<std::string>& params)
 }
 
 
+YieldAction EuclideanMenuSlice::loadFromFile(const std::list<std::string>& params)
+{
+	if (params.empty()) {
+		console->appendCommandErrorMessage("Error: \"load\" requires a file name.");
+		return YieldAction(YieldAction::Stack, console);
+	}
+
+	try {
+		load(params.front());
+	} catch (std::exception& ex) {
+		console->appendCommandErrorMessage(std::string("Error: ") + ex.what());
+		return YieldAction(YieldAction::Stack, console);
+	}
+
+	//Done.
+	return YieldAction();
+}
+
+
 YieldAction EuclideanMenuSlice::handleConsoleResults()
 {
 	std::list<std::string> line = console->getCurrCommand();
@@ -105,6 +162,8 @@ YieldAction EuclideanMenuSlice::handleConsoleResults()
 		return addNewMenuItem(line);
 	} else if (cmd == "save") {
 		return saveToFile(line);
+	} else if (cmd == "load") {
+		return loadFromFile(line);
 	}
 
 	//Else, throw the command back to the terminal.
@@ -119,6 +178,7 @@ YieldAction EuclideanMenuSlice::activated(GameEngineControl& geControl, Slice* p
 	//Save
 	this->window = &window;
 	this->geControl = &geControl;
+	items_sp.setScratchArena(&geControl.frameArena());
 
 	//Size the view appropriately.
 	resizeViews();
@@ -182,13 +242,29 @@ void EuclideanMenuSlice::resizeViews()
 	minimapView.setCenter(xRng.first+xDiff/2.0, yRng.first+yDiff/2.0);
 	minimapView.setSize(xDiff, yDiff);
 	minimapView.setViewport(sf::FloatRect(0.79, 0.01, 0.2, 0.2));
+
+	//The minimap's background only changes when the view does.
+	sf::Vector2u wndSize = window->getSize();
+	minimapUnderlay.setPosition(minimapView.getViewport().left*wndSize.x, minimapView.getViewport().top*wndSize.y);
+	minimapUnderlay.setSize(sf::Vector2f(minimapView.getViewport().width*wndSize.x, minimapView.getViewport().height*wndSize.y));
+	minimapUnderlay.setFillColor(sf::Color::White);
 }
 
-void EuclideanMenuSlice::update(const sf::Time& elapsed, const std::vector<sf::Event::KeyEvent>& typed)
+YieldAction EuclideanMenuSlice::update(const sf::Time& elapsed, const std::vector<sf::Event::KeyEvent>& typed)
 {
+	//Autosave (only what's changed is written, so this is cheap if nothing has).
+	sinceSave += elapsed;
+	if (!currFileName.empty() && sinceSave>=AutosaveInterval) {
+		save(currFileName);
+	}
+
 	for (const auto& key : typed) {
-		processKeyPress(key);
+		YieldAction res = processKeyPress(key);
+		if (res.action!=YieldAction::Nothing) {
+			return res;
+		}
 	}
+	return YieldAction();
 }
 
 /*YieldAction EuclideanMenuSlice::processEvent(const sf::Event& event, const sf::Time& elapsed)
@@ -242,11 +318,7 @@ void EuclideanMenuSlice::render()
 
 	//Draw a background for the minimap.
 	window->setView(window->getDefaultView());
-	sf::RectangleShape underlay;
-	underlay.setPosition(minimapView.getViewport().left*window->getSize().x, minimapView.getViewport().top*window->getSize().y);
-	underlay.setSize(sf::Vector2f(minimapView.getViewport().width*window->getSize().x, minimapView.getViewport().height*window->getSize().y));
-	underlay.setFillColor(sf::Color::White);
-	window->draw(underlay);
+	window->draw(minimapUnderlay);
 
 	//Now, draw the minimap
 	window->setView(minimapView);
@@ -265,6 +337,17 @@ void EuclideanMenuSlice::addItem(AbstractGameObject* item, const geom::Rectangle
 	items_sp.addItem(item, bounds);
 }
 
+void EuclideanMenuSlice::clearItems()
+{
+	//Remove from both (we own every item), and forget how they were saved.
+	items_sp.removeItems([](AbstractGameObject* const& item) { return true; });
+	for (AbstractGameObject* item : items) {
+		delete item;
+	}
+	items.clear();
+	savedItems.clear();
+}
+
 bool EuclideanMenuSlice::isItemsEmpty() const
 {
 	//Check both:
@@ -289,12 +372,17 @@ const AbstractGameObject* EuclideanMenuSlice::get_first_item() const {
 }
 
 void EuclideanMenuSlice::check_all_items() const {
-	std::set<const AbstractGameObject*> items1;
+	//This runs every frame, so use the frame arena (if we have one).
+	typedef std::set<const AbstractGameObject*, std::less<const AbstractGameObject*>, ArenaAllocator<const AbstractGameObject*>> ItemSet;
+	std::less<const AbstractGameObject*> compare;
+	ArenaAllocator<const AbstractGameObject*> scratch(geControl ? &geControl->frameArena() : nullptr);
+
+	ItemSet items1(compare, scratch);
 	for (AbstractGameObject* item : items) {
 		items1.insert(item);
 	}
 
-	std::set<const AbstractGameObject*> items2;
+	ItemSet items2(compare, scratch);
 	items_sp.forAllItems([&items2](AbstractGameObject* item) {
 		items2.insert(item);
 	});
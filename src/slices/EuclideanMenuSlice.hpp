@@ -8,6 +8,7 @@
 #include <SFML/Graphics.hpp>
 
 #include "index/LazySpatialIndex.hpp"
+#include "core/AutoSaver.hpp"
 
 class ConsoleSlice;
 class AbstractGameObject;
@@ -16,14 +17,17 @@ class AbstractGameObject;
  * A "menu" slice with various objects arranged in 2-D space and a "character" who walks around and
  *   can choose a single item with "Enter".
  * Debug commands allow you to "lift" each menu item and move it into position.
+ * Once saved (or loaded), the layout is autosaved in the background (see AutoSaver).
  */
 class EuclideanMenuSlice : public Slice {
 public:
 	EuclideanMenuSlice();
 	virtual ~EuclideanMenuSlice() {}
 
+	///Load a layout (its last full save, plus anything journaled since), replacing everything shown now.
 	void load(const std::string& file);
 
+	///Save this layout. Returns right away; the file is written on a background thread.
 	void save(const std::string& file);
 
 	virtual YieldAction activated(GameEngineControl& geControl, Slice* prevSlice, sf::RenderWindow& window);
@@ -31,13 +35,14 @@ public:
 	//TODO: This doesn't happen any more.
 	//virtual YieldAction processEvent(const sf::Event& event, const sf::Time& elapsed);
 
-	virtual void update(const sf::Time& elapsed, const std::vector<sf::Event::KeyEvent>& typed);
+	virtual YieldAction update(const sf::Time& elapsed, const std::vector<sf::Event::KeyEvent>& typed);
 
 	virtual void render();
 
 private:
 	//Helper: keep our two spatial indexes in sync. "Checks" will fail if they are not true for both.
 	void addItem(AbstractGameObject* item, const geom::Rectangle& bounds);
+	void clearItems();
 	bool isItemsEmpty() const;
 	const AbstractGameObject* get_first_item() const;
 	void check_all_items() const;
@@ -53,6 +58,12 @@ private:
 	//Save this layout to a file.
 	YieldAction saveToFile(const std::list<std::string>& params);
 
+	//Load a layout from a file.
+	YieldAction loadFromFile(const std::list<std::string>& params);
+
+	//Every item's saved form, re-using those that haven't changed since last time.
+	AutoSaver::Snapshot snapshot();
+
 	//The console for this Slice.
 	ConsoleSlice* console;
 
@@ -64,9 +75,20 @@ private:
 	//The name of the file which this Slice was loaded from.
 	std::string currFileName;
 
+	//Saving: each item's last saved form (and the version it was saved at), and the time since we last saved.
+	struct SavedItem {
+		unsigned int version;
+		AutoSaver::Record record;
+		SavedItem() : version(0) {}
+	};
+	std::map<uint64_t, SavedItem> savedItems;
+	AutoSaver saver;
+	sf::Time sinceSave;
+
 	GameEngineControl* geControl;
 	sf::RenderWindow* window;
 	sf::View mainView;
 	sf::View minimapView;
+	sf::RectangleShape minimapUnderlay;
 };
 
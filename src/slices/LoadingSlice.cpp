@@ -0,0 +1,83 @@
+#include "LoadingSlice.hpp"
+
+#include "core/InitGraph.hpp"
+
+
+namespace {
+const sf::Vector2f BarSize(400, 12);
+} //End un-named namespace
+
+
+LoadingSlice::LoadingSlice() : window(nullptr), graph(nullptr), font(nullptr)
+{
+	barBack.setSize(BarSize);
+	barBack.setFillColor(sf::Color(0x40, 0x40, 0x40));
+	bar.setFillColor(sf::Color(0xC0, 0xC0, 0x00));
+	status.setCharacterSize(14);
+	status.setColor(sf::Color(0xC0, 0xC0, 0xC0));
+}
+
+
+void LoadingSlice::watch(const InitGraph& graph, const AssetManager::FontHandle& font)
+{
+	this->graph = &graph;
+	this->font = &font;
+	statusLine.clear();
+}
+
+
+void LoadingSlice::unwatch()
+{
+	graph = nullptr;
+	font = nullptr;
+	statusLine.clear();
+	bar.setSize(sf::Vector2f(0, BarSize.y));
+}
+
+
+YieldAction LoadingSlice::activated(GameEngineControl& geControl, Slice* prevSlice, sf::RenderWindow& window)
+{
+	this->window = &window;
+
+	//Centered.
+	sf::Vector2f center(window.getSize().x/2.0f, window.getSize().y/2.0f);
+	barBack.setPosition(center - BarSize/2.0f);
+	bar.setPosition(barBack.getPosition());
+	status.setPosition(barBack.getPosition() + sf::Vector2f(0, BarSize.y + 8));
+	return YieldAction();
+}
+
+
+YieldAction LoadingSlice::update(const sf::Time& elapsed, const std::vector<sf::Event::KeyEvent>& typed)
+{
+	if (!graph) { return YieldAction(); }
+
+	//Tasks finished, out of all of them.
+	float done = graph->size()>0 ? static_cast<float>(graph->finished())/graph->size() : 1;
+	bar.setSize(sf::Vector2f(BarSize.x*done, BarSize.y));
+
+	//What's still running (only once we have a font to say it with).
+	if (font && font->ok()) {
+		std::string line = "Loading:";
+		for (const std::string& name : graph->running()) {
+			line += " " + name;
+		}
+		if (line!=statusLine) {
+			statusLine = line;
+			status.setFont(font->get());
+			status.setString(statusLine);
+		}
+	}
+	return YieldAction();
+}
+
+
+void LoadingSlice::render()
+{
+	if (!window) { return; }
+	window->draw(barBack);
+	window->draw(bar);
+	if (!statusLine.empty()) {
+		window->draw(status);
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Slice.hpp"
+
+#include <string>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "core/AssetManager.hpp"
+
+class InitGraph;
+
+
+/**
+ * Shown while the engine starts up (see InitGraph): a bar showing how many start-up tasks have
+ *   finished and, once the debug font has loaded, the names of the tasks still running. The engine
+ *   replaces it with the game's first slice once everything is ready.
+ */
+class LoadingSlice : public Slice {
+public:
+	LoadingSlice();
+
+	virtual ~LoadingSlice() {}
+
+	///Show the progress of "graph". The font is drawn with once it's ok() (it may load while we're shown).
+	void watch(const InitGraph& graph, const AssetManager::FontHandle& font);
+
+	///Stop showing progress (call before the graph or font goes away). Only the empty bar is drawn after this.
+	void unwatch();
+
+	virtual YieldAction activated(GameEngineControl& geControl, Slice* prevSlice, sf::RenderWindow& window);
+
+	virtual YieldAction update(const sf::Time& elapsed, const std::vector<sf::Event::KeyEvent>& typed);
+
+	virtual void render();
+
+private:
+	sf::RenderWindow* window;
+	const InitGraph* graph;
+	const AssetManager::FontHandle* font;
+
+	sf::RectangleShape barBack;
+	sf::RectangleShape bar;
+	sf::Text status;
+	std::string statusLine; //What "status" shows (it's only re-laid out when this changes).
+};
@@ -47,7 +47,14 @@ public:
 	//virtual YieldAction processEvent(const sf::Event& event, const sf::Time& elapsed) = 0;
 
 	///General update (called after all events).
-	virtual void update(const sf::Time& elapsed, const std::vector<sf::Event::KeyEvent>& typed) = 0;
+	///The return value can be used to switch out the active slice (e.g., to stack a console on top).
+	virtual YieldAction update(const sf::Time& elapsed, const std::vector<sf::Event::KeyEvent>& typed) = 0;
+
+	///Called once per frame, just before render(). When the engine runs a fixed timestep, "alpha"
+	/// is how far (0 to 1) we are between the last update() and the next one; slices can use it
+	/// to blend their previous and current state. In variable-timestep mode (and for any slice that
+	/// isn't on top, and so isn't being updated), alpha is always 1.
+	virtual void interpolate(float alpha) {}
 
 	///Render.
 	///NOTE: Do NOT call window.display()
@@ -7,6 +7,7 @@
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
+#include <cstdlib>
 
 extern "C" {
 	#include "lauxlib.h"
@@ -16,38 +17,199 @@ extern "C" {
 #include <jsoncpp/json/json.h>
 
 #include "core/GameEngine.hpp"
+#include "core/LuaScript.hpp"
+#include "core/ScriptScheduler.hpp"
+#include "core/ScriptMonitor.hpp"
+#include "core/ScriptDomain.hpp"
+#include "core/Profiler.hpp"
+#include "core/AllocTracker.hpp"
+#include "map/MapCompiler.hpp"
+#include "map/MapReader.hpp"
+#include "platform/MappedFile.hpp"
 #include "slices/ConsoleSlice.hpp"
 #include "widgets/AbstractGameObject.hpp"
 #include "widgets/CircleGameObject.hpp"
 #include "widgets/RectangleGameObject.hpp"
 
 
+namespace {
+///Parse a map's JSON (only if we can't use its compiled form; see mapfile::ReadMapFile()).
+Json::Value ReadMap(const std::string& file)
+{
+	Json::Value root;
+	Json::Reader read;
+	platform::MappedFile inFile;
+	if (!inFile.open(file)) {
+		throw std::runtime_error("Can't load file; doesn't exist.");
+	}
+	read.parse(inFile.data(), inFile.data()+inFile.size(), root);
+	return root;
+}
+} //End un-named namespace
+
+
 WalkableMapSlice::WalkableMapSlice() : Slice(), window(nullptr), geControl(nullptr),
-	console(new ConsoleSlice("TODO: lua console.")), bkgrdColor(0xC0, 0xC0, 0x00)
+	console(new ConsoleSlice(
+		"Lua console. Commands:\n"
+		"  lua <code>\n"
+		"  budget <instructions> [ms] | budget off | budget report\n"
+		"  profile start [interval] | stop | flat | save <file> | clear",
+		{"lua", "budget", "profile"})), bkgrdColor(0xC0, 0xC0, 0x00), cameraPlaced(false),
+	onupdateRef(LUA_NOREF), thisRef(LUA_NOREF), npcVerts(sf::Quads)
+{
+}
+
+WalkableMapSlice::~WalkableMapSlice()
 {
+	//Our NPCs may be running in the engine's script domains, which outlive us.
+	if (geControl) {
+		releaseNpcs();
+	}
 }
 
-void WalkableMapSlice::load(const std::string& file)
+void WalkableMapSlice::load(GameEngineControl& geControl, const std::string& file)
 {
+	PROFILE_SCOPE("WalkableMapSlice::load");
+	ALLOC_SCOPE(alloc::Subsystem::Assets);
+	this->geControl = &geControl;
+
 	//Get the path.
-	std::string path = "./";
+	mapFile = file;
+	mapPath = "./";
 	size_t sl = file.rfind('/');
 	if (sl!=std::string::npos) {
-		path = file.substr(0, sl+1);
+		mapPath = file.substr(0, sl+1);
 	}
 
-	//Read the root node.
+	//Use the compiled map, re-compiling it first if the JSON is newer (or it's unusable). Compiled maps keep
+	// only their scripts, NPCs, etc. as JSON; the (potentially huge) tile map is used straight from the file.
+	//The JSON is read as a stream, so its tiles go straight to the compiler without ever being a JSON tree.
+	std::string binFile = mapfile::CompiledPath(file);
+	if (CompiledMap::IsStale(file, binFile) || !compiled.open(binFile)) {
+		mapfile::MapData map;
+		mapfile::ReadMapFile(file, map);
+		compileMap(map);
+	}
 	Json::Value root;
-	{
-	Json::Reader read;
-	std::ifstream inFile(file);
-	if (!inFile.is_open()) {
-		throw std::runtime_error("Can't load file; doesn't exist.");
+	if (compiled.isOpen()) {
+		Json::Reader read;
+		read.parse(compiled.extra(), root);
+	} else {
+		root = ReadMap(file);
+	}
+
+	//Bind ourselves once (our scripts are called with "this").
+	lua_State* L = geControl.lua();
+	if (thisRef==LUA_NOREF) {
+		luabind::object(L, this).push(L);
+		thisRef = lua::RefTop(L);
+	}
+
+	//Load everything.
+	applyMap(root, true);
+}
+
+
+void WalkableMapSlice::applyMap(const Json::Value& root, bool all)
+{
+	PROFILE_SCOPE("WalkableMapSlice::applyMap");
+	ALLOC_SCOPE(alloc::Subsystem::Assets);
+
+	//Only re-load the sections that have changed (unless we're loading "all" of them).
+	const Json::Value& prev = mapJson;
+	auto changed = [&root, &prev, all](const char* key) {
+		return all || root[key]!=prev[key];
+	};
+
+	if (changed("background")) {
+		loadBackground(root);
+	}
+	//A map opened from its compiled form has no "tiles" or "tmap" JSON to compare with, so its tiles are
+	// compared with what it was compiled from.
+	bool tilesChanged = changed("tiles") || changed("tmap") || changed("grid") || changed("streaming");
+	mapfile::MapData map;
+	if (tilesChanged && !all) {
+		mapfile::FromJson(root, map);
+		map.source = mapfile::Stamp(mapFile); //"root" was just re-read from it.
+		tilesChanged = !compiled.isOpen() || mapfile::TileHash(map)!=compiled.tileHash();
+	}
+	if (tilesChanged) {
+		//A reloaded map is newer than its compiled form (and its chunks are about to be re-written).
+		streamer.close();
+		if (!all) {
+			compileMap(map);
+		}
+		loadTiles(root);
+		loadTileMap(root);
+		loadGround(root);
+		loadStreaming(root);
+		subscribeReloads();
+	}
+	if (changed("onupdate")) {
+		loadOnUpdate(root);
+	}
+	if (changed("domains") || changed("npcs")) {
+		loadNpcs(root);
+	}
+	if (changed("behaviours")) {
+		loadBehaviours(root);
+	}
+
+	mapJson = root;
+}
+
+
+void WalkableMapSlice::compileMap(const mapfile::MapData& map)
+{
+	ground.clear();
+	compiled.close();
+	std::string binFile = mapfile::CompiledPath(mapFile);
+	try {
+		mapfile::Compile(map, binFile);
+	} catch (std::exception& ex) {
+		std::cout <<"Warn: " <<ex.what() <<"\n";
+		return;
+	}
+	if (!compiled.open(binFile)) {
+		std::cout <<"Warn: can't open compiled map: " <<binFile <<"\n";
+	}
+}
+
+
+void WalkableMapSlice::subscribeReloads()
+{
+	HotReloader& reloader = geControl->hotReload();
+	reloader.unsubscribe(this);
+
+	//The map itself.
+	reloader.subscribe(mapFile, this, [this](const HotReloader::Asset& asset) {
+		if (asset.kind==HotReloader::Asset::Kind::Json) {
+			applyMap(asset.json, false);
+		}
+	});
+
+	//Each of its textures (tiles are drawn at their texture's current size, so nothing else needs to change).
+	for (const auto& tf : tileFiles) {
+		std::string key = tf.first;
+		reloader.subscribe(mapPath+tf.second, this, [this, key](const HotReloader::Asset& asset) {
+			auto it = tiles.find(key);
+			if (asset.kind==HotReloader::Asset::Kind::Image && it!=tiles.end()) {
+				geControl->assets().replace(it->second, asset.image);
+			}
+		});
 	}
-	read.parse(inFile, root);
+	if (!groundFile.empty()) {
+		reloader.subscribe(mapPath+groundFile, this, [this](const HotReloader::Asset& asset) {
+			if (asset.kind==HotReloader::Asset::Kind::Image) {
+				geControl->assets().replace(ground.getTileset(), asset.image);
+			}
+		});
 	}
+}
 
-	//Background color.
+
+void WalkableMapSlice::loadBackground(const Json::Value& root)
+{
 	bkgrdColor = sf::Color(0xC0, 0xC0, 0x00);
 	if (root.isMember("background")) {
 		std::string bkgrd = root["background"].asString();
@@ -60,43 +222,196 @@ void WalkableMapSlice::load(const std::string& file)
 		ss >> res;
 		bkgrdColor = sf::Color(sf::Uint8((res>>16)&0xFF), sf::Uint8((res>>8)&0xFF), sf::Uint8(res&0xFF));
 	}
+}
 
-	//Tiles.
-	for (std::map<std::string, sf::Texture*>::const_iterator it=tiles.begin(); it!=tiles.end(); it++) {
-		delete it->second;
-	}
+
+void WalkableMapSlice::loadTiles(const Json::Value& root)
+{
 	tiles.clear();
-	if (root.isMember("tiles")) {
+	tileFiles.clear();
+	tileTypes.clear();
+
+	//Tile names and files.
+	if (compiled.isOpen()) {
+		for (size_t i=0; i<compiled.numTileTypes(); i++) {
+			const mapfile::TileType& type = compiled.tileType(i);
+			tileFiles[compiled.string(type.name)] = compiled.string(type.file);
+		}
+	} else if (root.isMember("tiles")) {
 		const Json::Value& ts = root["tiles"];
-		const Json::Value::Members& keys = ts.getMemberNames();
-		for (const auto& key : keys) {
-			sf::Texture* txt = new sf::Texture();
-			if (!txt->loadFromFile(path+ts[key].asString())) {
-				std::cout <<"Warn: couldn't load texture: " <<ts[key].asString() <<"\n";
-			}
-			tiles[key] = txt;
+		for (const std::string& key : ts.getMemberNames()) {
+			tileFiles[key] = ts[key].asString();
 		}
 	}
 
-	//Tile map.
+	//These load in the background; we draw placeholders until they're ready.
+	for (const auto& tf : tileFiles) {
+		tiles[tf.first] = geControl->assets().loadTexture(mapPath+tf.second);
+	}
+
+	//Compiled tiles refer to their textures by id.
+	if (compiled.isOpen()) {
+		for (size_t i=0; i<compiled.numTileTypes(); i++) {
+			tileTypes.push_back(tiles[compiled.string(compiled.tileType(i).name)]);
+		}
+	}
+}
+
+
+void WalkableMapSlice::loadTileMap(const Json::Value& root)
+{
+	//Compiled maps are drawn straight from the file.
 	tmap.clear();
+	if (compiled.isOpen()) { return; }
+
 	if (root.isMember("tmap") && root["tmap"].isArray()) {
 		const Json::Value& ts = root["tmap"];
 		for (unsigned int i=0; i<ts.size(); i++) {
 			const Json::Value& item = ts[i];
 			if (item.isMember("tile") && item.isMember("x") && item.isMember("y")) {
-				sf::Sprite res(*tiles[item["tile"].asString()]);
-				res.setPosition(item["x"].asInt(), item["y"].asInt());
-				tmap.push_back(res);
+				auto tile = tiles.find(item["tile"].asString());
+				if (tile==tiles.end()) {
+					std::cout <<"Warn: unknown tile: " <<item["tile"].asString() <<"\n";
+					continue;
+				}
+				tmap.push_back(PlacedTile(tile->second, sf::Vector2f(item["x"].asInt(), item["y"].asInt())));
 			}
 		}
 	}
+}
+
+
+void WalkableMapSlice::loadGround(const Json::Value& root)
+{
+	//Compiled maps keep their ground layer in the file; otherwise, read it from the JSON.
+	ground.clear();
+	groundFile.clear();
+	if (compiled.isOpen()) {
+		groundFile = compiled.string(compiled.layer().tileset);
+		ground.view(compiled.layer(), compiled.layerTiles());
+	} else {
+		mapfile::Layer layer = mapfile::Layer();
+		std::vector<uint16_t> ids;
+		groundFile = mapfile::ReadLayer(root["grid"], layer, ids);
+		ground.assign(layer, ids);
+	}
 
-	//OnUpdate event.
+	if (!ground.empty()) {
+		ground.setTileset(geControl->assets().loadTexture(mapPath+groundFile));
+	}
+}
+
+
+void WalkableMapSlice::loadStreaming(const Json::Value& root)
+{
+	//Large maps are split into chunks when compiled; stream them in around the camera.
+	streamer.close();
+	const Json::Value& opts = root["streaming"];
+	if (compiled.isOpen() && opts["chunkSize"].asInt()>0) {
+		streamer.setScratchArena(&geControl->frameArena());
+		streamer.open(mapfile::ChunkDir(mapfile::CompiledPath(mapFile)), opts["chunkSize"].asUInt(), opts.get("radius", 1).asUInt());
+	}
+}
+
+
+void WalkableMapSlice::loadOnUpdate(const Json::Value& root)
+{
 	onupdate = "";
 	if (root.isMember("onupdate")) {
 		onupdate = root["onupdate"].asString();
 	}
+
+	//Compile it once, now. It's called with ("this", "elapsed").
+	lua_State* L = geControl->lua();
+	lua::Unref(L, onupdateRef);
+	onupdateRef = LUA_NOREF;
+	if (!onupdate.empty()) {
+		onupdateRef = lua::CompileChunk(L, onupdate, mapFile+":onupdate", "this, elapsed");
+	}
+}
+
+
+void WalkableMapSlice::loadNpcs(const Json::Value& root)
+{
+	//Drop our old NPCs and script domains (in that order; NPC handlers live in the domains).
+	releaseNpcs();
+	ScriptDomains& domains = geControl->scriptDomains();
+	for (const std::string& name : domainNames) {
+		domains.remove(name);
+	}
+	domainNames.clear();
+
+	//Script domains: each is a separate Lua state (running the given code), updated on a worker thread.
+	if (root.isMember("domains")) {
+		const Json::Value& list = root["domains"];
+		for (const std::string& name : list.getMemberNames()) {
+			domains.create(name).run(list[name].asString(), mapFile+":domains."+name);
+			domainNames.push_back(name);
+		}
+	}
+
+	//NPCs, by kind. Each kind has a list of "spawn" points and a batch "onupdate" handler, which runs
+	// in the main Lua state unless the kind names a "domain".
+	if (root.isMember("npcs")) {
+		const Json::Value& kinds = root["npcs"];
+		for (const std::string& kind : kinds.getMemberNames()) {
+			const Json::Value& def = kinds[kind];
+			npcs.emplace_back(kind);
+			EntityBatch& batch = npcs.back();
+			const Json::Value& spawn = def["spawn"];
+			for (unsigned int i=0; i<spawn.size(); i++) {
+				batch.add(spawn[i]["x"].asDouble(), spawn[i]["y"].asDouble(), spawn[i]["vx"].asDouble(), spawn[i]["vy"].asDouble(), spawn[i]["flags"].asInt());
+			}
+			if (def.isMember("onupdate")) {
+				ScriptDomain* domain = def.isMember("domain") ? domains.find(def["domain"].asString()) : nullptr;
+				if (def.isMember("domain") && !domain) {
+					std::cout <<"Warn: NPC kind \"" <<kind <<"\" uses unknown domain: " <<def["domain"].asString() <<"\n";
+				}
+				batch.setHandler(domain ? domain->lua() : geControl->lua(), def["onupdate"].asString());
+				if (domain) {
+					domain->addBatch(&batch);
+				}
+			}
+		}
+	}
+}
+
+
+void WalkableMapSlice::releaseNpcs()
+{
+	//A batch may run in any domain (not just ours), so ask them all to let it go.
+	if (!npcs.empty()) {
+		ScriptDomains& domains = geControl->scriptDomains();
+		for (EntityBatch& batch : npcs) {
+			domains.removeBatch(&batch);
+			batch.release();
+		}
+	}
+	npcs.clear();
+}
+
+
+void WalkableMapSlice::loadBehaviours(const Json::Value& root)
+{
+	//Behaviours. These are coroutines (called with "this") which can wait() instead of polling.
+	lua_State* L = geControl->lua();
+	geControl->scripts().cancel(this);
+	behaviours.clear();
+	if (root.isMember("behaviours")) {
+		const Json::Value& list = root["behaviours"];
+		for (unsigned int i=0; i<list.size(); i++) {
+			behaviours.push_back(list[i].asString());
+			std::stringstream name;
+			name <<mapFile <<":behaviours[" <<i <<"]";
+			int ref = lua::CompileChunk(L, behaviours.back(), name.str(), "this");
+			if (ref!=LUA_NOREF) {
+				lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+				lua_rawgeti(L, LUA_REGISTRYINDEX, thisRef);
+				geControl->scripts().spawn(1, this);
+				lua::Unref(L, ref);
+			}
+		}
+	}
 }
 
 void WalkableMapSlice::save(const std::string& file)
@@ -114,32 +429,190 @@ YieldAction WalkableMapSlice::activated(GameEngineControl& geControl, Slice* pre
 	this->window = &window;
 	this->geControl = &geControl;
 
+	//Start the camera at the center of the window (i.e., matching the default view).
+	sf::Vector2u size = window.getSize();
+	mapView.setSize(size.x, size.y);
+	if (!cameraPlaced) {
+		camera = prevCamera = sf::Vector2f(size.x/2.0, size.y/2.0);
+		cameraPlaced = true;
+	}
+
+	//We weren't updated while something else was on top, so there's nothing to blend from.
+	prevCamera = camera;
+
+	//Are we returning from a Console?
+	if (prevSlice==console) {
+		return handleConsoleResults();
+	}
+
 	//Done.
 	return YieldAction();
 }
 
 
-void WalkableMapSlice::update(const sf::Time& elapsed, const std::vector<sf::Event::KeyEvent>& typed)
+YieldAction WalkableMapSlice::handleConsoleResults()
+{
+	std::list<std::string> line = console->getCurrCommand();
+
+	//No command means the Console killed itself.
+	if (line.empty() || line.front().empty()) { return YieldAction(); }
+
+	//Else, the first item in the line is the command.
+	std::string cmd = line.front();
+	line.erase(line.begin());
+
+	//Run it, show the result, and keep the console open.
+	std::string res;
+	if (cmd == "lua") {
+		res = runLua(console->getCurrCommandArgs()); //As typed (spaces in strings matter).
+	} else if (cmd == "budget") {
+		res = setBudget(line);
+	} else if (cmd == "profile") {
+		res = profile(line);
+	} else {
+		res = "Error, unexpected command: \"" + cmd + "\"";
+	}
+	console->appendCommandResult(res);
+	return YieldAction(YieldAction::Stack, console);
+}
+
+
+std::string WalkableMapSlice::runLua(const std::string& code)
+{
+	lua_State* L = geControl->lua();
+	ScriptMonitor::Watch watch(L, "console");
+	if (luaL_loadbuffer(L, code.c_str(), code.size(), "=console")!=0 || lua_pcall(L, 0, 0, 0)!=0) {
+		std::string err = lua_tostring(L, -1);
+		lua_pop(L, 1);
+		return "Error: " + err;
+	}
+	return "Ok.";
+}
+
+
+std::string WalkableMapSlice::setBudget(const std::list<std::string>& params)
+{
+	ScriptMonitor& monitor = geControl->scriptMonitor();
+	std::stringstream res;
+	if (params.empty() || params.front().empty()) {
+		res <<"Usage: budget <instructions> [ms] | budget off | budget report";
+	} else if (params.front()=="off") {
+		monitor.clearBudget();
+		res <<"Script budget removed.";
+	} else if (params.front()=="report") {
+		monitor.printOverruns(res);
+	} else {
+		unsigned int instructions = std::atoi(params.front().c_str());
+		int ms = params.size()>1 ? std::atoi(params.back().c_str()) : 0;
+		monitor.setBudget(instructions, sf::milliseconds(ms));
+		res <<"Each script may now run " <<instructions <<" instructions and " <<ms <<" ms (0 means no limit).";
+	}
+	return res.str();
+}
+
+
+std::string WalkableMapSlice::profile(const std::list<std::string>& params)
+{
+	ScriptMonitor& monitor = geControl->scriptMonitor();
+	std::string sub = params.empty() ? "" : params.front();
+	std::stringstream res;
+	if (sub=="start") {
+		unsigned int interval = params.size()>1 ? std::atoi(params.back().c_str()) : 1000;
+		monitor.startProfiling(interval);
+		res <<"Sampling Lua every " <<std::max(1U, interval) <<" instructions.";
+	} else if (sub=="stop") {
+		monitor.stopProfiling();
+		res <<"Stopped sampling.";
+	} else if (sub=="flat") {
+		monitor.printFlat(res);
+	} else if (sub=="save" && params.size()>1) {
+		if (monitor.writeFolded(params.back())) {
+			res <<"Folded stacks written to: " <<params.back();
+		} else {
+			res <<"Error: can't write to: " <<params.back();
+		}
+	} else if (sub=="clear") {
+		monitor.clearResults();
+		res <<"Samples cleared.";
+	} else {
+		res <<"Usage: profile start [interval] | stop | flat | save <file> | clear";
+	}
+	return res.str();
+}
+
+
+YieldAction WalkableMapSlice::processKeyPress(const sf::Event::KeyEvent& key, const sf::Time& elapsed)
+{
+	//Open the console with "~".
+	if (key.code==sf::Keyboard::Tilde && NoModifiers(key)) {
+		console->reset();
+		return YieldAction(YieldAction::Stack, console);
+	}
+	return YieldAction();
+}
+
+
+YieldAction WalkableMapSlice::update(const sf::Time& elapsed, const std::vector<sf::Event::KeyEvent>& typed)
 {
+	//Typed keys.
+	YieldAction res;
+	for (const auto& key : typed) {
+		res = processKeyPress(key, elapsed);
+		if (res.action!=YieldAction::Nothing) { break; }
+	}
+
 	//Sprite movement.
 	std::pair<int,int> walk = std::make_pair(0,0);
-	if (sf::Keyboard::isKeyPressed(sf::Keyboard::Up)) { walk.second--; }
-	if (sf::Keyboard::isKeyPressed(sf::Keyboard::Down)) { walk.second++; }
-	if (sf::Keyboard::isKeyPressed(sf::Keyboard::Left)) { walk.first--; }
-	if (sf::Keyboard::isKeyPressed(sf::Keyboard::Right)) { walk.first++; }
+	if (geControl->isKeyPressed(sf::Keyboard::Up)) { walk.second--; }
+	if (geControl->isKeyPressed(sf::Keyboard::Down)) { walk.second++; }
+	if (geControl->isKeyPressed(sf::Keyboard::Left)) { walk.first--; }
+	if (geControl->isKeyPressed(sf::Keyboard::Right)) { walk.first++; }
+
+	//Walk the camera.
+	//TODO: Walk the hero instead, once we have one.
+	const float WalkSpeed = 200; //Pixels per second.
+	prevCamera = camera;
+	camera.x += walk.first * WalkSpeed * elapsed.asSeconds();
+	camera.y += walk.second * WalkSpeed * elapsed.asSeconds();
 
-	//TODO: Actually walk.
+	//Stream in the chunks around us (and ahead of us), for large maps.
+	streamer.update(camera.x, camera.y, walk.first*WalkSpeed, walk.second*WalkSpeed);
 
 	//TODO: Process onupdate for all Sprites.
 
-	//Process onupdate for this map.
-	if (!onupdate.empty()) {
-		luabind::globals(geControl->lua())["this"] = this;
-		if (luaL_dostring(geControl->lua(), onupdate.c_str())!=0) {
-			std::cout <<"Error running onupdate lua code: ##{" <<onupdate <<"}##\n";
-			std::cout <<"Error is: \"" <<lua_tostring(geControl->lua(), -1) <<"\"\n";
+	//Process onupdate for each kind of NPC (one call each). Kinds in a script domain are run by the engine, on a worker.
+	if (!npcs.empty()) {
+		PROFILE_SCOPE("lua npcs");
+		ALLOC_SCOPE(alloc::Subsystem::Lua);
+		sf::Clock scriptClock;
+		for (EntityBatch& batch : npcs) {
+			if (batch.lua()==geControl->lua()) {
+				batch.update(elapsed.asMilliseconds());
+			}
 		}
+		geControl->addScriptTime(scriptClock.getElapsedTime());
 	}
+
+	//Process onupdate for this map.
+	if (onupdateRef!=LUA_NOREF) {
+		PROFILE_SCOPE("lua onupdate");
+		ALLOC_SCOPE(alloc::Subsystem::Lua);
+		sf::Clock scriptClock;
+		lua_State* L = geControl->lua();
+		lua_rawgeti(L, LUA_REGISTRYINDEX, thisRef);
+		lua_pushinteger(L, elapsed.asMilliseconds());
+		lua::CallChunk(L, onupdateRef, 2, "onupdate");
+		geControl->addScriptTime(scriptClock.getElapsedTime());
+	}
+
+	return res;
+}
+
+
+void WalkableMapSlice::interpolate(float alpha)
+{
+	//Blend the last two camera positions.
+	mapView.setCenter(prevCamera.x + (camera.x-prevCamera.x)*alpha, prevCamera.y + (camera.y-prevCamera.y)*alpha);
 }
 
 
@@ -150,11 +623,90 @@ void WalkableMapSlice::render()
 
 	//Color the background.
 	window->clear(bkgrdColor);
+	window->setView(mapView);
+
+	//The ground layer, under everything.
+	{
+	sf::Vector2f center = mapView.getCenter();
+	sf::Vector2f size = mapView.getSize();
+	ground.setVisible(center.x-size.x/2, center.y-size.y/2, center.x+size.x/2, center.y+size.y/2);
+	window->draw(ground);
+	}
+
+	//Color all entries in the tile map. For compiled (and streamed) maps, only the tiles in view are drawn (found with their spatial index).
+	if (compiled.isOpen()) {
+		//Tiles are indexed by their top-left corner, so look up/left of the view by the largest tile's size.
+		sf::Vector2u maxSize;
+		for (const AssetManager::TextureHandle& tex : tileTypes) {
+			maxSize.x = std::max(maxSize.x, tex.get().getSize().x);
+			maxSize.y = std::max(maxSize.y, tex.get().getSize().y);
+		}
+		sf::Vector2f center = mapView.getCenter();
+		sf::Vector2f size = mapView.getSize();
+		float left = center.x-size.x/2-maxSize.x;
+		float top = center.y-size.y/2-maxSize.y;
+		float right = center.x+size.x/2;
+		float bottom = center.y+size.y/2;
 
-	//Color all entries in the tile map.
-	for (auto& item : tmap) {
-		window->draw(item);
+		//Draw them in map order.
+		if (streamer.isOpen()) {
+			visibleRefs.clear();
+			streamer.findTiles(left, top, right, bottom, visibleRefs);
+			for (ChunkStreamer::TileRef ref : visibleRefs) {
+				drawTile(streamer.tile(ref));
+			}
+		} else {
+			visibleTiles.clear();
+			compiled.findTiles(left, top, right, bottom, visibleTiles);
+			std::sort(visibleTiles.begin(), visibleTiles.end());
+			for (uint32_t id : visibleTiles) {
+				drawTile(compiled.tile(id));
+			}
+		}
+	} else {
+		for (const PlacedTile& item : tmap) {
+			tileSprite.setTexture(item.texture.get(), true);
+			tileSprite.setPosition(item.pos);
+			window->draw(tileSprite);
+		}
 	}
+
+	//Draw NPCs as small squares, straight from their position arrays.
+	const float NpcSize = 8;
+	size_t numNpcs = 0;
+	for (const EntityBatch& batch : npcs) {
+		numNpcs += batch.size();
+	}
+	npcVerts.resize(numNpcs*4);
+	size_t v = 0;
+	for (const EntityBatch& batch : npcs) {
+		for (size_t i=0; i<batch.size(); i++) {
+			float x = batch.x[i] - NpcSize/2;
+			float y = batch.y[i] - NpcSize/2;
+			sf::Color color = batch.flags[i] ? sf::Color::Red : sf::Color::White;
+			npcVerts[v++] = sf::Vertex(sf::Vector2f(x, y), color);
+			npcVerts[v++] = sf::Vertex(sf::Vector2f(x+NpcSize, y), color);
+			npcVerts[v++] = sf::Vertex(sf::Vector2f(x+NpcSize, y+NpcSize), color);
+			npcVerts[v++] = sf::Vertex(sf::Vector2f(x, y+NpcSize), color);
+		}
+	}
+	if (numNpcs>0) {
+		window->draw(npcVerts);
+	}
+}
+
+void WalkableMapSlice::drawTile(const mapfile::Tile& tile)
+{
+	if (tile.type<tileTypes.size()) {
+		tileSprite.setTexture(tileTypes[tile.type].get(), true);
+		tileSprite.setPosition(tile.x, tile.y);
+		window->draw(tileSprite);
+	}
+}
+
+int WalkableMapSlice::tileAt(float x, float y) const
+{
+	return ground.tileAt(x, y);
 }
 
 void WalkableMapSlice::changeBgColor(long elapsedMs)
@@ -6,8 +6,15 @@
 #include <list>
 
 #include <SFML/Graphics.hpp>
+#include <jsoncpp/json/json.h>
 
 #include "index/LazySpatialIndex.hpp"
+#include "core/EntityBatch.hpp"
+#include "core/AssetManager.hpp"
+#include "map/CompiledMap.hpp"
+#include "map/ChunkStreamer.hpp"
+#include "map/TileGrid.hpp"
+#include "map/MapReader.hpp"
 
 class ConsoleSlice;
 class AbstractGameObject;
@@ -18,9 +25,12 @@ class AbstractGameObject;
 class WalkableMapSlice : public Slice {
 public:
 	WalkableMapSlice();
-	virtual ~WalkableMapSlice() {}
+	virtual ~WalkableMapSlice();
 
-	void load(const std::string& file);
+	///Load a map. Its scripts are compiled here, once, in geControl's Lua state.
+	///The map is loaded from its compiled form (see map/MapFormat.hpp), which is rebuilt first if the JSON is newer.
+	///While the game runs, changes to the map (or its textures) are re-applied as they're saved.
+	void load(GameEngineControl& geControl, const std::string& file);
 
 	void save(const std::string& file);
 
@@ -28,24 +38,95 @@ public:
 
 	//virtual YieldAction processEvent(const sf::Event& event, const sf::Time& elapsed);
 
-	virtual void update(const sf::Time& elapsed, const std::vector<sf::Event::KeyEvent>& typed);
+	virtual YieldAction update(const sf::Time& elapsed, const std::vector<sf::Event::KeyEvent>& typed);
+
+	virtual void interpolate(float alpha);
 
 	virtual void render();
 
 	//Temporary, for testing Lua.
 	void changeBgColor(long elapsedMs);
 
+	///The ground layer's tile id at pixel (x,y), or 0 if there's none.
+	int tileAt(float x, float y) const;
+
 private:
 	//The console for this Slice.
 	ConsoleSlice* console;
 
 	YieldAction processKeyPress(const sf::Event::KeyEvent& key, const sf::Time& elapsed);
 
+	//Apply a (re-)loaded map. Unless "all" is set, only sections that differ from the current map are re-loaded.
+	void applyMap(const Json::Value& root, bool all);
+	void compileMap(const mapfile::MapData& map);
+	void subscribeReloads();
+	void loadBackground(const Json::Value& root);
+	void loadTiles(const Json::Value& root);
+	void loadTileMap(const Json::Value& root);
+	void loadStreaming(const Json::Value& root);
+	void loadGround(const Json::Value& root);
+	void drawTile(const mapfile::Tile& tile);
+	void loadOnUpdate(const Json::Value& root);
+	void loadNpcs(const Json::Value& root);
+	void releaseNpcs(); //Take our NPCs out of any script domain, and drop their handlers.
+	void loadBehaviours(const Json::Value& root);
+
+	//Console commands.
+	YieldAction handleConsoleResults();
+	std::string runLua(const std::string& code);
+	std::string setBudget(const std::list<std::string>& params);
+	std::string profile(const std::list<std::string>& params);
+
+	//The map we loaded, as of its last (re-)load.
+	std::string mapFile;
+	std::string mapPath;
+	Json::Value mapJson;
+
 	//Properties.
 	sf::Color bkgrdColor;
-	std::map<std::string, sf::Texture*> tiles;
-	std::vector<sf::Sprite> tmap;
+	std::map<std::string, AssetManager::TextureHandle> tiles; //These may still be loading.
+	std::map<std::string, std::string> tileFiles;
+
+	//The ground layer, drawn under everything else (its ids may point into the compiled map).
+	TileGrid ground;
+	std::string groundFile;
+
+	//Only used if we couldn't compile the map.
+	struct PlacedTile {
+		AssetManager::TextureHandle texture;
+		sf::Vector2f pos;
+		PlacedTile(const AssetManager::TextureHandle& texture, const sf::Vector2f& pos) : texture(texture), pos(pos) {}
+	};
+	std::vector<PlacedTile> tmap;
+
+	//The compiled map (memory-mapped), its textures (by tile type id), and scratch space for drawing it.
+	CompiledMap compiled;
+	std::vector<AssetManager::TextureHandle> tileTypes;
+	std::vector<uint32_t> visibleTiles;
+	sf::Sprite tileSprite; //Every tile is drawn with this.
+
+	//For large maps, the chunks of the compiled map near the camera.
+	ChunkStreamer streamer;
+	std::vector<ChunkStreamer::TileRef> visibleRefs;
 	std::string onupdate; //Lua script
+	int onupdateRef;      //Compiled onupdate(this, elapsed), in the Lua registry.
+	int thisRef;          //Our own Lua object, in the Lua registry (so we don't re-bind it every frame).
+
+	//Behaviours (Lua coroutines) started when the map loads; they're run by the engine's ScriptScheduler.
+	std::vector<std::string> behaviours;
+
+	//Script domains (isolated Lua states, run on worker threads) created by this map.
+	std::vector<std::string> domainNames;
+
+	//NPCs, one batch per kind (each kind has one Lua handler for all of its members).
+	std::list<EntityBatch> npcs;
+	sf::VertexArray npcVerts;
+
+	//Camera position (pixels) at the last two updates, and the blended position we render at.
+	sf::Vector2f prevCamera;
+	sf::Vector2f camera;
+	sf::View mapView;
+	bool cameraPlaced;
 
 	GameEngineControl* geControl;
 	sf::RenderWindow* window;
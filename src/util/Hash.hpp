@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+///Non-cryptographic hashing, for content-addressed caches.
+namespace hash {
+
+const uint64_t FnvOffset = 14695981039346656037ULL;
+const uint64_t FnvPrime = 1099511628211ULL;
+
+///64-bit FNV-1a. Pass a previous result as "seed" to hash several buffers as one.
+inline uint64_t Fnv1a(const void* data, size_t len, uint64_t seed=FnvOffset)
+{
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	uint64_t res = seed;
+	for (size_t i=0; i<len; i++) {
+		res ^= p[i];
+		res *= FnvPrime;
+	}
+	return res;
+}
+
+inline uint64_t Fnv1a(const std::string& str, uint64_t seed=FnvOffset)
+{
+	return Fnv1a(str.data(), str.size(), seed);
+}
+
+///Format a hash as 16 hex digits (e.g., for file names).
+inline std::string ToHex(uint64_t val)
+{
+	const char* Digits = "0123456789abcdef";
+	std::string res(16, '0');
+	for (int i=15; i>=0; i--) {
+		res[i] = Digits[val&0xF];
+		val >>= 4;
+	}
+	return res;
+}
+
+}
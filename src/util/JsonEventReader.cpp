@@ -0,0 +1,239 @@
+#include "JsonEventReader.hpp"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+
+
+namespace {
+///Append code point "cp" to "out", as UTF-8.
+void AppendUtf8(std::string& out, unsigned int cp)
+{
+	if (cp<0x80) {
+		out.push_back(static_cast<char>(cp));
+	} else if (cp<0x800) {
+		out.push_back(static_cast<char>(0xC0 | (cp>>6)));
+		out.push_back(static_cast<char>(0x80 | (cp&0x3F)));
+	} else if (cp<0x10000) {
+		out.push_back(static_cast<char>(0xE0 | (cp>>12)));
+		out.push_back(static_cast<char>(0x80 | ((cp>>6)&0x3F)));
+		out.push_back(static_cast<char>(0x80 | (cp&0x3F)));
+	} else {
+		out.push_back(static_cast<char>(0xF0 | (cp>>18)));
+		out.push_back(static_cast<char>(0x80 | ((cp>>12)&0x3F)));
+		out.push_back(static_cast<char>(0x80 | ((cp>>6)&0x3F)));
+		out.push_back(static_cast<char>(0x80 | (cp&0x3F)));
+	}
+}
+} //End un-named namespace
+
+
+JsonEventReader::JsonEventReader(const char* begin, const char* end) : begin(begin), end(end), pos(begin),
+	started(false), afterKey(false), num(0)
+{
+	numText[0] = '\0';
+}
+
+
+void JsonEventReader::fail(const char* msg) const
+{
+	std::stringstream res;
+	res <<"JSON error on line " <<(std::count(begin, pos, '\n')+1) <<": " <<msg;
+	throw std::runtime_error(res.str());
+}
+
+
+void JsonEventReader::skipSpace()
+{
+	while (pos<end) {
+		if (*pos==' ' || *pos=='\t' || *pos=='\n' || *pos=='\r') {
+			pos++;
+		} else if (*pos=='/' && pos+1<end && pos[1]=='/') {
+			pos = std::find(pos, end, '\n');
+		} else if (*pos=='/' && pos+1<end && pos[1]=='*') {
+			const char* close = "*/";
+			const char* found = std::search(pos+2, end, close, close+2);
+			if (found==end) { fail("unterminated comment"); }
+			pos = found + 2;
+		} else {
+			break;
+		}
+	}
+}
+
+
+void JsonEventReader::expect(char c)
+{
+	skipSpace();
+	if (pos==end || *pos!=c) {
+		char msg[] = "expected ' '";
+		msg[10] = c;
+		fail(msg);
+	}
+	pos++;
+}
+
+
+JsonEventReader::Event JsonEventReader::next()
+{
+	skipSpace();
+
+	//Outside of everything: the top-level value, then nothing else.
+	if (stack.empty()) {
+		if (started) {
+			if (pos!=end) { fail("unexpected text after the end"); }
+			return Event::End;
+		}
+		started = true;
+		return value();
+	}
+
+	//The value of a key we've just read.
+	if (afterKey) {
+		afterKey = false;
+		return value();
+	}
+
+	//The end of the current object/array, or its next item (after a comma, unless it's the first).
+	Frame& frame = stack.back();
+	char close = frame.kind=='{' ? '}' : ']';
+	if (pos<end && *pos==close) {
+		pos++;
+		stack.pop_back();
+		return close=='}' ? Event::EndObject : Event::EndArray;
+	}
+	if (!frame.empty) {
+		expect(',');
+		skipSpace();
+	}
+	frame.empty = false;
+	if (frame.kind=='[') {
+		return value();
+	}
+
+	//Objects have "key": value.
+	if (pos==end || *pos!='"') { fail("expected a key"); }
+	readString();
+	expect(':');
+	afterKey = true;
+	return Event::Key;
+}
+
+
+JsonEventReader::Event JsonEventReader::value()
+{
+	if (pos==end) { fail("unexpected end of file"); }
+	switch (*pos) {
+		case '{':
+		case '[': {
+			Frame frame = {*pos, true};
+			stack.push_back(frame);
+			pos++;
+			return frame.kind=='{' ? Event::BeginObject : Event::BeginArray;
+		}
+		case '"':
+			readString();
+			return Event::String;
+		case 't':
+			readLiteral("true");
+			num = 1;
+			return Event::Bool;
+		case 'f':
+			readLiteral("false");
+			num = 0;
+			return Event::Bool;
+		case 'n':
+			readLiteral("null");
+			return Event::Null;
+		default:
+			readNumber();
+			return Event::Number;
+	}
+}
+
+
+void JsonEventReader::skip(Event ev)
+{
+	if (ev!=Event::BeginObject && ev!=Event::BeginArray) { return; }
+	size_t depth = stack.size();
+	while (stack.size()>=depth) {
+		if (next()==Event::End) { fail("unexpected end of file"); }
+	}
+}
+
+
+void JsonEventReader::readString()
+{
+	str.clear();
+	pos++; //Opening quote.
+	for (;;) {
+		//Copy plain characters in one go.
+		const char* stop = pos;
+		while (stop<end && *stop!='"' && *stop!='\\') {
+			stop++;
+		}
+		str.append(pos, stop);
+		pos = stop;
+		if (pos==end) { fail("unterminated string"); }
+		if (*pos++=='"') { return; }
+
+		//Escapes.
+		if (pos==end) { fail("unterminated string"); }
+		char c = *pos++;
+		switch (c) {
+			case '"': case '\\': case '/': str.push_back(c); break;
+			case 'b': str.push_back('\b'); break;
+			case 'f': str.push_back('\f'); break;
+			case 'n': str.push_back('\n'); break;
+			case 'r': str.push_back('\r'); break;
+			case 't': str.push_back('\t'); break;
+			case 'u': {
+				unsigned int cp = 0;
+				for (int i=0; i<4; i++) {
+					if (pos==end || !std::isxdigit(static_cast<unsigned char>(*pos))) { fail("bad unicode escape"); }
+					char hex[2] = {*pos++, '\0'};
+					cp = cp*16 + std::strtoul(hex, nullptr, 16);
+				}
+				//Surrogate pairs come as two escapes.
+				if (cp>=0xD800 && cp<0xDC00 && end-pos>=6 && pos[0]=='\\' && pos[1]=='u') {
+					char hex[5] = {pos[2], pos[3], pos[4], pos[5], '\0'};
+					unsigned int low = std::strtoul(hex, nullptr, 16);
+					if (low>=0xDC00 && low<0xE000) {
+						cp = 0x10000 + ((cp-0xD800)<<10) + (low-0xDC00);
+						pos += 6;
+					}
+				}
+				AppendUtf8(str, cp);
+				break;
+			}
+			default:
+				fail("bad escape in string");
+		}
+	}
+}
+
+
+void JsonEventReader::readNumber()
+{
+	//The text may not be null-terminated, so copy the number out first.
+	size_t len = 0;
+	while (pos<end && len<sizeof(numText)-1 && (std::isdigit(static_cast<unsigned char>(*pos)) || (*pos && std::strchr("+-.eE", *pos)))) {
+		numText[len++] = *pos++;
+	}
+	numText[len] = '\0';
+
+	char* stop = nullptr;
+	num = std::strtod(numText, &stop);
+	if (len==0 || stop!=numText+len) { fail("bad value"); }
+}
+
+
+void JsonEventReader::readLiteral(const char* word)
+{
+	size_t len = std::strlen(word);
+	if (size_t(end-pos)<len || !std::equal(word, word+len, pos)) { fail("bad value"); }
+	pos += len;
+}
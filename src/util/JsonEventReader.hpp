@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+
+/**
+ * Reads JSON as a stream of events (begin/end of objects and arrays, keys, and values), instead of
+ *   parsing it into a tree. Callers pull one event at a time with next(), and build whatever they
+ *   want from it directly, so memory use is only what they keep. Comments (both "//" and C-style) are
+ *   allowed, as in JsonCpp.
+ *
+ * The text isn't copied, and must outlive the reader (e.g., a MappedFile). Reading a key or string
+ *   re-uses one buffer, so steady-state reading doesn't allocate.
+ *
+ * Throws std::runtime_error (with the line number) on malformed JSON.
+ */
+class JsonEventReader {
+public:
+	enum class Event { BeginObject, EndObject, BeginArray, EndArray, Key, String, Number, Bool, Null, End };
+
+	JsonEventReader(const char* begin, const char* end);
+
+	///Read the next event. After the top-level value has been read, this returns End.
+	Event next();
+
+	///If "ev" (the last event) began an object or array, skip to its end (so that next() reads whatever follows).
+	void skip(Event ev);
+
+	///The last Key or String.
+	const std::string& string() const { return str; }
+
+	///The last Number or Bool.
+	double number() const { return num; }
+	bool boolean() const { return num!=0; }
+
+	///The last Number, exactly as written (e.g., to tell "3" from "3.0", or to read integers too big for a double).
+	const char* numberText() const { return numText; }
+
+	///How far we've read.
+	size_t offset() const { return pos-begin; }
+	size_t size() const { return end-begin; }
+
+private:
+	///An open object or array.
+	struct Frame {
+		char kind;  //'{' or '['
+		bool empty; //No items read yet.
+	};
+
+	Event value();
+	void readString();
+	void readNumber();
+	void readLiteral(const char* word);
+	void skipSpace();
+	void expect(char c);
+	void fail(const char* msg) const;
+
+	const char* begin;
+	const char* end;
+	const char* pos;
+
+	std::vector<Frame> stack;
+	bool started;  //Have we begun the top-level value?
+	bool afterKey; //Did we just read a key (so a value comes next)?
+
+	std::string str;
+	double num;
+	char numText[64];
+};
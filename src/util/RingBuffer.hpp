@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+#include <stdexcept>
+
+
+/**
+ * A fixed-capacity FIFO that overwrites its oldest element once full. Storage is allocated
+ *   once (at construction, or on setCapacity()), so pushing never touches the heap for types
+ *   which don't allocate themselves.
+ *
+ * Elements are indexed from oldest (0) to newest (size()-1). The buffer also counts every
+ *   element ever pushed; since pushed elements are never modified in-place, the pair
+ *   (totalPushed()-size()+i) uniquely identifies element "i" for the lifetime of the buffer
+ *   (until clear()). This makes it cheap for callers to cache data derived from an element.
+ */
+template <class T>
+class RingBuffer {
+public:
+	explicit RingBuffer(size_t capacity) : head(0), count(0), pushed(0) {
+		setCapacity(capacity);
+	}
+
+	size_t size() const { return count; }
+	size_t capacity() const { return data.size(); }
+	bool empty() const { return count==0; }
+	bool full() const { return count==data.size(); }
+
+	///Total number of elements pushed since the last clear(); never decreases otherwise.
+	size_t totalPushed() const { return pushed; }
+
+	///Absolute (monotonic) id of the oldest element still stored.
+	size_t firstId() const { return pushed - count; }
+
+	void clear() {
+		head = count = pushed = 0;
+	}
+
+	///Add an item, overwriting the oldest item if we're at capacity.
+	void push_back(const T& item) {
+		data[(head+count)%data.size()] = item;
+		if (count<data.size()) {
+			count++;
+		} else {
+			head = (head+1)%data.size();
+		}
+		pushed++;
+	}
+
+	///Remove the oldest item.
+	void pop_front() {
+		if (count==0) { throw std::runtime_error("RingBuffer::pop_front() on an empty buffer."); }
+		head = (head+1)%data.size();
+		count--;
+	}
+
+	T& operator[](size_t i) { return data[(head+i)%data.size()]; }
+	const T& operator[](size_t i) const { return data[(head+i)%data.size()]; }
+
+	T& front() { return (*this)[0]; }
+	const T& front() const { return (*this)[0]; }
+	T& back() { return (*this)[count-1]; }
+	const T& back() const { return (*this)[count-1]; }
+
+	///Resize the buffer, keeping the newest items. This (re-)allocates.
+	void setCapacity(size_t capacity) {
+		if (capacity==0) { throw std::runtime_error("RingBuffer capacity must be non-zero."); }
+		std::vector<T> res(capacity);
+		size_t keep = std::min(count, capacity);
+		for (size_t i=0; i<keep; i++) {
+			res[i] = (*this)[count-keep+i];
+		}
+		data.swap(res);
+		head = 0;
+		count = keep;
+	}
+
+private:
+	std::vector<T> data;
+	size_t head;   //Index of the oldest element.
+	size_t count;  //Number of valid elements.
+	size_t pushed; //Total pushes.
+};
+
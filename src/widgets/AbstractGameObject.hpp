@@ -1,7 +1,9 @@
 #pragma once
 
 #include <string>
-#include <fstream>
+#include <ostream>
+#include <cstdint>
+#include <algorithm>
 #include <SFML/Graphics.hpp>
 
 #include "geom/Geom.hpp"
@@ -11,18 +13,19 @@
 /**
  * An AbstractGameObject provides all the elements necessary for interaction:
  *    * It (may) have a name that can be used to identify it.
+ *    * It has a unique id (kept across saves), and a version that changes whenever it does.
  *    * It can save/load itself from a file.
  *    * It has a location and size (bounds/position).
  *    * It has instructions for drawing itself.
  */
 class AbstractGameObject {
 public:
-	AbstractGameObject(const std::string& name="") : name(name)
+	AbstractGameObject(const std::string& name="") : name(name), id(++NextId()), version(0)
 	{}
 	virtual ~AbstractGameObject()
 	{}
 
-	virtual void save(std::ofstream& file, int tabLevel) const = 0;
+	virtual void save(std::ostream& file, int tabLevel) const = 0;
 	virtual geom::Rectangle getBounds() const = 0;
 
 	virtual void draw(sf::RenderWindow& window) const = 0;
@@ -31,7 +34,33 @@ public:
 		return name;
 	}
 
+	uint64_t getId() const {
+		return id;
+	}
+
+	//Used when loading; later objects get higher ids.
+	void setId(uint64_t id) {
+		this->id = id;
+		NextId() = std::max(NextId(), id);
+	}
+
+	//Call this after changing the object (e.g., moving it), so that it will be saved again.
+	void touch() {
+		version++;
+	}
+
+	unsigned int getVersion() const {
+		return version;
+	}
+
 private:
+	static uint64_t& NextId() {
+		static uint64_t next = 0;
+		return next;
+	}
+
 	std::string name;
+	uint64_t id;
+	unsigned int version;
 };
 
@@ -6,12 +6,26 @@ CircleGameObject::CircleGameObject(float radius, unsigned int pointCount, const
 	CircleShape(radius, pointCount), AbstractGameObject(name)
 {}
 
-void CircleGameObject::save(std::ofstream& file, int tabLevel) const
+CircleGameObject* CircleGameObject::FromJson(const Json::Value& obj)
+{
+	CircleGameObject* res = new CircleGameObject(obj["radius"].asFloat(), obj.get("point-count", 30).asUInt(), obj["name"].asString());
+	const Json::Value& color = obj["fill-color"];
+	res->setFillColor(sf::Color(color["r"].asUInt(), color["g"].asUInt(), color["b"].asUInt(), color.get("a", 255).asUInt()));
+	res->setPosition(obj["xpos"].asFloat(), obj["ypos"].asFloat());
+	if (obj.isMember("id")) {
+		res->setId(obj["id"].asUInt64());
+	}
+	return res;
+}
+
+void CircleGameObject::save(std::ostream& file, int tabLevel) const
 {
 	const std::string tab(tabLevel, ' ');
 	const std::string Q("\"");
 
 	file <<tab <<"{\n";
+	file <<tab <<"  " <<Q <<"type" <<Q <<" : " <<Q <<"circle" <<Q <<",\n";
+	file <<tab <<"  " <<Q <<"id" <<Q <<" : " <<this->getId() <<",\n";
 	file <<tab <<"  " <<Q <<"radius" <<Q <<" : " <<this->getRadius() <<",\n";
 	file <<tab <<"  " <<Q <<"point-count" <<Q <<" : " <<this->getPointCount() <<",\n";
 
@@ -28,7 +42,7 @@ void CircleGameObject::save(std::ofstream& file, int tabLevel) const
 	file <<tab <<"  " <<Q <<"ypos" <<Q <<" : " <<pos.y <<",\n";
 
 	//Name is always last.
-	file <<tab <<"  " <<Q <<"name" <<Q <<" : " <<Q <<this->getName() <<Q <<"\n";
+	file <<tab <<"  " <<Q <<"name" <<Q <<" : " <<Json::valueToQuotedString(this->getName().c_str()) <<"\n";
 	file <<tab <<"}";
 }
 
@@ -1,8 +1,9 @@
 #pragma once
 
 #include <string>
-#include <fstream>
+#include <ostream>
 #include <SFML/Graphics.hpp>
+#include <jsoncpp/json/json.h>
 #include "AbstractGameObject.hpp"
 #include "geom/Geom.hpp"
 
@@ -14,7 +15,10 @@ class CircleGameObject : public sf::CircleShape, public AbstractGameObject {
 public:
 	CircleGameObject(float radius=0, unsigned int pointCount=30, const std::string& name="");
 
-	virtual void save(std::ofstream& file, int tabLevel) const;
+	///Make one from what save() wrote.
+	static CircleGameObject* FromJson(const Json::Value& obj);
+
+	virtual void save(std::ostream& file, int tabLevel) const;
 
 	virtual geom::Rectangle getBounds() const;
 
@@ -1,47 +1,157 @@
 #include "FpsCounter.hpp"
 
-#include <sstream>
-#include <iomanip>
-#include <iostream>
+#include <cstdio>
+#include <algorithm>
 
-FpsCounter::FpsCounter(int numMeasurements) : maxMeasurements(numMeasurements), runningTotal(0.0), delay(0)
+namespace {
+//Graph size, in pixels. The graph sits under the text; its height maps to 2x the budget.
+const float GraphWidth = 240;
+const float GraphHeight = 50;
+const float GraphTop = 105;
+
+//Helper: the "p"th percentile of the (unsorted) values in "vals". Re-orders vals.
+float Percentile(std::vector<float>& vals, double p)
+{
+	size_t index = std::min(vals.size()-1, static_cast<size_t>(p*vals.size()));
+	std::nth_element(vals.begin(), vals.begin()+index, vals.end());
+	return vals[index];
+}
+} //End un-named namespace
+
+
+FpsCounter::FpsCounter(int numMeasurements) : delay(0), budgetMs(1000.0f/60), overBudgetTotal(0), luaHeap(0),
+	samples(numMeasurements), graph(sf::Quads, numMeasurements*4+4)
+{
+	scratch.reserve(numMeasurements);
+	text.setString("N/A fps");
+}
+
+void FpsCounter::setBudget(const sf::Time& budget)
+{
+	budgetMs = budget.asMicroseconds()/1000.0f;
+}
+
+void FpsCounter::setFont(const sf::Font& font)
+{
+	text.setFont(font);
+}
+
+void FpsCounter::setColor(const sf::Color& color)
+{
+	text.setColor(color);
+}
+
+void FpsCounter::setCharacterSize(unsigned int size)
 {
-	setString("N/A fps");
+	text.setCharacterSize(size);
 }
 
-void FpsCounter::update(const sf::Time& elapsed)
+void FpsCounter::update(const sf::Time& elapsed, const FrameBreakdown& breakdown)
 {
 	//First frame tick.
 	if (elapsed.asSeconds()==0) { return; }
 
 	//Account for this
-	double currMeasure = 1.0/elapsed.asSeconds();
-	runningTotal += currMeasure/maxMeasurements;
-	measurements.push_back(currMeasure);
-
-	//Remove any outstanding values.
-	if (measurements.size()>maxMeasurements) {
-		currMeasure = measurements.front();
-		measurements.pop_front();
-		runningTotal -= currMeasure/maxMeasurements;
+	Sample curr;
+	curr.frameMs = elapsed.asMicroseconds()/1000.0f;
+	curr.updateMs = breakdown.update.asMicroseconds()/1000.0f;
+	curr.scriptMs = breakdown.script.asMicroseconds()/1000.0f;
+	curr.renderMs = breakdown.render.asMicroseconds()/1000.0f;
+	curr.gcMs = breakdown.gc.asMicroseconds()/1000.0f;
+	curr.allocs = breakdown.allocs;
+	samples.push_back(curr);
+	luaHeap = breakdown.luaHeap;
+	if (curr.frameMs>budgetMs) {
+		overBudgetTotal++;
 	}
 
+	//The graph is always live; it's cheap.
+	refreshGraph();
+
 	//Account for the delay.
-	bool update = false;
 	delay -= elapsed.asSeconds();
 	if (delay<=0) {
 		delay += 0.75; //Every 3/4 second, update
-		update = true;
+		refreshText();
 	}
+}
 
-	//Update text?
-	if (update && measurements.size()==maxMeasurements) {
-	    std::stringstream msg;
-	    msg <<std::fixed <<std::setprecision(1); //1 point after the decimal.
-	    msg <<runningTotal <<" fps";
-		setString(msg.str());
+
+void FpsCounter::refreshText()
+{
+	//Percentiles.
+	scratch.clear();
+	Sample mean;
+	unsigned int overBudget = 0;
+	float maxGcMs = 0;
+	for (size_t i=0; i<samples.size(); i++) {
+		const Sample& s = samples[i];
+		scratch.push_back(s.frameMs);
+		mean.frameMs += s.frameMs/samples.size();
+		mean.updateMs += s.updateMs/samples.size();
+		mean.scriptMs += s.scriptMs/samples.size();
+		mean.renderMs += s.renderMs/samples.size();
+		mean.gcMs += s.gcMs/samples.size();
+		mean.allocs += s.allocs/samples.size();
+		maxGcMs = std::max(maxGcMs, s.gcMs);
+		if (s.frameMs>budgetMs) { overBudget++; }
 	}
+	float p50 = Percentile(scratch, 0.50);
+	float p95 = Percentile(scratch, 0.95);
+	float p99 = Percentile(scratch, 0.99);
+	float max = *std::max_element(scratch.begin(), scratch.end());
+
+	//We write into a fixed buffer, to avoid the stringstream.
+	char msg[256];
+	snprintf(msg, sizeof(msg),
+		"%.1f fps  p50 %.1f  p95 %.1f  p99 %.1f  max %.1f ms\n"
+		"over %.1f ms: %u/%u (%u total)\n"
+		"update %.2f  script %.2f  render %.2f ms  allocs/frame %.1f\n"
+		"lua gc %.2f (max %.2f) ms  lua heap %.0f KB",
+		1000.0/mean.frameMs, p50, p95, p99, max,
+		budgetMs, overBudget, static_cast<unsigned int>(samples.size()), overBudgetTotal,
+		mean.updateMs, mean.scriptMs, mean.renderMs, mean.allocs,
+		mean.gcMs, maxGcMs, luaHeap/1024.0);
+	text.setString(msg);
 }
 
 
+void FpsCounter::refreshGraph()
+{
+	//One bar per sample, newest on the right. Bars over budget are red.
+	const float barWidth = GraphWidth / samples.capacity();
+	const float scale = GraphHeight / (budgetMs*2);
+	for (size_t i=0; i<samples.capacity(); i++) {
+		float height = 0;
+		bool over = false;
+		if (i<samples.size()) {
+			const Sample& s = samples[samples.size()-1-i];
+			height = std::min(GraphHeight, s.frameMs*scale);
+			over = s.frameMs>budgetMs;
+		}
 
+		float x = GraphWidth - (i+1)*barWidth;
+		sf::Color color = over ? sf::Color::Red : sf::Color::Green;
+		sf::Vertex* quad = &graph[i*4];
+		quad[0] = sf::Vertex(sf::Vector2f(x, GraphTop+GraphHeight-height), color);
+		quad[1] = sf::Vertex(sf::Vector2f(x+barWidth, GraphTop+GraphHeight-height), color);
+		quad[2] = sf::Vertex(sf::Vector2f(x+barWidth, GraphTop+GraphHeight), color);
+		quad[3] = sf::Vertex(sf::Vector2f(x, GraphTop+GraphHeight), color);
+	}
+
+	//The budget line (1 pixel high) is the last quad.
+	sf::Vertex* quad = &graph[samples.capacity()*4];
+	float y = GraphTop + GraphHeight/2;
+	quad[0] = sf::Vertex(sf::Vector2f(0, y), sf::Color::White);
+	quad[1] = sf::Vertex(sf::Vector2f(GraphWidth, y), sf::Color::White);
+	quad[2] = sf::Vertex(sf::Vector2f(GraphWidth, y+1), sf::Color::White);
+	quad[3] = sf::Vertex(sf::Vector2f(0, y+1), sf::Color::White);
+}
+
+
+void FpsCounter::draw(sf::RenderTarget& target, sf::RenderStates states) const
+{
+	states.transform *= getTransform();
+	target.draw(text, states);
+	target.draw(graph, states);
+}
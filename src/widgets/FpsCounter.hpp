@@ -1,23 +1,78 @@
 #pragma once
 
 #include <SFML/Graphics.hpp>
-#include <list>
+#include <vector>
+
+#include "util/RingBuffer.hpp"
+
+
+/**
+ * How long each phase of a frame took. "update" excludes time spent in scripts.
+ * Also counts calls to the global operator new during the frame, and tracks the Lua heap
+ *   (and the time spent collecting it).
+ */
+struct FrameBreakdown {
+	sf::Time update;
+	sf::Time script;
+	sf::Time render;
+	sf::Time gc;
+	size_t allocs;
+	size_t luaHeap;
+
+	FrameBreakdown() : allocs(0), luaHeap(0) {}
+};
 
 
 /**
- * A Text field that averages the frames-per-second over a given number of past measurements.
- * Performs well enough if performance doesn't fluctuate wildly.
+ * A frame-time HUD. Keeps the last N frame times in a ring buffer and shows:
+ *    * Rolling p50/p95/p99/max frame times (averages hide stutters; percentiles don't).
+ *    * How many frames went over budget (in the window, and since startup).
+ *    * The average update/script/render cost, and heap allocations per frame.
+ *    * Lua GC time (average and worst) and the size of the Lua heap.
+ *    * A small bar graph of recent frame times, with the budget marked.
+ * Only the periodic text refresh allocates (sf::Text copies its string); everything else is
+ *   allocated at construction.
  */
-class FpsCounter : public sf::Text {
+class FpsCounter : public sf::Drawable, public sf::Transformable {
 public:
 	FpsCounter(int numMeasurements);
 
-	void update(const sf::Time& elapsed);
+	///Record the previous frame's total time and its breakdown.
+	void update(const sf::Time& elapsed, const FrameBreakdown& breakdown=FrameBreakdown());
+
+	///Frames longer than this are counted (and graphed) as "over budget". Default is 60Hz.
+	void setBudget(const sf::Time& budget);
+
+	//Forwarded to our text.
+	void setFont(const sf::Font& font);
+	void setColor(const sf::Color& color);
+	void setCharacterSize(unsigned int size);
+
+protected:
+	virtual void draw(sf::RenderTarget& target, sf::RenderStates states) const;
 
 private:
+	struct Sample {
+		float frameMs;
+		float updateMs;
+		float scriptMs;
+		float renderMs;
+		float gcMs;
+		float allocs;
+		Sample() : frameMs(0), updateMs(0), scriptMs(0), renderMs(0), gcMs(0), allocs(0) {}
+	};
+
+	void refreshText();
+	void refreshGraph();
+
 	double delay;
-	int maxMeasurements;
-	std::list<double> measurements;
-	double runningTotal;
-};
+	float budgetMs;
+	unsigned int overBudgetTotal;
+	size_t luaHeap; //As of the last frame.
+
+	RingBuffer<Sample> samples;
+	std::vector<float> scratch; //For percentiles (nth_element re-orders).
 
+	sf::Text text;
+	sf::VertexArray graph;
+};
@@ -6,12 +6,26 @@ RectangleGameObject::RectangleGameObject(double width, double height, const std:
 	RectangleShape(sf::Vector2f(width, height)), AbstractGameObject(name)
 {}
 
-void RectangleGameObject::save(std::ofstream& file, int tabLevel) const
+RectangleGameObject* RectangleGameObject::FromJson(const Json::Value& obj)
+{
+	RectangleGameObject* res = new RectangleGameObject(obj["width"].asDouble(), obj["height"].asDouble(), obj["name"].asString());
+	const Json::Value& color = obj["fill-color"];
+	res->setFillColor(sf::Color(color["r"].asUInt(), color["g"].asUInt(), color["b"].asUInt(), color.get("a", 255).asUInt()));
+	res->setPosition(obj["xpos"].asFloat(), obj["ypos"].asFloat());
+	if (obj.isMember("id")) {
+		res->setId(obj["id"].asUInt64());
+	}
+	return res;
+}
+
+void RectangleGameObject::save(std::ostream& file, int tabLevel) const
 {
 	const std::string tab(tabLevel, ' ');
 	const std::string Q("\"");
 
 	file <<tab <<"{\n";
+	file <<tab <<"  " <<Q <<"type" <<Q <<" : " <<Q <<"rectangle" <<Q <<",\n";
+	file <<tab <<"  " <<Q <<"id" <<Q <<" : " <<this->getId() <<",\n";
 
 	sf::Vector2f sz = this->getSize();
 	file <<tab <<"  " <<Q <<"width" <<Q <<" : " <<sz.x <<",\n";
@@ -30,7 +44,7 @@ void RectangleGameObject::save(std::ofstream& file, int tabLevel) const
 	file <<tab <<"  " <<Q <<"ypos" <<Q <<" : " <<pos.y <<",\n";
 
 	//Name is always last.
-	file <<tab <<"  " <<Q <<"name" <<Q <<" : " <<Q <<this->getName() <<Q <<"\n";
+	file <<tab <<"  " <<Q <<"name" <<Q <<" : " <<Json::valueToQuotedString(this->getName().c_str()) <<"\n";
 	file <<tab <<"}";
 }
 
@@ -1,8 +1,9 @@
 #pragma once
 
 #include <string>
-#include <fstream>
+#include <ostream>
 #include <SFML/Graphics.hpp>
+#include <jsoncpp/json/json.h>
 #include "AbstractGameObject.hpp"
 #include "geom/Geom.hpp"
 
@@ -14,7 +15,10 @@ class RectangleGameObject : public sf::RectangleShape, public AbstractGameObject
 public:
 	RectangleGameObject(double width=0, double height=0, const std::string& name="");
 
-	virtual void save(std::ofstream& file, int tabLevel) const;
+	///Make one from what save() wrote.
+	static RectangleGameObject* FromJson(const Json::Value& obj);
+
+	virtual void save(std::ostream& file, int tabLevel) const;
 
 	virtual geom::Rectangle getBounds() const;
 
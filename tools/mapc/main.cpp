@@ -0,0 +1,37 @@
+#include <string>
+#include <iostream>
+#include <stdexcept>
+
+#include "map/MapCompiler.hpp"
+#include "map/MapReader.hpp"
+
+
+/**
+ * The offline map compiler. Converts each map_*.json given into its binary form (see map/MapFormat.hpp),
+ *   written next to it as a ".pmap". The game also does this itself when a map's JSON is newer than
+ *   its compiled form; this tool is for building them ahead of time (e.g., before shipping).
+ */
+int main(int argc, char* argv[])
+{
+	if (argc<2) {
+		std::cout <<"Usage: " <<argv[0] <<" <map.json> [<map.json> ...]\n";
+		return 1;
+	}
+
+	int failed = 0;
+	for (int i=1; i<argc; i++) {
+		std::string file = argv[i];
+		try {
+			mapfile::MapData map;
+			mapfile::ReadMapFile(file, map);
+
+			std::string outFile = mapfile::CompiledPath(file);
+			mapfile::Compile(map, outFile);
+			std::cout <<file <<" -> " <<outFile <<"\n";
+		} catch (std::exception& ex) {
+			std::cout <<"Error compiling " <<file <<": " <<ex.what() <<"\n";
+			failed++;
+		}
+	}
+	return failed>0 ? 1 : 0;
+}
@@ -0,0 +1,140 @@
+#include <string>
+#include <vector>
+#include <iostream>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+#include "map/MapCompiler.hpp"
+#include "map/MapReader.hpp"
+#include "pack/PackFormat.hpp"
+#include "pack/PackWriter.hpp"
+#include "platform/Fonts.hpp"
+
+
+namespace {
+namespace fs = boost::filesystem;
+
+///Hidden files (or anything in a hidden directory), and files the game writes for itself, don't belong in a pack.
+bool Skip(const fs::path& path)
+{
+	for (const fs::path& part : path) {
+		std::string name = part.string();
+		if (name.size()>1 && name[0]=='.' && name!="..") { return true; }
+	}
+	std::string ext = path.extension().string();
+	return ext==".tmp" || ext==".journal" || ext==".pack";
+}
+
+///A path relative to the current directory, with '/' separators (as the game names it).
+std::string PackName(const fs::path& path)
+{
+	std::string res;
+	for (const fs::path& part : path) {
+		std::string name = part.string();
+		if (name.empty() || name==".") { continue; }
+		if (!res.empty()) { res += "/"; }
+		res += name;
+	}
+	return res;
+}
+
+///Compile every map_*.json under "dir" (so the pack has up-to-date .pmap files, and their chunks).
+int CompileMaps(const fs::path& dir)
+{
+	int failed = 0;
+	boost::system::error_code err;
+	for (fs::recursive_directory_iterator it(dir, err), end; !err && it!=end; it.increment(err)) {
+		std::string name = it->path().filename().string();
+		if (!fs::is_regular_file(it->status()) || name.compare(0, 4, "map_")!=0 || it->path().extension()!=".json") { continue; }
+		std::string file = it->path().string();
+		try {
+			mapfile::MapData map;
+			mapfile::ReadMapFile(file, map);
+			mapfile::Compile(map, mapfile::CompiledPath(file));
+		} catch (std::exception& ex) {
+			std::cout <<"Error compiling " <<file <<": " <<ex.what() <<"\n";
+			failed++;
+		}
+	}
+	return failed;
+}
+
+///Add every file under "dir" (or "dir" itself, if it's a file).
+void Gather(const fs::path& dir, std::vector<packfile::Source>& files)
+{
+	if (fs::is_regular_file(dir)) {
+		files.push_back(packfile::Source(PackName(dir), dir.string()));
+		return;
+	}
+	boost::system::error_code err;
+	for (fs::recursive_directory_iterator it(dir, err), end; !err && it!=end; it.increment(err)) {
+		if (fs::is_regular_file(it->status()) && !Skip(it->path())) {
+			files.push_back(packfile::Source(PackName(it->path()), it->path().string()));
+		}
+	}
+	if (err) {
+		throw std::runtime_error("Can't read directory: " + dir.string());
+	}
+}
+} //End un-named namespace
+
+
+/**
+ * The asset packer. Bundles the given directories (e.g., "res" and "script") into one asset pack (see
+ *   pack/PackFormat.hpp), named as the game names them. Run it from the directory the game runs in,
+ *   and put the pack there too. Maps are compiled first (so the game never needs to), and a monospace
+ *   font is bundled (the one given, or the system's), so that the game needn't go looking for one.
+ */
+int main(int argc, char* argv[])
+{
+	if (argc<3) {
+		std::cout <<"Usage: " <<argv[0] <<" <out.pack> <dir|file> [<dir|file> ...] [--font <file>|--no-font]\n";
+		return 1;
+	}
+
+	std::string outFile = argv[1];
+	std::vector<std::string> dirs;
+	std::string font;
+	bool useFont = true;
+	for (int i=2; i<argc; i++) {
+		std::string arg = argv[i];
+		if (arg=="--font" && i+1<argc) {
+			font = argv[++i];
+		} else if (arg=="--no-font") {
+			useFont = false;
+		} else {
+			dirs.push_back(arg);
+		}
+	}
+
+	int failed = 0;
+	std::vector<packfile::Source> files;
+	try {
+		for (const std::string& dir : dirs) {
+			if (fs::is_directory(dir)) {
+				failed += CompileMaps(dir);
+			}
+			Gather(dir, files);
+		}
+
+		if (useFont) {
+			if (font.empty()) {
+				font = platform::GuessMonoFont();
+			}
+			if (fs::is_regular_file(font)) {
+				files.push_back(packfile::Source(packfile::MonoFont, font));
+			} else {
+				std::cout <<"Warn: no monospace font found; the game will look for one when it starts.\n";
+			}
+		}
+
+		packfile::Write(outFile, files);
+	} catch (std::exception& ex) {
+		std::cout <<"Error: " <<ex.what() <<"\n";
+		return 1;
+	}
+
+	std::cout <<"Packed " <<files.size() <<" files into " <<outFile <<"\n";
+	return failed>0 ? 1 : 0;
+}